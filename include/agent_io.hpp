@@ -1,11 +1,16 @@
 #pragma once
 #include "fstream"
 #include "network.hpp"
+#include "util/buffered_writer.hpp"
 #include "util/misc.hpp"
 #include <fmt/core.h>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
+#include <charconv>
+#include <iterator>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
 namespace Seldon
@@ -17,6 +22,27 @@ template<typename AgentT>
     return "";
 }
 
+/*
+Appends the string representation of the agent to buffer, without allocating a temporary string.
+Agent types can specialize this; by default it falls back to agent_to_string.
+*/
+template<typename AgentT>
+void agent_to_buffer( fmt::memory_buffer & buffer, const AgentT & agent )
+{
+    const std::string str = agent_to_string( agent );
+    buffer.append( str );
+}
+
+/*
+Writes the numeric fields of the agent to columns, in the order of agent_to_string_column_names.
+Agent types that can be written to a trajectory file specialize this.
+*/
+template<typename AgentT>
+void agent_to_columns( const AgentT & agent [[maybe_unused]], std::span<double> columns [[maybe_unused]] )
+{
+    throw std::runtime_error( "This agent type cannot be written to a trajectory file" );
+}
+
 template<typename AgentT>
 [[nodiscard]] std::string opinion_to_string( const AgentT & agent [[maybe_unused]] )
 {
@@ -35,14 +61,14 @@ template<typename AgentT>
     return { "agent_data[...]" };
 }
 
-template<typename AgentT>
-void agents_to_file( const Network<AgentT> & network, const std::string & file_path )
+/*
+Writes n_rows agents to a file, where row idx_row holds the agent agent_at( idx_row ) with the index
+index_at( idx_row ) in the first column
+*/
+template<typename AgentT, typename AgentAtT, typename IndexAtT>
+void agent_rows_to_file(
+    const std::string & file_path, size_t n_rows, AgentAtT agent_at, IndexAtT index_at, size_t n_threads = 1 )
 {
-    std::fstream fs;
-    fs.open( file_path, std::fstream::in | std::fstream::out | std::fstream::trunc );
-
-    size_t n_agents = network.n_agents();
-
     auto column_names = agent_to_string_column_names<AgentT>();
 
     std::string header = "# idx_agent";
@@ -52,13 +78,41 @@ void agents_to_file( const Network<AgentT> & network, const std::string & file_p
     }
     header += "\n";
 
-    fmt::print( fs, "{}", header );
-    for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+    // Every row is "{:>5}, {:>25}\n", with the agent formatted into a per-thread scratch buffer first,
+    // so that it can be right aligned
+    auto format_row = [&]( fmt::memory_buffer & buffer, size_t idx_row )
     {
-        std::string row = fmt::format( "{:>5}, {:>25}\n", idx_agent, agent_to_string( network.agents[idx_agent] ) );
-        fs << row;
-    }
-    fs.close();
+        thread_local fmt::memory_buffer agent_buffer;
+        agent_buffer.clear();
+        agent_to_buffer( agent_buffer, agent_at( idx_row ) );
+
+        fmt::format_to( std::back_inserter( buffer ), "{:>5}, ", index_at( idx_row ) );
+        append_right_aligned( buffer, std::string_view( agent_buffer.data(), agent_buffer.size() ), 25 );
+        buffer.push_back( '\n' );
+    };
+
+    write_rows_to_file( file_path, header, n_rows, format_row, n_threads );
+}
+
+template<typename AgentT>
+void agents_to_file( const Network<AgentT> & network, const std::string & file_path, size_t n_threads = 1 )
+{
+    agent_rows_to_file<AgentT>(
+        file_path, network.n_agents(), [&]( size_t idx_row ) -> const AgentT & { return network.agents[idx_row]; },
+        []( size_t idx_row ) { return idx_row; }, n_threads );
+}
+
+/*
+Writes a subset of the agents: row i holds agents[i] with the index agent_indices[i] in the first column
+*/
+template<typename AgentT>
+void agents_to_file(
+    const std::vector<AgentT> & agents, const std::vector<size_t> & agent_indices, const std::string & file_path,
+    size_t n_threads = 1 )
+{
+    agent_rows_to_file<AgentT>(
+        file_path, agents.size(), [&]( size_t idx_row ) -> const AgentT & { return agents[idx_row]; },
+        [&]( size_t idx_row ) { return agent_indices[idx_row]; }, n_threads );
 }
 
 template<typename AgentT>
@@ -101,4 +155,39 @@ std::vector<AgentT> agents_from_file( const std::string & file )
     return agents;
 }
 
+/*
+Reads a list of agent indices, one per line. Empty lines and lines starting with '#' are ignored.
+*/
+inline std::vector<size_t> agent_indices_from_file( const std::string & file )
+{
+    std::vector<size_t> agent_indices{};
+
+    std::string file_contents = get_file_contents( file );
+    size_t start_of_line      = 0;
+    while( start_of_line < file_contents.size() )
+    {
+        auto end_of_line = file_contents.find( '\n', start_of_line );
+        if( end_of_line == std::string::npos )
+            end_of_line = file_contents.size();
+
+        auto line     = file_contents.substr( start_of_line, end_of_line - start_of_line );
+        start_of_line = end_of_line + 1;
+
+        auto first = line.find_first_not_of( " \t\r" );
+        if( first == std::string::npos || line[first] == '#' )
+            continue;
+
+        size_t idx_agent = 0;
+        auto last        = line.find_last_not_of( " \t\r" ) + 1;
+        auto result      = std::from_chars( line.data() + first, line.data() + last, idx_agent );
+        if( result.ec != std::errc() || result.ptr != line.data() + last )
+        {
+            throw std::runtime_error( fmt::format( "Invalid agent index '{}' in {}", line, file ) );
+        }
+        agent_indices.push_back( idx_agent );
+    }
+
+    return agent_indices;
+}
+
 } // namespace Seldon
\ No newline at end of file
@@ -15,10 +15,19 @@ struct ActivityAgentData
 
 using ActivityAgent = Agent<ActivityAgentData>;
 
+template<>
+inline void agent_to_buffer<ActivityAgent>( fmt::memory_buffer & buffer, const ActivityAgent & agent )
+{
+    fmt::format_to(
+        std::back_inserter( buffer ), "{}, {}, {}", agent.data.opinion, agent.data.activity, agent.data.reluctance );
+}
+
 template<>
 inline std::string agent_to_string<ActivityAgent>( const ActivityAgent & agent )
 {
-    return fmt::format( "{}, {}, {}", agent.data.opinion, agent.data.activity, agent.data.reluctance );
+    fmt::memory_buffer buffer;
+    agent_to_buffer( buffer, agent );
+    return fmt::to_string( buffer );
 }
 
 template<>
@@ -59,4 +68,12 @@ inline std::vector<std::string> agent_to_string_column_names<ActivityAgent>()
 {
     return { "opinion", "activity", "reluctance" };
 }
+
+template<>
+inline void agent_to_columns<ActivityAgent>( const ActivityAgent & agent, std::span<double> columns )
+{
+    columns[0] = agent.data.opinion;
+    columns[1] = agent.data.activity;
+    columns[2] = agent.data.reluctance;
+}
 } // namespace Seldon
\ No newline at end of file
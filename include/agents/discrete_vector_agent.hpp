@@ -18,17 +18,24 @@ struct DiscreteVectorAgentData
 using DiscreteVectorAgent = Agent<DiscreteVectorAgentData>;
 
 template<>
-inline std::string agent_to_string<DiscreteVectorAgent>( const DiscreteVectorAgent & agent )
+inline void agent_to_buffer<DiscreteVectorAgent>( fmt::memory_buffer & buffer, const DiscreteVectorAgent & agent )
 {
     if( agent.data.opinion.empty() )
-        return "";
+        return;
 
-    auto res = fmt::format( "{}", agent.data.opinion[0] );
+    fmt::format_to( std::back_inserter( buffer ), "{}", agent.data.opinion[0] );
     for( size_t i = 1; i < agent.data.opinion.size(); i++ )
     {
-        res += fmt::format( ", {}", agent.data.opinion[i] );
+        fmt::format_to( std::back_inserter( buffer ), ", {}", agent.data.opinion[i] );
     }
-    return res;
+}
+
+template<>
+inline std::string agent_to_string<DiscreteVectorAgent>( const DiscreteVectorAgent & agent )
+{
+    fmt::memory_buffer buffer;
+    agent_to_buffer( buffer, agent );
+    return fmt::to_string( buffer );
 }
 
 template<>
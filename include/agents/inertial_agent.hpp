@@ -17,11 +17,20 @@ struct InertialAgentData
 
 using InertialAgent = Agent<InertialAgentData>;
 
+template<>
+inline void agent_to_buffer<InertialAgent>( fmt::memory_buffer & buffer, const InertialAgent & agent )
+{
+    fmt::format_to(
+        std::back_inserter( buffer ), "{}, {}, {}, {}", agent.data.opinion, agent.data.velocity, agent.data.activity,
+        agent.data.reluctance );
+}
+
 template<>
 inline std::string agent_to_string<InertialAgent>( const InertialAgent & agent )
 {
-    return fmt::format(
-        "{}, {}, {}, {}", agent.data.opinion, agent.data.velocity, agent.data.activity, agent.data.reluctance );
+    fmt::memory_buffer buffer;
+    agent_to_buffer( buffer, agent );
+    return fmt::to_string( buffer );
 }
 
 template<>
@@ -65,4 +74,13 @@ inline std::vector<std::string> agent_to_string_column_names<InertialAgent>()
 {
     return { "opinion", "velocity", "activity", "reluctance" };
 }
+
+template<>
+inline void agent_to_columns<InertialAgent>( const InertialAgent & agent, std::span<double> columns )
+{
+    columns[0] = agent.data.opinion;
+    columns[1] = agent.data.velocity;
+    columns[2] = agent.data.activity;
+    columns[3] = agent.data.reluctance;
+}
 } // namespace Seldon
\ No newline at end of file
@@ -13,10 +13,18 @@ struct SimpleAgentData
 
 using SimpleAgent = Agent<SimpleAgentData>;
 
+template<>
+inline void agent_to_buffer<SimpleAgent>( fmt::memory_buffer & buffer, const SimpleAgent & agent )
+{
+    fmt::format_to( std::back_inserter( buffer ), "{}", agent.data.opinion );
+}
+
 template<>
 inline std::string agent_to_string<SimpleAgent>( const SimpleAgent & agent )
 {
-    return fmt::format( "{}", agent.data.opinion );
+    fmt::memory_buffer buffer;
+    agent_to_buffer( buffer, agent );
+    return fmt::to_string( buffer );
 }
 
 template<>
@@ -38,4 +46,10 @@ inline std::vector<std::string> agent_to_string_column_names<SimpleAgent>()
 {
     return { "opinion" };
 }
+
+template<>
+inline void agent_to_columns<SimpleAgent>( const SimpleAgent & agent, std::span<double> columns )
+{
+    columns[0] = agent.data.opinion;
+}
 } // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,295 @@
+#pragma once
+#include "agent_io.hpp"
+#include "network.hpp"
+#include <fmt/format.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Binary checkpoint of the state of a simulation, from which it continues bit for bit.
+
+    header  : "SELDCKPT", uint32 byte order mark, uint32 version, uint64 n_iterations
+    rng     : uint64 n_bytes, followed by the textual state of the std::mt19937 engine
+    agents  : uint64 n_agents, uint8 encoding, uint64 n_bytes per agent (encoding 0 only), the agents
+    network : uint8 direction (0 incoming, 1 outgoing), for every agent uint64 n_edges, the neighbour indices as
+              uint64 and the weights
+    model   : uint64 n_bytes, followed by the state of the model, see Model::state_to_buffer
+    footer  : uint64 checksum of everything before
+
+Agents with trivially copyable data are stored as the raw bytes of their data (encoding 0), all other agents as
+uint64 length prefixed strings of agent_to_string (encoding 1). All numbers are in the native byte order of the host
+that wrote the checkpoint, which the byte order mark records, so checkpoints only restart on hosts of the same byte
+order.
+
+Everything else the models keep between iterations is either recomputed in every iteration, depends only on the
+settings, or is part of the state of the model, e.g. the opinions and normalisations that the incremental mean-field
+weights were computed with.
+*/
+namespace Checkpoint
+{
+constexpr char file_magic[8]       = { 'S', 'E', 'L', 'D', 'C', 'K', 'P', 'T' };
+constexpr uint32_t byte_order_mark = 0x01020304;
+constexpr uint32_t version         = 3;
+
+constexpr uint8_t encoding_raw    = 0;
+constexpr uint8_t encoding_string = 1;
+
+uint64_t checksum( const char * data, size_t n_bytes );
+
+template<typename T>
+void append_pod( std::vector<char> & out, const T & value )
+{
+    const char * bytes = reinterpret_cast<const char *>( &value );
+    out.insert( out.end(), bytes, bytes + sizeof( T ) );
+}
+
+template<typename T>
+void append_array( std::vector<char> & out, const T * values, size_t n_values )
+{
+    const char * bytes = reinterpret_cast<const char *>( values );
+    out.insert( out.end(), bytes, bytes + n_values * sizeof( T ) );
+}
+
+template<typename T>
+T extract_pod( const std::vector<char> & in, size_t & position )
+{
+    if( position + sizeof( T ) > in.size() )
+        throw std::runtime_error( "Unexpected end of checkpoint" );
+    T value;
+    std::memcpy( &value, in.data() + position, sizeof( T ) );
+    position += sizeof( T );
+    return value;
+}
+
+template<typename T>
+void extract_array( const std::vector<char> & in, size_t & position, T * values, size_t n_values )
+{
+    if( position + n_values * sizeof( T ) > in.size() )
+        throw std::runtime_error( "Unexpected end of checkpoint" );
+    std::memcpy( values, in.data() + position, n_values * sizeof( T ) );
+    position += n_values * sizeof( T );
+}
+
+inline std::string extract_string( const std::vector<char> & in, size_t & position )
+{
+    const auto n_bytes = extract_pod<uint64_t>( in, position );
+    if( position + n_bytes > in.size() )
+        throw std::runtime_error( "Unexpected end of checkpoint" );
+    std::string result( in.data() + position, n_bytes );
+    position += n_bytes;
+    return result;
+}
+
+// Reads the checkpoint file and checks its header and checksum. Returns the contents after the header
+std::vector<char> read_file( const std::string & file_path, size_t & position );
+} // namespace Checkpoint
+
+/*
+Serializes the state into buffer, which is cleared first. Since the buffer can be reused, only the first checkpoint
+allocates memory. model_state is the state of the model, see Model::state_to_buffer.
+*/
+template<typename AgentT, typename WeightT>
+void checkpoint_to_buffer(
+    std::vector<char> & buffer, size_t n_iterations, const std::mt19937 & gen,
+    const Network<AgentT, WeightT> & network, const std::vector<char> & model_state )
+{
+    using DataT = typename AgentT::data_t;
+
+    buffer.clear();
+    buffer.insert( buffer.end(), std::begin( Checkpoint::file_magic ), std::end( Checkpoint::file_magic ) );
+    Checkpoint::append_pod( buffer, Checkpoint::byte_order_mark );
+    Checkpoint::append_pod( buffer, Checkpoint::version );
+    Checkpoint::append_pod( buffer, uint64_t( n_iterations ) );
+
+    std::ostringstream gen_state;
+    gen_state << gen;
+    const auto gen_string = gen_state.str();
+    Checkpoint::append_pod( buffer, uint64_t( gen_string.size() ) );
+    buffer.insert( buffer.end(), gen_string.begin(), gen_string.end() );
+
+    const size_t n_agents = network.n_agents();
+    Checkpoint::append_pod( buffer, uint64_t( n_agents ) );
+    if constexpr( std::is_trivially_copyable_v<DataT> )
+    {
+        Checkpoint::append_pod( buffer, Checkpoint::encoding_raw );
+        Checkpoint::append_pod( buffer, uint64_t( sizeof( DataT ) ) );
+        const size_t offset = buffer.size();
+        buffer.resize( offset + n_agents * sizeof( DataT ) );
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            std::memcpy(
+                buffer.data() + offset + idx_agent * sizeof( DataT ), &network.agents[idx_agent].data,
+                sizeof( DataT ) );
+        }
+    }
+    else
+    {
+        Checkpoint::append_pod( buffer, Checkpoint::encoding_string );
+        for( const auto & agent : network.agents )
+        {
+            const auto agent_string = agent_to_string( agent );
+            Checkpoint::append_pod( buffer, uint64_t( agent_string.size() ) );
+            buffer.insert( buffer.end(), agent_string.begin(), agent_string.end() );
+        }
+    }
+
+    using DirectionT = typename Network<AgentT, WeightT>::EdgeDirection;
+    Checkpoint::append_pod( buffer, uint8_t( network.direction() == DirectionT::Incoming ? 0 : 1 ) );
+    for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+    {
+        const auto neighbours = network.get_neighbours( idx_agent );
+        const auto weights    = network.get_weights( idx_agent );
+        Checkpoint::append_pod( buffer, uint64_t( neighbours.size() ) );
+        for( auto idx_neighbour : neighbours )
+            Checkpoint::append_pod( buffer, uint64_t( idx_neighbour ) );
+        Checkpoint::append_array( buffer, weights.data(), weights.size() );
+    }
+
+    Checkpoint::append_pod( buffer, uint64_t( model_state.size() ) );
+    buffer.insert( buffer.end(), model_state.begin(), model_state.end() );
+
+    Checkpoint::append_pod( buffer, Checkpoint::checksum( buffer.data(), buffer.size() ) );
+}
+
+/*
+Restores gen and the network, including its agents, from a checkpoint file and returns the number of iterations. The
+state of the model is read into model_state, for Model::state_from_buffer.
+*/
+template<typename AgentT, typename WeightT>
+size_t checkpoint_from_file(
+    const std::string & file_path, std::mt19937 & gen, Network<AgentT, WeightT> & network,
+    std::vector<char> & model_state )
+{
+    using DataT = typename AgentT::data_t;
+
+    size_t position         = 0;
+    const auto contents     = Checkpoint::read_file( file_path, position );
+    const auto n_iterations = Checkpoint::extract_pod<uint64_t>( contents, position );
+
+    std::istringstream gen_state( Checkpoint::extract_string( contents, position ) );
+    gen_state >> gen;
+    if( !gen_state )
+        throw std::runtime_error( fmt::format( "Invalid state of the random number generator in {}", file_path ) );
+
+    const auto n_agents = Checkpoint::extract_pod<uint64_t>( contents, position );
+    if( n_agents != network.n_agents() )
+    {
+        throw std::runtime_error( fmt::format(
+            "The checkpoint {} holds {} agents, but the simulation has {} agents", file_path, n_agents,
+            network.n_agents() ) );
+    }
+
+    std::vector<AgentT> agents( n_agents );
+    const auto encoding = Checkpoint::extract_pod<uint8_t>( contents, position );
+    if( encoding == Checkpoint::encoding_raw )
+    {
+        if constexpr( std::is_trivially_copyable_v<DataT> )
+        {
+            if( Checkpoint::extract_pod<uint64_t>( contents, position ) != sizeof( DataT ) )
+                throw std::runtime_error( fmt::format( "The agents in {} are of a different type", file_path ) );
+            for( auto & agent : agents )
+                Checkpoint::extract_array( contents, position, &agent.data, 1 );
+        }
+        else
+        {
+            throw std::runtime_error( fmt::format( "The agents in {} are of a different type", file_path ) );
+        }
+    }
+    else if( encoding == Checkpoint::encoding_string )
+    {
+        for( auto & agent : agents )
+            agent = agent_from_string<AgentT>( Checkpoint::extract_string( contents, position ) );
+    }
+    else
+    {
+        throw std::runtime_error( fmt::format( "Unknown agent encoding {} in {}", encoding, file_path ) );
+    }
+
+    using DirectionT     = typename Network<AgentT, WeightT>::EdgeDirection;
+    const auto direction = Checkpoint::extract_pod<uint8_t>( contents, position ) == 0 ? DirectionT::Incoming
+                                                                                        : DirectionT::Outgoing;
+    std::vector<std::vector<size_t>> neighbour_list( n_agents );
+    std::vector<std::vector<WeightT>> weight_list( n_agents );
+    for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+    {
+        const auto n_edges = Checkpoint::extract_pod<uint64_t>( contents, position );
+        neighbour_list[idx_agent].resize( n_edges );
+        weight_list[idx_agent].resize( n_edges );
+        for( auto & idx_neighbour : neighbour_list[idx_agent] )
+        {
+            idx_neighbour = Checkpoint::extract_pod<uint64_t>( contents, position );
+            if( idx_neighbour >= n_agents )
+                throw std::runtime_error( fmt::format( "Neighbour index out of range in {}", file_path ) );
+        }
+        Checkpoint::extract_array( contents, position, weight_list[idx_agent].data(), n_edges );
+    }
+
+    const auto model_state_string = Checkpoint::extract_string( contents, position );
+    model_state.assign( model_state_string.begin(), model_state_string.end() );
+
+    network        = Network<AgentT, WeightT>( std::move( neighbour_list ), std::move( weight_list ), direction );
+    network.agents = std::move( agents );
+    return n_iterations;
+}
+
+/*
+Writes checkpoints on a background thread, so that the simulation only pauses for the serialization into memory.
+Every checkpoint is written to a temporary file, which then replaces the checkpoint file. A checkpoint file is thus
+always complete, even if the process is killed while writing.
+*/
+class CheckpointWriter
+{
+public:
+    explicit CheckpointWriter( const std::string & file_path ) : file_path( file_path ) {}
+
+    CheckpointWriter( const CheckpointWriter & )             = delete;
+    CheckpointWriter & operator=( const CheckpointWriter & ) = delete;
+
+    ~CheckpointWriter();
+
+    /*
+    Waits for the previous checkpoint, then starts writing the contents of buffer. The buffer is swapped with the
+    buffer of the previous checkpoint, so that it can be reused for the next serialization.
+    */
+    void write( std::vector<char> & buffer );
+
+    // Blocks until the current checkpoint has been written. Rethrows an error of the writer thread.
+    void wait();
+
+private:
+    std::string file_path{};
+    std::vector<char> buffer_in_flight{};
+    std::thread writer_thread{};
+    std::exception_ptr error{};
+};
+
+/*
+Checkpoints requested by signals: SIGUSR1 requests a checkpoint, SIGTERM a checkpoint after which the simulation
+stops. The requests are handled after the current iteration.
+*/
+enum class CheckpointRequest
+{
+    None,
+    Checkpoint,
+    CheckpointAndStop
+};
+
+void install_checkpoint_signal_handlers();
+
+// Returns and clears the pending request
+CheckpointRequest take_checkpoint_request();
+
+} // namespace Seldon
\ No newline at end of file
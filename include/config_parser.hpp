@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <optional>
 #include <random>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -29,6 +30,29 @@ enum class Model
     DeffuantModel
 };
 
+enum class AgentOutputFormat
+{
+    Text,      // One opinions_N.txt file per output step
+    Trajectory // A single binary trajectory file, see trajectory.hpp
+};
+
+enum class TrajectoryCompression
+{
+    None,     // Frames hold the raw doubles
+    Lossless, // XOR of every value with its value in the previous frame, with compressed zero bits
+    Lossy     // Like Lossless, but the opinions are quantized to trajectory_error_bound
+};
+
+enum class Observable
+{
+    Mean,
+    Variance,
+    MeanAbs,      // Mean of the absolute values of the opinions
+    Polarization, // See observables.hpp
+    Histogram,
+    Clusters // Number of opinion clusters
+};
+
 struct OutputSettings
 {
     // Write out the agents/network every n iterations, nullopt means never
@@ -36,9 +60,42 @@ struct OutputSettings
     std::optional<size_t> n_output_network = std::nullopt;
     bool print_progress                    = false; // Print the iteration time, by default does not print
     bool output_initial                    = true;  // Output initial opinions and network, by default always outputs.
+    bool async_output                      = false; // Write the output files on a background thread
     size_t start_output         = 1; // Start printing opinion and/or network files from this iteration number
     size_t start_numbering_from = 0; // The initial step number, before the simulation runs, is this value. The first
                                      // step would be (1+start_numbering_from). By default, 0
+
+    // Settings of the agent output format, see trajectory.hpp
+    AgentOutputFormat agent_output_format        = AgentOutputFormat::Text;
+    TrajectoryCompression trajectory_compression = TrajectoryCompression::None;
+    double trajectory_error_bound                = 1e-6; // Maximum error of the opinions, for lossy compression
+    size_t trajectory_keyframe_interval          = 64;   // Every n-th frame can be decoded without the previous frames
+
+    // Subset of the agents that is written out, by default all agents. At most one of these can be set
+    std::optional<std::string> output_agents_file = std::nullopt; // File with the agent indices, one per line
+    std::optional<size_t> output_agents_sample    = std::nullopt; // Uniform random sample of this many agents
+    bool output_bots_only                         = false;        // Only the bots of the activity driven models
+
+    // In-situ observables of the opinions, written to a single file, see observables.hpp
+    std::optional<size_t> n_output_observables = std::nullopt; // Compute the observables every n iterations
+    std::vector<Observable> observables        = { Observable::Mean, Observable::Variance };
+    size_t histogram_bins                      = 20;
+    double histogram_min                       = -1.0; // Opinions outside of the range are counted in the outer bins
+    double histogram_max                       = 1.0;
+    double cluster_threshold                   = 0.1; // Opinions closer than this belong to the same cluster
+
+    // Temporal network of the activity driven models, see contact_events.hpp
+    bool output_contact_events = false; // Record the sampled contacts of every iteration to contacts.bin
+
+    // Checkpoints of the state of the simulation, see checkpoint.hpp
+    std::optional<size_t> n_output_checkpoint = std::nullopt; // Write checkpoint.bin every n iterations
+
+    // Publication of the state to POSIX shared memory, for local analysis processes, see shared_state.hpp
+    std::optional<size_t> n_output_shared_memory = std::nullopt; // Publish the agents every n iterations
+    std::string shared_memory_name               = "/seldon";
+    size_t shared_memory_slots                   = 4;     // Number of snapshots in the ring buffer
+    bool shared_memory_network                   = false; // Also publish the network
+    size_t shared_memory_max_edges               = 0;     // Edges per snapshot, 0 means twice the initial ones
 };
 
 struct DeGrootSettings
@@ -59,6 +116,26 @@ struct DeffuantSettings
         = 1; // The size of the opinions vector. This is used for the multi-dimensional DeffuantModelVector model.
 };
 
+enum class ContactSampling
+{
+    Reservoir,   // Weighted reservoir sampling over all agents, see reservoir_sampling_A_ExpJ
+    OpinionIndex // Rejection sampling from the agents sorted by opinion, see HomophilySampler
+};
+
+enum class ActivationSampling
+{
+    PerAgent, // One random number per agent
+    Buckets   // Geometric skips over the agents grouped by activity, see ActivationSampler
+};
+
+enum class MeanFieldMode
+{
+    Matrix,     // The weights are stored in the fully connected network
+    MatrixFree, // The weights are recomputed in every evaluation of the slopes
+    Binned,     // Like MatrixFree, with the agents of similar weights summed together, see approximate_weighted_sum
+    Incremental // Like Matrix, but only the weights of agents whose opinions drifted are recomputed
+};
+
 struct ActivityDrivenSettings
 {
     std::optional<int> max_iterations = std::nullopt;
@@ -82,6 +159,46 @@ struct ActivityDrivenSettings
     double reluctance_sigma           = 0.25;
     double reluctance_eps             = 0.01;
     double covariance_factor          = 0.0;
+
+    // Replay the contacts recorded with output_contact_events instead of sampling them, see contact_events.hpp
+    std::optional<std::string> contact_events_file = std::nullopt;
+
+    // How the contacted agents are sampled. Both give the same distribution of contacts, but different random numbers
+    ContactSampling contact_sampling = ContactSampling::Reservoir;
+    // How the activated agents are sampled. Both activate every agent with probability equal to its activity, but use
+    // different random numbers
+    ActivationSampling activation_sampling = ActivationSampling::PerAgent;
+
+    // Every activated agent draws its contacts from its own random stream, so that the network is sampled in parallel
+    // and does not depend on the number of threads. Changes the random numbers
+    bool per_agent_streams = false;
+
+    // Keep the sampled networks as outgoing edges and push the slopes along them, which skips the transpose of the
+    // network in every step. Gives the same opinions and network output, the network is transposed when it is written
+    bool push_slopes = false;
+
+    // How the weights of mean_weights are evaluated. MatrixFree only keeps O(N) memory, but computes the N^2 weights in
+    // every stage of the integration. Both give the same opinions, but MatrixFree leaves the network without edges
+    MeanFieldMode mean_field_mode = MeanFieldMode::Matrix;
+    // The relative error of the normalisations of MeanFieldMode::Binned. The weights themselves are not monotonic in
+    // the opinions, so their error is only steered by, but not bounded by mean_field_tolerance
+    double mean_field_tolerance = 1e-3;
+    // With MeanFieldMode::Incremental, the weights of an agent are recomputed once its opinion drifted by more than
+    // mean_field_drift_tolerance, or its normalisation changed by more than the relative
+    // mean_field_normalization_tolerance, and all weights every mean_field_refresh_interval steps, never if 0
+    double mean_field_drift_tolerance         = 1e-3;
+    double mean_field_normalization_tolerance = 1e-3;
+    size_t mean_field_refresh_interval        = 0;
+
+    // Agents without incoming edges in a step decay exactly as x * e^(-dt), and the Runge-Kutta stages only visit the
+    // agents that are coupled to others. Changes the opinions within the error of the integration. Has no effect on
+    // the inertial model, or if the slopes of all agents are computed at once, see push_slopes and mean_field_mode
+    bool exact_isolated_decay = false;
+
+    // Sample the network of the next step on a separate thread, while the opinions of this step are integrated. Only
+    // used if the contacts do not depend on the opinions, i.e. with homophily = 0 for all agents and reservoir contact
+    // sampling. Gives the same results as without
+    bool pipelined_sampling = false;
 };
 
 struct ActivityDrivenInertialSettings : public ActivityDrivenSettings
@@ -89,9 +206,16 @@ struct ActivityDrivenInertialSettings : public ActivityDrivenSettings
     double friction_coefficient = 1.0;
 };
 
+enum class NetworkFileFormat
+{
+    AdjacencyList, // One row per agent: idx_agent, n_neighbours_in, indices_neighbours_in[...], weights_in[...]
+    EdgeList       // One row per edge: idx_source, idx_target[, weight]
+};
+
 struct InitialNetworkSettings
 {
     std::optional<std::string> file;
+    NetworkFileFormat file_format = NetworkFileFormat::AdjacencyList;
     size_t n_agents      = 200;
     size_t n_connections = 10;
 };
@@ -102,13 +226,15 @@ struct SimulationOptions
         = std::variant<DeGrootSettings, ActivityDrivenSettings, ActivityDrivenInertialSettings, DeffuantSettings>;
     Model model;
     std::string model_string;
-    int rng_seed = std::random_device()();
+    int rng_seed     = std::random_device()();
+    size_t n_threads = 1; // Number of threads used by the parallelized parts of the code
     OutputSettings output_settings;
     ModelVariantT model_settings;
     InitialNetworkSettings network_settings;
 };
 
 SimulationOptions parse_config_file( std::string_view config_file_path );
+std::string observable_to_string( Observable observable );
 void validate_settings( const SimulationOptions & options );
 void print_settings( const SimulationOptions & options );
 
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Binary stream of the contacts that the activity driven models sample in every step, i.e. the temporal network.
+
+    header : "SELDCEVT", uint32 version, uint64 n_agents
+    blocks : one per step, uint64 step, uint64 n_events, uint64 n_bytes, followed by n_bytes of payload
+
+The payload holds the (source, target) events of the step in the order of the outgoing edges of the network, as
+LEB128 varints of the zigzag encoded difference to the previous source and of the target. Since the sources are
+nondecreasing, an event mostly takes two or three bytes. All numbers are encoded little endian, independent of the
+byte order of the host.
+*/
+namespace ContactEvents
+{
+constexpr char file_magic[8] = { 'S', 'E', 'L', 'D', 'C', 'E', 'V', 'T' };
+constexpr uint32_t version   = 1;
+} // namespace ContactEvents
+
+using ContactEvent = std::pair<size_t, size_t>; // (source, target), i.e. the edge source -> target
+
+class ContactEventWriter
+{
+public:
+    ContactEventWriter( const std::string & file_path, size_t n_agents );
+
+    void write_step( size_t step, std::span<const ContactEvent> events );
+
+    // Records the edges of a network, that currently holds outgoing edges
+    template<typename NetworkT>
+    void write_network_step( size_t step, const NetworkT & network )
+    {
+        events.clear();
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            for( auto idx_target : network.get_neighbours( idx_agent ) )
+                events.emplace_back( idx_agent, idx_target );
+        }
+        write_step( step, events );
+    }
+
+    void close();
+
+private:
+    std::ofstream fs{};
+    std::vector<ContactEvent> events{};
+    std::vector<char> payload{};
+};
+
+/*
+Reads the steps of a contact event stream one after another. A truncated last block, e.g. of a simulation that was
+killed, is treated as the end of the stream.
+*/
+class ContactEventReader
+{
+public:
+    explicit ContactEventReader( const std::string & file_path );
+
+    [[nodiscard]] size_t n_agents() const
+    {
+        return n_agents_;
+    }
+
+    // Reads the next step into step and events, returns false at the end of the stream
+    bool read_step( size_t & step, std::vector<ContactEvent> & events );
+
+private:
+    std::ifstream fs{};
+    std::string file_path{};
+    size_t n_agents_         = 0;
+    std::streamoff file_size = 0;
+    std::vector<char> payload{};
+};
+
+} // namespace Seldon
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstddef>
 #include <optional>
+#include <vector>
 
 namespace Seldon
 {
@@ -21,11 +22,24 @@ public:
         _n_iterations = 0;
     }
 
+    // Continues counting the iterations of a simulation that is restarted from a checkpoint
+    virtual void restart_iterations( size_t n_iterations )
+    {
+        _n_iterations = n_iterations;
+    }
+
     virtual void iteration()
     {
         _n_iterations++;
     };
 
+    // Appends the state that the model keeps between iterations and that is not recomputed from the agents and the
+    // network, so that a restart from a checkpoint continues bit for bit. Most models keep no such state
+    virtual void state_to_buffer( std::vector<char> & /* buffer */ ) const {}
+
+    // Restores the state of state_to_buffer after restart_iterations. state is empty for checkpoints without one
+    virtual void state_from_buffer( const std::vector<char> & /* state */ ) {}
+
     size_t n_iterations()
     {
         return _n_iterations;
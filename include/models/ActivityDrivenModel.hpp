@@ -2,13 +2,26 @@
 
 #include "agents/activity_agent.hpp"
 #include "agents/inertial_agent.hpp"
+#include "checkpoint.hpp"
 #include "config_parser.hpp"
+#include "contact_events.hpp"
 #include "model.hpp"
 #include "network.hpp"
 #include "network_generation.hpp"
+#include "util/activation_sampler.hpp"
+#include "util/edge_hash_set.hpp"
+#include "util/homophily_sampler.hpp"
+#include "util/math.hpp"
+#include "util/parallel.hpp"
+#include "util/segment_sum.hpp"
+#include <fmt/format.h>
 #include <cstddef>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <random>
-#include <set>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
@@ -28,7 +41,6 @@ public:
         const Config::ActivityDrivenSettings & settings, NetworkT & network, std::mt19937 & gen )
             : Model<AgentT>( settings.max_iterations ),
               network( network ),
-              contact_prob_list( std::vector<std::vector<WeightT>>( network.n_agents() ) ),
               gen( gen ),
               dt( settings.dt ),
               m( settings.m ),
@@ -49,11 +61,37 @@ public:
               bot_m( settings.bot_m ),
               bot_activity( settings.bot_activity ),
               bot_opinion( settings.bot_opinion ),
-              bot_homophily( settings.bot_homophily )
+              bot_homophily( settings.bot_homophily ),
+              contact_sampling( settings.contact_sampling ),
+              activation_sampling( settings.activation_sampling ),
+              per_agent_streams( settings.per_agent_streams ),
+              push_slopes( settings.push_slopes ),
+              mean_field_mode( settings.mean_field_mode ),
+              mean_field_tolerance( settings.mean_field_tolerance ),
+              mean_field_drift_tolerance( settings.mean_field_drift_tolerance ),
+              mean_field_normalization_tolerance( settings.mean_field_normalization_tolerance ),
+              mean_field_refresh_interval( settings.mean_field_refresh_interval ),
+              exact_isolated_decay( settings.exact_isolated_decay ),
+              pipelined_sampling( settings.pipelined_sampling )
     {
         get_agents_from_power_law();
 
-        if( mean_weights )
+        if( settings.contact_events_file.has_value() )
+        {
+            contact_event_reader = std::make_unique<ContactEventReader>( settings.contact_events_file.value() );
+            if( contact_event_reader->n_agents() != network.n_agents() )
+            {
+                throw std::runtime_error( fmt::format(
+                    "The contact events in {} are for {} agents, but the network has {} agents",
+                    settings.contact_events_file.value(), contact_event_reader->n_agents(), network.n_agents() ) );
+            }
+        }
+
+        if( mean_weights && !mean_field_weights_stored() )
+        {
+            network = NetworkT( network.agents ); // No edges, the weights are never stored
+        }
+        else if( mean_weights )
         {
             auto agents_copy = network.agents;
             network          = NetworkGeneration::generate_fully_connected<AgentT>( network.n_agents() );
@@ -61,16 +99,116 @@ public:
         }
     }
 
+    ActivityDrivenModelAbstract( const ActivityDrivenModelAbstract & )             = delete;
+    ActivityDrivenModelAbstract & operator=( const ActivityDrivenModelAbstract & ) = delete;
+
+    ~ActivityDrivenModelAbstract() override
+    {
+        discard_pipelined_network();
+    }
+
     void iteration() override {};
 
+    // Records the sampled contacts of every following iteration to file_path, see contact_events.hpp. The steps in the
+    // file are the iteration numbers plus step_offset
+    void record_contact_events( const std::string & file_path, size_t step_offset = 0 )
+    {
+        if( mean_weights )
+        {
+            throw std::runtime_error( "Contact events cannot be recorded with mean_weights, no contacts are sampled" );
+        }
+        discard_pipelined_network(); // The network of the next step would not be recorded
+        contact_event_writer      = std::make_unique<ContactEventWriter>( file_path, network.n_agents() );
+        contact_event_step_offset = step_offset;
+    }
+
+    void stop_recording_contact_events()
+    {
+        contact_event_writer.reset();
+    }
+
+    // The number of steps whose network was sampled ahead by pipelined_sampling
+    [[nodiscard]] size_t n_pipelined_networks_taken() const
+    {
+        return n_pipelined_networks;
+    }
+
+    // Sets the number of threads that integrate the opinions. The results are the same for any number of threads
+    void set_n_threads( size_t n_threads )
+    {
+        thread_pool.reset();
+        if( n_threads > 1 )
+            thread_pool = std::make_unique<Parallel::ThreadPool>( n_threads );
+    }
+
+    void initialize_iterations() override
+    {
+        Model<AgentT>::initialize_iterations();
+        discard_pipelined_network();
+        // The activities may have been read from a file since
+        sampling_context.activation_sampler           = ActivationSampler{};
+        pipelined_sampling_context.activation_sampler = ActivationSampler{};
+        mean_field_weight_normalizations.clear(); // And the opinions, so the mean-field weights start from scratch
+    }
+
+    void restart_iterations( size_t n_iterations ) override
+    {
+        Model<AgentT>::restart_iterations( n_iterations );
+        discard_pipelined_network();
+        sampling_context.activation_sampler           = ActivationSampler{};
+        pipelined_sampling_context.activation_sampler = ActivationSampler{};
+        mean_field_weight_normalizations.clear();
+
+        // Skip the replayed contacts of the iterations before the checkpoint
+        if( contact_event_reader )
+        {
+            for( size_t iteration = 1; iteration <= n_iterations; iteration++ )
+                read_replay_step( iteration );
+        }
+    }
+
+    // The incremental mean-field weights depend on the opinions and normalisations they were last computed with
+    void state_to_buffer( std::vector<char> & buffer ) const override
+    {
+        if( mean_field_mode != Config::MeanFieldMode::Incremental
+            || mean_field_weight_normalizations.size() != network.n_agents() )
+            return;
+        Checkpoint::append_pod( buffer, uint64_t( mean_field_updates_since_refresh ) );
+        for( const auto * values : { &opinion_cache, &mean_field_normalizations, &mean_field_weight_normalizations } )
+        {
+            Checkpoint::append_pod( buffer, uint64_t( values->size() ) );
+            Checkpoint::append_array( buffer, values->data(), values->size() );
+        }
+    }
+
+    // Without a saved state, e.g. in another mean-field mode, the weights are computed from scratch in the next step
+    void state_from_buffer( const std::vector<char> & state ) override
+    {
+        if( mean_field_mode != Config::MeanFieldMode::Incremental || state.empty() )
+            return;
+        size_t position                  = 0;
+        mean_field_updates_since_refresh = Checkpoint::extract_pod<uint64_t>( state, position );
+        for( auto * values : { &opinion_cache, &mean_field_normalizations, &mean_field_weight_normalizations } )
+        {
+            const auto n_values = Checkpoint::extract_pod<uint64_t>( state, position );
+            if( n_values != network.n_agents() )
+                throw std::runtime_error( "The mean-field state of the checkpoint does not match the agents" );
+            values->resize( n_values );
+            Checkpoint::extract_array( state, position, values->data(), n_values );
+        }
+    }
+
 protected:
     NetworkT & network;
 
 private:
-    std::vector<std::vector<WeightT>> contact_prob_list; // Probability of choosing i in 1 to m rounds
     // Random number generation
-    std::mt19937 & gen; // reference to simulation Mersenne-Twister engine
-    std::set<std::pair<size_t, size_t>> reciprocal_edge_buffer{};
+    std::mt19937 & gen;                                         // reference to simulation Mersenne-Twister engine
+    std::unique_ptr<ContactEventWriter> contact_event_writer{}; // Only set while contact events are recorded
+    size_t contact_event_step_offset = 0;
+    std::unique_ptr<ContactEventReader> contact_event_reader{}; // Only set if recorded contacts are replayed
+    std::vector<ContactEvent> replay_events{};
+    std::optional<size_t> replay_step_offset{}; // The step of iteration 0 in the replayed file
 
 protected:
     // Model-specific parameters
@@ -101,11 +239,73 @@ protected:
     std::vector<double> bot_opinion   = std::vector<double>( 0 );
     std::vector<double> bot_homophily = std::vector<double>( 0 );
 
-    // Buffers for RK4 integration
-    std::vector<double> k1_buffer{};
-    std::vector<double> k2_buffer{};
-    std::vector<double> k3_buffer{};
-    std::vector<double> k4_buffer{};
+    Config::ContactSampling contact_sampling = Config::ContactSampling::Reservoir;
+    std::vector<double> opinion_cache{}; // The opinions that the mean-field weights are computed with
+    // The sums of the homophily weights of every agent for all other agents, with mean_weights
+    std::vector<double> mean_field_normalizations{};
+    std::vector<double> mean_field_activities{}; // max( 1, a_i ) with mean_weights
+
+    Config::ActivationSampling activation_sampling = Config::ActivationSampling::PerAgent;
+
+    // Every activated agent samples its contacts from its own random stream, so that they can be sampled in parallel
+    bool per_agent_streams = false;
+
+    // Keep the sampled networks outgoing and scatter the slopes along them, see push_slopes_from_activations
+    bool push_slopes = false;
+
+    Config::MeanFieldMode mean_field_mode = Config::MeanFieldMode::Matrix;
+    double mean_field_tolerance           = 1e-3;
+    // With MeanFieldMode::Binned, the agents other than the bots sorted by opinion, and their activations in this order
+    std::vector<size_t> mean_field_order{};
+    std::vector<size_t> mean_field_ranks{}; // The position of every agent other than the bots in mean_field_order
+    std::vector<double> mean_field_sorted_opinions{};
+    std::vector<double> mean_field_sorted_activations{};
+    std::vector<double> mean_field_activation_sums{}; // Prefix sums of mean_field_sorted_activations
+    // With MeanFieldMode::Incremental, opinion_cache holds the opinions that the weights were last computed with
+    double mean_field_drift_tolerance         = 1e-3; // An absolute distance of opinions
+    double mean_field_normalization_tolerance = 1e-3; // A change of the normalisations, relative to them
+    size_t mean_field_refresh_interval        = 0;
+    size_t mean_field_updates_since_refresh   = 0;
+    std::vector<size_t> mean_field_drifted_agents{};        // The agents that drifted in this step, ascending
+    std::vector<double> mean_field_previous_opinions{};     // Their opinions in opinion_cache before this step
+    std::vector<size_t> mean_field_recomputed_agents{};     // The agents whose weights are recomputed, ascending
+    std::vector<double> mean_field_weight_normalizations{}; // The normalisations the weights were last computed with
+
+    // Integrate the agents without incoming edges exactly, see update_coupled_agents
+    bool exact_isolated_decay = false;
+    std::vector<size_t> coupled_agents{};   // The agents integrated with Runge-Kutta, ascending
+    std::vector<size_t> isolated_sources{}; // Agents without incoming edges, that are neighbours of coupled agents
+    std::vector<bool> source_flags{};
+
+    // Sample the network of the next step while this step is integrated, see start_pipelined_sampling
+    bool pipelined_sampling        = false;
+    bool pipelined_network_pending = false; // Set while the sampling worker runs, until the network is taken
+    NetworkT pipelined_network{};           // The network of the next step
+    std::mt19937 pipelined_gen{};           // gen after the network of the next step was sampled
+    std::mt19937 pipelined_gen_start{};     // gen before, to check that nothing else drew from gen since
+    size_t n_pipelined_networks = 0;        // The networks that were sampled ahead and taken
+    // The thread that samples ahead, started by the first start_pipelined_sampling and kept for all later steps
+    std::unique_ptr<Parallel::BackgroundWorker> sampling_worker{};
+
+    // Buffers for the integration
+    std::vector<double> coupling_buffer{};           // 1/r_i * K of every agent
+    std::vector<double> activation_buffer{};         // tanh( alpha * x_j ) in the current stage
+    std::vector<double> stage_opinion_buffer{};      // x_j in the current stage
+    std::vector<double> next_activation_buffer{};    // tanh( alpha * x_j ) in the next stage
+    std::vector<double> next_stage_opinion_buffer{}; // x_j in the next stage
+    std::vector<double> rk4_increment_buffer{};      // k_1 + 2 k_2 + 2 k_3 + k_4
+    std::vector<double> slope_buffer{};              // The slopes of the current stage, if computed at once
+
+    std::unique_ptr<Parallel::ThreadPool> thread_pool{}; // Only set if more than one thread is used
+    std::vector<size_t> agent_chunk_bounds{};            // The agents integrated by each thread
+
+    // The layout of the terms of the pushed slopes with a thread pool, see update_push_layout
+    std::vector<size_t> push_source_chunk_bounds{};        // The sources whose terms each thread computes
+    std::vector<std::vector<size_t>> push_chunk_offsets{}; // Per chunk of sources, its first term of every target
+    std::vector<size_t> push_source_offsets{};             // The first outgoing edge of every source
+    std::vector<size_t> push_term_offsets{};               // The first term of every target
+    std::vector<size_t> push_term_positions{};             // The term of every outgoing edge
+    std::vector<double> push_terms{};
 
 private:
     void get_agents_from_power_law()
@@ -147,161 +347,994 @@ private:
         }
     }
 
-    // The weight for contact between two agents
-    double homophily_weight( size_t idx_contacter, size_t idx_contacted )
+    /*
+    The weights max( tolerance, |x_i - x_j| )^(-homophily) of agent i = idx_contacter for all agents j, zero for j = i,
+    computed from opinions in one loop, which the compiler can vectorize for the common homophilies.
+    */
+    void homophily_weights(
+        size_t idx_contacter, const std::vector<double> & opinions, std::vector<double> & weights ) const
     {
         double homophily = this->homophily;
-
-        if( idx_contacted == idx_contacter )
-            return 0.0;
-
         if( bot_present() && idx_contacter < n_bots )
             homophily = this->bot_homophily[idx_contacter];
 
         constexpr double tolerance = 1e-10;
-        auto opinion_diff
-            = std::abs( network.agents[idx_contacter].data.opinion - network.agents[idx_contacted].data.opinion );
-        opinion_diff = std::max( tolerance, opinion_diff );
+        const double opinion       = opinions[idx_contacter];
+        weights.resize( opinions.size() );
+
+        auto fill = [&]( auto weight_of_distance )
+        {
+            for( size_t j = 0; j < opinions.size(); j++ )
+            {
+                weights[j] = weight_of_distance( std::max( tolerance, std::abs( opinion - opinions[j] ) ) );
+            }
+        };
+
+        visit_weight_of_distance( homophily, fill );
+
+        weights[idx_contacter] = 0.0;
+    }
+
+    /*
+    Calls func with a function object that returns the weight opinion_diff^(-homophily), for the common homophilies 0,
+    0.5 (the default), 1 and 2 without pow, so that loops over the agents inside func can be vectorized.
+    */
+    template<typename FuncT>
+    static void visit_weight_of_distance( double homophily, FuncT func )
+    {
+        if( homophily == 0.0 )
+            func( []( double ) { return 1.0; } );
+        else if( homophily == 0.5 )
+            func( []( double opinion_diff ) { return 1.0 / std::sqrt( opinion_diff ); } );
+        else if( homophily == 1.0 )
+            func( []( double opinion_diff ) { return 1.0 / opinion_diff; } );
+        else if( homophily == 2.0 )
+            func( []( double opinion_diff ) { return 1.0 / ( opinion_diff * opinion_diff ); } );
+        else
+            func( [=]( double opinion_diff ) { return std::pow( opinion_diff, -homophily ); } );
+    }
+
+    // A single weight opinion_diff^(-homophily), the same as the ones of visit_weight_of_distance
+    static double weight_of_distance( double homophily, double opinion_diff )
+    {
+        double weight = 0;
+        visit_weight_of_distance(
+            homophily, [&]( auto weight_of_distance ) { weight = weight_of_distance( opinion_diff ); } );
+        return weight;
+    }
+
+    // The contacts are sampled as outgoing edges, which replace the network of the previous step
+    void begin_network_update( NetworkT & sampled_network )
+    {
+        if( sampled_network.direction() == NetworkT::EdgeDirection::Incoming )
+            sampled_network.switch_direction_flag();
+    }
+
+    // Switches to the incoming edges, unless the slopes are pushed along the outgoing edges
+    void end_network_update( NetworkT & sampled_network, Parallel::ThreadPool * pool )
+    {
+        if( push_slopes )
+            return;
+        if( pool )
+            sampled_network.toggle_incoming_outgoing( *pool );
+        else
+            sampled_network.toggle_incoming_outgoing();
+    }
+
+    // The memory for sampling the contacts of one agent, one per thread
+    struct ContactWorkspace
+    {
+        std::mt19937 gen{};                      // The stream of the current agent with per_agent_streams
+        ReservoirWorkspace reservoir{};          // Used with ContactSampling::Reservoir
+        HomophilySampler::Workspace homophily{}; // Used with ContactSampling::OpinionIndex
+        std::vector<size_t> contacts{};          // The contacts of the current agent
+        // The edges ( contacted, contacter ) to reciprocate, with per_agent_streams
+        std::vector<std::pair<size_t, size_t>> reciprocal_edges{};
+    };
+
+    // Everything that sampling a network writes, so that the network of the next step can be sampled with its own
+    struct SamplingContext
+    {
+        HomophilySampler homophily_sampler{};   // Only used with ContactSampling::OpinionIndex
+        std::vector<double> opinions{};         // The opinions while the contacts are sampled
+        ActivationSampler activation_sampler{}; // Built from the activities at the start of a run
+        std::vector<size_t> activated_agents{};
+        EdgeHashSet reciprocal_edge_buffer{};               // The contacts of the current step
+        ContactWorkspace contact_workspace{};               // For update_network_probabilistic
+        std::vector<ContactWorkspace> contact_workspaces{}; // One per thread, for update_network_per_agent_streams
+    };
+
+    SamplingContext sampling_context{};           // For the networks sampled in their own step
+    SamplingContext pipelined_sampling_context{}; // For the networks sampled ahead by start_pipelined_sampling
+
+    // Sorts the agents by opinion or caches the opinions, for sample_contacts
+    void prepare_contact_sampling( const NetworkT & sampled_network, SamplingContext & context )
+    {
+        if( contact_sampling == Config::ContactSampling::OpinionIndex )
+        {
+            context.homophily_sampler.update(
+                sampled_network.n_agents(),
+                [&]( size_t idx_agent ) { return sampled_network.agents[idx_agent].data.opinion; } );
+        }
+        else
+        {
+            // The opinions do not change while the contacts are sampled
+            context.opinions.resize( sampled_network.n_agents() );
+            for( size_t idx_agent = 0; idx_agent < sampled_network.n_agents(); idx_agent++ )
+            {
+                context.opinions[idx_agent] = sampled_network.agents[idx_agent].data.opinion;
+            }
+        }
+    }
+
+    // Draws the activated agents with the activation buckets into context.activated_agents
+    void sample_activation_buckets( const NetworkT & sampled_network, std::mt19937 & gen, SamplingContext & context )
+    {
+        if( context.activation_sampler.n_agents() != sampled_network.n_agents() )
+        {
+            context.activation_sampler.build(
+                sampled_network.n_agents(),
+                [&]( size_t idx_agent ) { return sampled_network.agents[idx_agent].data.activity; } );
+        }
+        context.activation_sampler.sample( gen, context.activated_agents );
+    }
+
+    /*
+    Samples the contacts of the activated agent idx_agent into contacts. Only reads the state of the model, so that
+    several agents can be sampled at the same time with separate generators and workspaces.
+    */
+    void sample_contacts(
+        size_t idx_agent, std::vector<size_t> & contacts, std::mt19937 & gen, const SamplingContext & context,
+        ContactWorkspace & workspace ) const
+    {
+        // Implement the weight for the probability of agent `idx_agent` contacting agent `j`
+        // Not normalised since this is taken care of by the reservoir sampling
+
+        int m_temp = this->m;
+
+        if( bot_present() && idx_agent < n_bots )
+        {
+            m_temp = bot_m[idx_agent];
+        }
+
+        if( contact_sampling == Config::ContactSampling::OpinionIndex )
+        {
+            double homophily = this->homophily;
+            if( bot_present() && idx_agent < n_bots )
+                homophily = this->bot_homophily[idx_agent];
+            context.homophily_sampler.sample( idx_agent, m_temp, homophily, contacts, gen, workspace.homophily );
+        }
+        else
+        {
+            homophily_weights( idx_agent, context.opinions, workspace.reservoir.weights );
+            reservoir_sampling_A_ExpJ_log( m_temp, workspace.reservoir.weights, contacts, gen, workspace.reservoir );
+        }
+    }
+
+    // Seed of the random stream of agent idx_agent in the step with step_seed (splitmix64 of both)
+    static uint32_t agent_stream_seed( uint64_t step_seed, size_t idx_agent )
+    {
+        uint64_t z = step_seed + ( uint64_t( idx_agent ) + 1 ) * 0x9e3779b97f4a7c15ULL;
+        z          = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+        z          = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+        return uint32_t( z ^ ( z >> 31 ) );
+    }
+
+    /*
+    Samples the same kind of network as update_network_probabilistic. The activations are drawn from gen as before,
+    but every activated agent then draws its contacts, and which of them it reciprocates, from its own random stream,
+    seeded from gen and its index. The agents are sampled in parallel, the reciprocal edges are collected per thread and
+    added in the order of the agents, and the incoming edges are assembled in parallel. The network thus does not
+    depend on the number of threads.
+    */
+    void update_network_per_agent_streams(
+        NetworkT & sampled_network, std::mt19937 & gen, Parallel::ThreadPool * pool, SamplingContext & context )
+    {
+        begin_network_update( sampled_network );
+
+        prepare_contact_sampling( sampled_network, context );
+
+        auto & activated_agents = context.activated_agents;
+        if( activation_sampling == Config::ActivationSampling::Buckets )
+        {
+            sample_activation_buckets( sampled_network, gen, context );
+        }
+        else
+        {
+            std::uniform_real_distribution<> dis_activation( 0.0, 1.0 );
+            activated_agents.clear();
+            for( size_t idx_agent = 0; idx_agent < sampled_network.n_agents(); idx_agent++ )
+            {
+                if( dis_activation( gen ) < sampled_network.agents[idx_agent].data.activity )
+                    activated_agents.push_back( idx_agent );
+            }
+        }
+
+        uint64_t step_seed = gen();
+        step_seed          = ( step_seed << 32 ) | gen();
+
+        const size_t n_chunks     = pool ? pool->n_threads() : 1;
+        auto & contact_workspaces = context.contact_workspaces;
+        contact_workspaces.resize( n_chunks );
+        auto run_chunks = [&]( const std::function<void( size_t )> & func )
+        {
+            if( pool )
+                pool->run( func );
+            else
+                func( 0 );
+        };
+
+        for( size_t idx_agent = 0; idx_agent < sampled_network.n_agents(); idx_agent++ )
+        {
+            sampled_network.set_neighbours_and_weights( idx_agent, {}, {} );
+        }
+
+        // Every activated agent only writes its own outgoing edges
+        run_chunks(
+            [&]( size_t idx_chunk )
+            {
+                auto & workspace = contact_workspaces[idx_chunk];
+                workspace.reciprocal_edges.clear();
+                std::uniform_real_distribution<> dis_reciprocation( 0.0, 1.0 );
+                auto [begin, end] = Parallel::chunk_range( activated_agents.size(), n_chunks, idx_chunk );
+                for( size_t i = begin; i < end; i++ )
+                {
+                    const size_t idx_agent = activated_agents[i];
+                    workspace.gen.seed( agent_stream_seed( step_seed, idx_agent ) );
+                    sample_contacts( idx_agent, workspace.contacts, workspace.gen, context, workspace );
+                    for( const auto & idx_outgoing : workspace.contacts )
+                    {
+                        if( dis_reciprocation( workspace.gen ) < reciprocity )
+                            workspace.reciprocal_edges.emplace_back( idx_outgoing, idx_agent );
+                    }
+                    sampled_network.set_neighbours_and_weights( idx_agent, workspace.contacts, 1.0 );
+                }
+            } );
+
+        // Only the edges that were not sampled in the other direction are reciprocated
+        run_chunks(
+            [&]( size_t idx_chunk )
+            {
+                auto & edges = contact_workspaces[idx_chunk].reciprocal_edges;
+                std::erase_if(
+                    edges,
+                    [&]( const auto & edge )
+                    {
+                        const auto contacts = sampled_network.get_neighbours( edge.first );
+                        return std::find( contacts.begin(), contacts.end(), edge.second ) != contacts.end();
+                    } );
+            } );
+        for( const auto & workspace : contact_workspaces )
+        {
+            for( const auto & [idx_contacted, idx_contacter] : workspace.reciprocal_edges )
+                sampled_network.push_back_neighbour_and_weight( idx_contacted, idx_contacter, 1.0 );
+        }
 
-        return std::pow( opinion_diff, -homophily );
+        // The sampled network still holds the outgoing edges, i.e. the contacts of this step including the reciprocal
+        // edges, which update_network_replay relies on to rebuild the same network
+        if( contact_event_writer )
+        {
+            contact_event_writer->write_network_step(
+                this->n_iterations() + contact_event_step_offset, sampled_network );
+        }
+
+        end_network_update( sampled_network, pool );
     }
 
-    void update_network_probabilistic()
+    void update_network_probabilistic(
+        NetworkT & sampled_network, std::mt19937 & gen, Parallel::ThreadPool * pool, SamplingContext & context )
     {
-        network.switch_direction_flag();
+        begin_network_update( sampled_network );
 
         std::uniform_real_distribution<> dis_activation( 0.0, 1.0 );
         std::uniform_real_distribution<> dis_reciprocation( 0.0, 1.0 );
         std::vector<size_t> contacted_agents{};
+        auto & reciprocal_edge_buffer = context.reciprocal_edge_buffer;
+        const auto & activated_agents = context.activated_agents;
         reciprocal_edge_buffer.clear(); // Clear the reciprocal edge buffer
-        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+
+        prepare_contact_sampling( sampled_network, context );
+
+        const bool use_activation_buckets = activation_sampling == Config::ActivationSampling::Buckets;
+        if( use_activation_buckets )
+            sample_activation_buckets( sampled_network, gen, context );
+        size_t idx_next_activated = 0;
+
+        for( size_t idx_agent = 0; idx_agent < sampled_network.n_agents(); idx_agent++ )
         {
             // Test if the agent is activated
-            bool activated = dis_activation( gen ) < network.agents[idx_agent].data.activity;
+            bool activated = false;
+            if( use_activation_buckets )
+            {
+                activated = idx_next_activated < activated_agents.size()
+                            && activated_agents[idx_next_activated] == idx_agent;
+                if( activated )
+                    idx_next_activated++;
+            }
+            else
+            {
+                activated = dis_activation( gen ) < sampled_network.agents[idx_agent].data.activity;
+            }
 
             if( activated )
             {
-                // Implement the weight for the probability of agent `idx_agent` contacting agent `j`
-                // Not normalised since this is taken care of by the reservoir sampling
-
-                int m_temp = this->m;
-
-                if( bot_present() && idx_agent < n_bots )
-                {
-                    m_temp = bot_m[idx_agent];
-                }
-
-                reservoir_sampling_A_ExpJ(
-                    m_temp, network.n_agents(), [&]( int j ) { return homophily_weight( idx_agent, j ); },
-                    contacted_agents, gen );
+                sample_contacts( idx_agent, contacted_agents, gen, context, context.contact_workspace );
 
                 // Fill the outgoing edges into the reciprocal edge buffer
                 for( const auto & idx_outgoing : contacted_agents )
                 {
-                    reciprocal_edge_buffer.insert(
-                        { idx_agent, idx_outgoing } ); // insert the edge idx_agent -> idx_outgoing
+                    // insert the edge idx_agent -> idx_outgoing
+                    reciprocal_edge_buffer.insert( idx_agent, idx_outgoing );
                 }
 
                 // Set the *outgoing* edges
-                network.set_neighbours_and_weights( idx_agent, contacted_agents, 1.0 );
+                sampled_network.set_neighbours_and_weights( idx_agent, contacted_agents, 1.0 );
             }
             else
             {
-                network.set_neighbours_and_weights( idx_agent, {}, {} );
+                sampled_network.set_neighbours_and_weights( idx_agent, {}, {} );
             }
         }
 
         // Reciprocity check
-        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        for( size_t idx_agent = 0; idx_agent < sampled_network.n_agents(); idx_agent++ )
         {
             // Get the outgoing edges
-            auto contacted_agents = network.get_neighbours( idx_agent );
+            auto contacted_agents = sampled_network.get_neighbours( idx_agent );
             // For each outgoing edge we check if the reverse edge already exists
             for( const auto & idx_outgoing : contacted_agents )
             {
                 // If the edge is not reciprocated
-                if( !reciprocal_edge_buffer.contains( { idx_outgoing, idx_agent } ) )
+                if( !reciprocal_edge_buffer.contains( idx_outgoing, idx_agent ) )
                 {
                     if( dis_reciprocation( gen ) < reciprocity )
                     {
-                        network.push_back_neighbour_and_weight( idx_outgoing, idx_agent, 1.0 );
+                        sampled_network.push_back_neighbour_and_weight( idx_outgoing, idx_agent, 1.0 );
                     }
                 }
             }
         }
 
-        network.toggle_incoming_outgoing(); // switch direction, so that we have incoming edges
+        // The sampled network still holds the outgoing edges, i.e. the contacts of this step including the reciprocal
+        // edges, which update_network_replay relies on to rebuild the same network
+        if( contact_event_writer )
+        {
+            contact_event_writer->write_network_step(
+                this->n_iterations() + contact_event_step_offset, sampled_network );
+        }
+
+        end_network_update( sampled_network, pool );
     }
 
-    void update_network_mean()
+    // Replaces the sampling of the contacts with the contacts of the next step in the contact event file. With
+    // homophily = 0 the contacts do not depend on the opinions, so that the replay gives the same network as the run
+    // that recorded them.
+    void update_network_replay()
     {
-        std::vector<WeightT> weights( network.n_agents(), 0.0 );
+        read_replay_step( this->n_iterations() );
 
-        // Set all weights to zero in the beginning
+        begin_network_update( network );
         for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
         {
-            network.set_weights( idx_agent, weights );
-            contact_prob_list[idx_agent] = weights; // set to zero
+            network.set_neighbours_and_weights( idx_agent, {}, {} );
+        }
+        // The events of a source are in the order of its outgoing edges, which keeps the transpose identical
+        for( const auto & [idx_source, idx_target] : replay_events )
+        {
+            network.push_back_neighbour_and_weight( idx_source, idx_target, 1.0 );
         }
 
-        auto probability_helper = []( double omega, size_t m )
+        if( contact_event_writer )
+            contact_event_writer->write_step( this->n_iterations() + contact_event_step_offset, replay_events );
+
+        end_network_update( network, thread_pool.get() );
+    }
+
+    // Reads the contacts of the given iteration into replay_events. The steps of the file are the iterations plus the
+    // numbering offset of the recording run, which is taken from the first step read.
+    void read_replay_step( size_t iteration )
+    {
+        size_t step = 0;
+        if( !contact_event_reader->read_step( step, replay_events ) )
         {
-            double p = 0;
-            for( size_t i = 1; i <= m; i++ )
-                p += ( std::pow( -omega, i + 1 ) + omega ) / ( omega + 1 );
-            return p;
-        };
+            throw std::runtime_error( fmt::format( "The contact events ended before iteration {}", iteration ) );
+        }
+        if( !replay_step_offset.has_value() && step >= iteration )
+            replay_step_offset = step - iteration;
+        if( !replay_step_offset.has_value() || step != iteration + replay_step_offset.value() )
+        {
+            throw std::runtime_error( fmt::format(
+                "The contact events of step {} do not belong to iteration {}, steps are missing or out of order", step,
+                iteration ) );
+        }
+    }
 
-        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+    /*
+    The probability sum_{i=1}^m ( (-omega)^(i+1) + omega ) / ( omega + 1 ) that an activated agent contacts an agent of
+    normalised weight omega in m draws, in closed form.
+    */
+    static double mean_field_contact_probability( double omega, int m )
+    {
+        double power = 1.0; // (-omega)^m
+        double base  = -omega;
+        for( int exponent = m; exponent > 0; exponent /= 2 )
+        {
+            if( exponent % 2 == 1 )
+                power *= base;
+            base *= base;
+        }
+        // sum_{i=1}^m (-omega)^(i+1) = omega^2 ( 1 - (-omega)^m ) / ( 1 + omega )
+        const double alternating_sum = omega * omega * ( 1.0 - power ) / ( 1.0 + omega );
+        return ( m * omega + alternating_sum ) / ( omega + 1.0 );
+    }
+
+    [[nodiscard]] double homophily_of( size_t idx_agent ) const
+    {
+        if( bot_present() && idx_agent < n_bots )
+            return bot_homophily[idx_agent];
+        return homophily;
+    }
+
+    [[nodiscard]] int m_of( size_t idx_agent ) const
+    {
+        if( bot_present() && idx_agent < n_bots )
+            return bot_m[idx_agent];
+        return m;
+    }
+
+    /*
+    The weight w_ij of agent j in the incoming weights of agent i = idx_agent, see update_network_mean. Expects
+    opinion_cache, mean_field_normalizations and mean_field_activities of the current step.
+    */
+    [[nodiscard]] double mean_field_weight( size_t idx_agent, size_t j ) const
+    {
+        if( j == idx_agent )
+            return 0.0;
+
+        // The weights only depend on the distance of the opinions, and the homophilies
+        constexpr double tolerance   = 1e-10;
+        const double opinion_diff    = std::max( tolerance, std::abs( opinion_cache[idx_agent] - opinion_cache[j] ) );
+        const double homophily_agent = homophily_of( idx_agent );
+        const double homophily_j     = homophily_of( j );
+        const double weight_agent    = weight_of_distance( homophily_agent, opinion_diff );
+        const double weight_j
+            = homophily_j == homophily_agent ? weight_agent : weight_of_distance( homophily_j, opinion_diff );
+
+        const auto [prob_contact_ij, prob_contact_ji]
+            = mean_field_contact_probabilities( idx_agent, j, weight_agent, weight_j );
+        return prob_contact_ji + ( 1.0 - prob_contact_ji ) * reciprocity * prob_contact_ij;
+    }
+
+    // p_ij, agent idx_agent contacts j, and p_ji, from the homophily weights of j for idx_agent and of idx_agent for j
+    [[nodiscard]] std::pair<double, double>
+    mean_field_contact_probabilities( size_t idx_agent, size_t j, double weight_agent, double weight_j ) const
+    {
+        const double omega_ij = weight_agent / mean_field_normalizations[idx_agent];
+        const double omega_ji = weight_j / mean_field_normalizations[j];
+        return { mean_field_activities[idx_agent] * mean_field_contact_probability( omega_ij, m_of( idx_agent ) ),
+                 mean_field_activities[j] * mean_field_contact_probability( omega_ji, m_of( j ) ) };
+    }
+
+    /*
+    The slopes of all agents, like slope_from_activations, with the weights of mean_field_weight computed on the fly
+    instead of read from the network. The agents are processed in blocks of rows, and the other agents in tiles, so that
+    the opinions, normalisations and activations of a tile are reused from the cache by all rows of a block. Every
+    slope is summed in the order of the agents, the same as with the stored weights.
+    */
+    void mean_field_slopes_from_activations(
+        const std::vector<double> & opinions, const std::vector<double> & activations, std::vector<double> & slopes )
+    {
+        if( mean_field_mode == Config::MeanFieldMode::Binned )
         {
-            // Implement the weight for the probability of agent `idx_agent` contacting agent `j`
-            // Not normalised since this is taken care of by the reservoir sampling
+            binned_mean_field_slopes_from_activations( opinions, activations, slopes );
+            return;
+        }
 
-            double normalization = 0;
-            for( size_t k = 0; k < network.n_agents(); k++ )
+        constexpr size_t n_rows_block = 32;
+        constexpr size_t n_cols_tile  = 2048;
+        const size_t n_agents         = network.n_agents();
+        slopes.resize( n_agents );
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
             {
-                normalization += homophily_weight( idx_agent, k );
-            }
+                for( size_t row_begin = begin; row_begin < end; row_begin += n_rows_block )
+                {
+                    const size_t row_end = std::min( end, row_begin + n_rows_block );
+                    for( size_t idx_agent = row_begin; idx_agent < row_end; idx_agent++ )
+                    {
+                        slopes[idx_agent] = -opinions[idx_agent];
+                    }
+                    for( size_t col_begin = 0; col_begin < n_agents; col_begin += n_cols_tile )
+                    {
+                        const size_t col_end = std::min( n_agents, col_begin + n_cols_tile );
+                        for( size_t idx_agent = row_begin; idx_agent < row_end; idx_agent++ )
+                        {
+                            const double coupling = coupling_buffer[idx_agent];
+                            double slope          = slopes[idx_agent];
+                            for( size_t j = col_begin; j < col_end; j++ )
+                            {
+                                slope += coupling * mean_field_weight( idx_agent, j ) * activations[j];
+                            }
+                            slopes[idx_agent] = slope;
+                        }
+                    }
+                }
+            } );
+    }
 
-            // Go through all the neighbours of idx_agent
-            // Calculate the probability of i contacting j (in 1 to m rounds, assuming
-            // the agent is activated
-            int m_temp = m;
-            if( bot_present() && idx_agent < n_bots )
+    [[nodiscard]] bool mean_field_weights_stored() const
+    {
+        return mean_field_mode == Config::MeanFieldMode::Matrix
+               || mean_field_mode == Config::MeanFieldMode::Incremental;
+    }
+
+    /*
+    Calls func( begin, end ) for the ranges of mean_field_order without idx_agent, on both sides of its opinion
+    */
+    template<typename FuncT>
+    void for_binned_mean_field_sides( size_t idx_agent, FuncT func ) const
+    {
+        const size_t n_sorted = mean_field_order.size();
+        if( bot_present() && idx_agent < n_bots )
+        {
+            const size_t split = std::lower_bound(
+                                     mean_field_sorted_opinions.begin(), mean_field_sorted_opinions.end(),
+                                     opinion_cache[idx_agent] )
+                                 - mean_field_sorted_opinions.begin();
+            func( 0, split );
+            func( split, n_sorted );
+            return;
+        }
+        func( 0, mean_field_ranks[idx_agent] );
+        func( mean_field_ranks[idx_agent] + 1, n_sorted );
+    }
+
+    /*
+    Sorts the agents other than the bots by opinion and approximates the normalisations with approximate_weighted_sum
+    over the sorted agents. The bots have their own homophilies and are summed exactly.
+    */
+    void update_binned_mean_field_normalizations()
+    {
+        const size_t n_agents = network.n_agents();
+        mean_field_order.resize( n_agents - std::min( n_bots, n_agents ) );
+        std::iota( mean_field_order.begin(), mean_field_order.end(), n_agents - mean_field_order.size() );
+        // Ties are ordered by the agent index, as in HomophilySampler
+        std::sort(
+            mean_field_order.begin(), mean_field_order.end(),
+            [&]( size_t idx1, size_t idx2 )
             {
-                m_temp = bot_m[idx_agent];
-            }
+                return opinion_cache[idx1] < opinion_cache[idx2]
+                       || ( opinion_cache[idx1] == opinion_cache[idx2] && idx1 < idx2 );
+            } );
 
-            double activity = std::max( 1.0, network.agents[idx_agent].data.activity );
-            for( size_t j = 0; j < network.n_agents(); j++ )
+        mean_field_ranks.resize( n_agents );
+        mean_field_sorted_opinions.resize( mean_field_order.size() );
+        for( size_t position = 0; position < mean_field_order.size(); position++ )
+        {
+            mean_field_ranks[mean_field_order[position]] = position;
+            mean_field_sorted_opinions[position]         = opinion_cache[mean_field_order[position]];
+        }
+
+        constexpr double tolerance = 1e-10;
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                {
+                    const double opinion   = opinion_cache[idx_agent];
+                    const double homophily = homophily_of( idx_agent );
+                    double normalization   = 0;
+                    for( size_t idx_bot = 0; idx_bot < std::min( n_bots, n_agents ); idx_bot++ )
+                    {
+                        if( idx_bot != idx_agent )
+                            normalization += weight_of_distance(
+                                homophily, std::max( tolerance, std::abs( opinion - opinion_cache[idx_bot] ) ) );
+                    }
+
+                    auto weight = [&]( size_t position )
+                    {
+                        const double opinion_diff = std::abs( opinion - mean_field_sorted_opinions[position] );
+                        return weight_of_distance( homophily, std::max( tolerance, opinion_diff ) );
+                    };
+                    auto value     = []( size_t ) { return 1.0; };
+                    auto range_sum = []( size_t first, size_t last ) { return double( last - first ); };
+                    for_binned_mean_field_sides(
+                        idx_agent,
+                        [&]( size_t first, size_t last )
+                        {
+                            normalization += approximate_weighted_sum(
+                                first, last, weight, value, range_sum, mean_field_tolerance );
+                        } );
+                    mean_field_normalizations[idx_agent] = normalization;
+                }
+            } );
+    }
+
+    /*
+    The slopes of mean_field_slopes_from_activations, with the weights of the sorted agents approximated. Unlike the
+    homophily weights of the normalisations, the weights w_ij are not monotonic in the opinion of j, since p_ji depends
+    on the normalisation and the activity of j. mean_field_tolerance is thus not a bound of the error of the slopes.
+    */
+    void binned_mean_field_slopes_from_activations(
+        const std::vector<double> & opinions, const std::vector<double> & activations, std::vector<double> & slopes )
+    {
+        const size_t n_agents = network.n_agents();
+        const size_t n_sorted = mean_field_order.size();
+        slopes.resize( n_agents );
+        mean_field_sorted_activations.resize( n_sorted );
+        mean_field_activation_sums.resize( n_sorted + 1 );
+        mean_field_activation_sums[0] = 0.0;
+        for( size_t position = 0; position < n_sorted; position++ )
+        {
+            mean_field_sorted_activations[position]  = activations[mean_field_order[position]];
+            mean_field_activation_sums[position + 1] = mean_field_activation_sums[position]
+                                                       + mean_field_sorted_activations[position];
+        }
+
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                {
+                    double sum = 0;
+                    for( size_t idx_bot = 0; idx_bot < std::min( n_bots, n_agents ); idx_bot++ )
+                    {
+                        sum += mean_field_weight( idx_agent, idx_bot ) * activations[idx_bot];
+                    }
+
+                    auto weight
+                        = [&]( size_t position ) { return mean_field_weight( idx_agent, mean_field_order[position] ); };
+                    auto value     = [&]( size_t position ) { return mean_field_sorted_activations[position]; };
+                    auto range_sum = [&]( size_t first, size_t last )
+                    { return mean_field_activation_sums[last] - mean_field_activation_sums[first]; };
+                    for_binned_mean_field_sides(
+                        idx_agent,
+                        [&]( size_t first, size_t last )
+                        {
+                            sum += approximate_weighted_sum(
+                                first, last, weight, value, range_sum, mean_field_tolerance );
+                        } );
+                    slopes[idx_agent] = -opinions[idx_agent] + coupling_buffer[idx_agent] * sum;
+                }
+            } );
+    }
+
+    /*
+    Sets the incoming weights of the fully connected network to the expected contacts
+        w_ij = p_ji + ( 1 - p_ji ) * reciprocity * p_ij,
+    where p_ij = max( 1, a_i ) * P( omega_ij, m_i ) is the probability that i contacts j and omega_ij the homophily
+    weight of j for i, normalised over all agents. The normalisations are computed first, then every row of weights
+    from the opinions, so that no N x N probabilities are stored and the rows can be computed in parallel.
+    */
+    void update_network_mean()
+    {
+        const size_t n_agents = network.n_agents();
+        mean_field_activities.resize( n_agents );
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            mean_field_activities[idx_agent] = std::max( 1.0, network.agents[idx_agent].data.activity );
+        }
+
+        if( mean_field_mode == Config::MeanFieldMode::Incremental && incremental_mean_field_update_possible() )
+        {
+            update_network_mean_incremental();
+            return;
+        }
+        mean_field_updates_since_refresh = 0;
+
+        opinion_cache.resize( n_agents );
+        mean_field_normalizations.resize( n_agents );
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            opinion_cache[idx_agent] = network.agents[idx_agent].data.opinion;
+        }
+
+        if( mean_field_mode == Config::MeanFieldMode::Binned )
+        {
+            update_binned_mean_field_normalizations();
+            return;
+        }
+
+        // Without the matrix, the weights are computed by mean_field_slopes_from_activations
+        if( !mean_field_weights_stored() )
+        {
+            for_agent_chunks(
+                [&]( size_t begin, size_t end )
+                {
+                    for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                    {
+                        mean_field_normalizations[idx_agent] = mean_field_normalization( idx_agent );
+                    }
+                } );
+            mean_field_weight_normalizations = mean_field_normalizations;
+            return;
+        }
+
+        // The homophily weight of every pair is evaluated once, or twice if the homophilies differ. The row of agent i
+        // first holds the homophily weights with the homophily of i, whose sum is the normalisation of i, and these
+        // are then replaced by the weights of both directions of every pair at once
+        constexpr double tolerance = 1e-10;
+        for_agent_pairs(
+            [&]( size_t idx_agent, size_t j )
+            {
+                const double opinion_diff
+                    = std::max( tolerance, std::abs( opinion_cache[idx_agent] - opinion_cache[j] ) );
+                const double homophily_agent        = homophily_of( idx_agent );
+                const double homophily_j            = homophily_of( j );
+                const double weight_agent           = weight_of_distance( homophily_agent, opinion_diff );
+                network.get_weights( idx_agent )[j] = weight_agent;
+                network.get_weights( j )[idx_agent]
+                    = homophily_j == homophily_agent ? weight_agent : weight_of_distance( homophily_j, opinion_diff );
+            } );
+
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                {
+                    const auto weights   = network.get_weights( idx_agent );
+                    double normalization = 0;
+                    for( size_t j = 0; j < n_agents; j++ )
+                    {
+                        if( j != idx_agent )
+                            normalization += weights[j];
+                    }
+                    mean_field_normalizations[idx_agent] = normalization;
+                    weights[idx_agent]                   = 0.0;
+                }
+            } );
+        mean_field_weight_normalizations = mean_field_normalizations;
+
+        for_agent_pairs(
+            [&]( size_t idx_agent, size_t j )
+            {
+                auto & weight_ij = network.get_weights( idx_agent )[j];
+                auto & weight_ji = network.get_weights( j )[idx_agent];
+                const auto [prob_contact_ij, prob_contact_ji]
+                    = mean_field_contact_probabilities( idx_agent, j, weight_ij, weight_ji );
+                weight_ij = prob_contact_ji + ( 1.0 - prob_contact_ji ) * reciprocity * prob_contact_ij;
+                weight_ji = prob_contact_ij + ( 1.0 - prob_contact_ij ) * reciprocity * prob_contact_ji;
+            } );
+    }
+
+    /*
+    Calls func( idx_agent, j ) for all pairs of agents idx_agent < j, on the threads of the thread pool if there is one.
+    All pairs of an agent idx_agent are visited by the same thread, and the threads get about equal numbers of pairs.
+    func may write to the weights of both agents of its pair.
+    */
+    template<typename FuncT>
+    void for_agent_pairs( FuncT func )
+    {
+        const size_t n_agents = network.n_agents();
+        auto visit_pairs      = [&]( size_t begin, size_t end )
+        {
+            for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
             {
-                double omega = homophily_weight( idx_agent, j ) / normalization;
-                // We can calculate the probability of i contacting j ( i->j )
-                // Update contact prob_list (outgoing)
-                contact_prob_list[idx_agent][j] = activity * probability_helper( omega, m_temp );
+                for( size_t j = idx_agent + 1; j < n_agents; j++ )
+                    func( idx_agent, j );
             }
+        };
+
+        if( !thread_pool )
+        {
+            visit_pairs( 0, n_agents );
+            return;
         }
+        std::vector<size_t> pair_chunk_bounds{};
+        Parallel::balanced_chunk_bounds(
+            n_agents, thread_pool->n_threads(), [&]( size_t idx_agent ) { return n_agents - idx_agent; },
+            pair_chunk_bounds );
+        thread_pool->run( [&]( size_t idx_chunk )
+                          { visit_pairs( pair_chunk_bounds[idx_chunk], pair_chunk_bounds[idx_chunk + 1] ); } );
+    }
 
-        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+    // The sum of the homophily weights of agent idx_agent for all other agents, with the opinions in opinion_cache
+    [[nodiscard]] double mean_field_normalization( size_t idx_agent ) const
+    {
+        constexpr double tolerance = 1e-10;
+        const double opinion       = opinion_cache[idx_agent];
+        double normalization       = 0;
+        visit_weight_of_distance(
+            homophily_of( idx_agent ),
+            [&]( auto weight_of_distance )
+            {
+                for( size_t k = 0; k < opinion_cache.size(); k++ )
+                {
+                    if( k != idx_agent )
+                        normalization
+                            += weight_of_distance( std::max( tolerance, std::abs( opinion - opinion_cache[k] ) ) );
+                }
+            } );
+        return normalization;
+    }
+
+    // Whether the weights of the last step can be updated, instead of computed from scratch
+    [[nodiscard]] bool incremental_mean_field_update_possible() const
+    {
+        const size_t n_agents = network.n_agents();
+        const bool refresh_due
+            = mean_field_refresh_interval > 0 && mean_field_updates_since_refresh + 1 >= mean_field_refresh_interval;
+        return !refresh_due && opinion_cache.size() == n_agents && mean_field_weight_normalizations.size() == n_agents;
+    }
+
+    /*
+    Updates the weights of update_network_mean for the agents whose opinions drifted by more than
+    mean_field_drift_tolerance from opinion_cache. Their opinions are moved into opinion_cache and their normalisations
+    are recomputed, while the normalisations of the other agents are updated by the change of the terms of the drifted
+    agents. The row and column of weights are recomputed for the drifted agents, and for the agents whose normalisation
+    changed by more than mean_field_normalization_tolerance times the normalisation their weights were computed with.
+    The other weights are kept, their opinions and normalisations are within the tolerances. This takes
+    O( N * n_recomputed ) instead of O( N^2 ), but the updated normalisations collect rounding errors, which
+    mean_field_refresh_interval bounds.
+    */
+    void update_network_mean_incremental()
+    {
+        const size_t n_agents = network.n_agents();
+        mean_field_updates_since_refresh++;
+        mean_field_drifted_agents.clear();
+        mean_field_previous_opinions.clear();
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
         {
-            // Calculate the actual weights and reciprocity
-            for( size_t j = 0; j < network.n_agents(); j++ )
+            const double opinion = network.agents[idx_agent].data.opinion;
+            if( std::abs( opinion - opinion_cache[idx_agent] ) > mean_field_drift_tolerance )
             {
-                double prob_contact_ij = contact_prob_list[idx_agent][j]; // outgoing probabilites
-                double prob_contact_ji = contact_prob_list[j][idx_agent];
+                mean_field_drifted_agents.push_back( idx_agent );
+                mean_field_previous_opinions.push_back( opinion_cache[idx_agent] );
+                opinion_cache[idx_agent] = opinion;
+            }
+        }
+        if( mean_field_drifted_agents.empty() )
+            return;
 
-                // Set the incoming agent weight, j-i in weight list
-                double & win_ji = network.get_weights( j )[idx_agent];
-                win_ji += prob_contact_ij;
+        auto drifted = [&]( size_t idx_agent )
+        { return std::binary_search( mean_field_drifted_agents.begin(), mean_field_drifted_agents.end(), idx_agent ); };
 
-                // Handle the reciprocity for j->i
-                // Update incoming weight i-j
-                double & win_ij = network.get_weights( idx_agent )[j];
+        constexpr double tolerance = 1e-10;
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                {
+                    if( drifted( idx_agent ) )
+                    {
+                        mean_field_normalizations[idx_agent] = mean_field_normalization( idx_agent );
+                        continue;
+                    }
+                    const double opinion   = opinion_cache[idx_agent];
+                    const double homophily = homophily_of( idx_agent );
+                    double change          = 0;
+                    for( size_t i = 0; i < mean_field_drifted_agents.size(); i++ )
+                    {
+                        const double opinion_diff = std::abs( opinion - opinion_cache[mean_field_drifted_agents[i]] );
+                        const double previous_opinion_diff = std::abs( opinion - mean_field_previous_opinions[i] );
+                        change += weight_of_distance( homophily, std::max( tolerance, opinion_diff ) )
+                                  - weight_of_distance( homophily, std::max( tolerance, previous_opinion_diff ) );
+                    }
+                    mean_field_normalizations[idx_agent] += change;
+                }
+            } );
 
-                // The probability of reciprocating is
-                win_ij += ( 1.0 - prob_contact_ji ) * reciprocity * prob_contact_ij;
+        mean_field_recomputed_agents.clear();
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            const double normalization        = mean_field_normalizations[idx_agent];
+            const double weight_normalization = mean_field_weight_normalizations[idx_agent];
+            const double max_change           = mean_field_normalization_tolerance * weight_normalization;
+            if( drifted( idx_agent ) || std::abs( normalization - weight_normalization ) > max_change )
+            {
+                mean_field_recomputed_agents.push_back( idx_agent );
+                mean_field_weight_normalizations[idx_agent] = normalization;
             }
         }
+        auto recomputed = [&]( size_t idx_agent )
+        {
+            return std::binary_search(
+                mean_field_recomputed_agents.begin(), mean_field_recomputed_agents.end(), idx_agent );
+        };
+
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+                {
+                    auto weights = network.get_weights( idx_agent );
+                    if( recomputed( idx_agent ) )
+                    {
+                        for( size_t j = 0; j < n_agents; j++ )
+                        {
+                            weights[j] = mean_field_weight( idx_agent, j );
+                        }
+                        continue;
+                    }
+                    for( const auto j : mean_field_recomputed_agents )
+                    {
+                        weights[j] = mean_field_weight( idx_agent, j );
+                    }
+                }
+            } );
+    }
+
+    // Samples the contacts of a step into sampled_network, with the random numbers of gen and the buffers of context
+    void sample_network(
+        NetworkT & sampled_network, std::mt19937 & gen, Parallel::ThreadPool * pool, SamplingContext & context )
+    {
+        if( per_agent_streams )
+            update_network_per_agent_streams( sampled_network, gen, pool, context );
+        else
+            update_network_probabilistic( sampled_network, gen, pool, context );
+    }
+
+    /*
+    True if the contacts do not depend on the opinions, so that the network of the next step can be sampled before the
+    opinions of this step are integrated. That is the case with homophily = 0 for all agents and the reservoir
+    sampling, as long as no contact events are replayed or recorded. The opinion index orders the agents by opinion,
+    so that its draws depend on the opinions even without homophily.
+    */
+    [[nodiscard]] bool pipelined_sampling_possible() const
+    {
+        if( !pipelined_sampling || mean_weights || contact_event_reader || contact_event_writer
+            || contact_sampling != Config::ContactSampling::Reservoir || homophily != 0 )
+            return false;
+        for( size_t idx_bot = 0; idx_bot < n_bots; idx_bot++ )
+        {
+            if( bot_homophily[idx_bot] != 0 )
+                return false;
+        }
+        return true;
+    }
+
+    /*
+    Starts sampling the network of the next step on sampling_worker, into pipelined_network with a copy of gen and with
+    pipelined_sampling_context, so that it touches nothing that the integration or the output use. The sampling draws
+    the same random numbers in the same order as it would in the next step, so that take_pipelined_network gives the
+    same network as sampling it then.
+    */
+    void start_pipelined_sampling()
+    {
+        if( pipelined_network.n_agents() != network.n_agents() )
+            pipelined_network = NetworkT( network.agents );
+        else
+            pipelined_network.agents = network.agents; // For the activities, the opinions are not used
+        pipelined_gen_start = gen;
+        pipelined_gen       = gen;
+        if( !sampling_worker )
+            sampling_worker = std::make_unique<Parallel::BackgroundWorker>();
+        pipelined_network_pending = true;
+        sampling_worker->start(
+            [this]() { sample_network( pipelined_network, pipelined_gen, nullptr, pipelined_sampling_context ); } );
+    }
+
+    /*
+    Replaces the edges of the network with the ones sampled by start_pipelined_sampling and advances gen past their
+    random numbers. Returns false if no network was sampled ahead, or if gen changed since, e.g. by loading a
+    checkpoint, in which case the network has to be sampled again.
+    */
+    bool take_pipelined_network()
+    {
+        if( !std::exchange( pipelined_network_pending, false ) )
+            return false;
+        sampling_worker->wait(); // Re-throws the errors of the sampling
+        if( gen != pipelined_gen_start )
+            return false;
+        network.swap_edges( pipelined_network );
+        gen = pipelined_gen;
+        n_pipelined_networks++;
+        return true;
+    }
+
+    // Drops the network sampled ahead, because the state of the model is changed from outside
+    void discard_pipelined_network()
+    {
+        if( !std::exchange( pipelined_network_pending, false ) )
+            return;
+        try
+        {
+            sampling_worker->wait();
+        }
+        catch( ... )
+        {
+            // The network is dropped, and with it the error of sampling it
+        }
     }
 
 protected:
@@ -313,39 +1346,345 @@ protected:
     void update_network()
     {
 
-        if( !mean_weights )
+        if( contact_event_reader )
+        {
+            update_network_replay();
+        }
+        else if( !mean_weights )
         {
-            update_network_probabilistic();
+            if( !take_pipelined_network() )
+                sample_network( network, gen, thread_pool.get(), sampling_context );
+            if( pipelined_sampling_possible() && !this->finished() )
+                start_pipelined_sampling();
         }
         else
         {
             update_network_mean();
         }
+
+        if( thread_pool )
+            update_agent_chunks();
     }
 
-    template<typename Opinion_Callback>
-    void get_euler_slopes( std::vector<double> & k_buffer, Opinion_Callback opinion )
+    // Splits the agents into one chunk per thread, such that every chunk has about the same number of incoming edges
+    void update_agent_chunks()
+    {
+        if( network.direction() == NetworkT::EdgeDirection::Outgoing )
+        {
+            update_push_layout();
+            return;
+        }
+        Parallel::balanced_chunk_bounds(
+            network.n_agents(), thread_pool->n_threads(),
+            [this]( size_t idx_agent ) { return network.get_neighbours( idx_agent ).size() + 1; }, agent_chunk_bounds );
+    }
+
+    /*
+    Calls func( begin, end ) for the chunks of agents [begin, end), on the threads of the thread pool if there is one.
+    func may only write to the state of the agents in its chunk.
+    */
+    template<typename FuncT>
+    void for_agent_chunks( FuncT func )
     {
-        // h is the timestep
-        size_t j_index = 0;
+        if( !thread_pool )
+        {
+            func( size_t( 0 ), network.n_agents() );
+            return;
+        }
+        if( agent_chunk_bounds.empty() || agent_chunk_bounds.back() != network.n_agents() )
+            update_agent_chunks();
+        thread_pool->run( [&]( size_t idx_chunk )
+                          { func( agent_chunk_bounds[idx_chunk], agent_chunk_bounds[idx_chunk + 1] ); } );
+    }
 
-        k_buffer.resize( network.n_agents() );
+    /*
+    Sorts the agents for the integration of a step. Without exact_isolated_decay, or if the slopes are computed at once,
+    all agents are coupled agents. Otherwise, the coupled agents are the ones with incoming edges, and the others
+    follow dx/dt = -x exactly. Of those, the isolated sources are the ones whose opinions the coupled agents read, so
+    that their states are needed in the stages.
+    */
+    void update_coupled_agents()
+    {
+        const size_t n_agents = network.n_agents();
+        coupled_agents.clear();
+        isolated_sources.clear();
+        if( !exact_isolated_decay || slopes_computed_at_once() )
+        {
+            coupled_agents.resize( n_agents );
+            std::iota( coupled_agents.begin(), coupled_agents.end(), 0 );
+            return;
+        }
 
-        for( size_t idx_agent = 0; idx_agent < network.n_agents(); ++idx_agent )
+        source_flags.assign( n_agents, false );
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
         {
-            auto neighbour_buffer = network.get_neighbours( idx_agent ); // Get the incoming neighbours
-            auto weight_buffer    = network.get_weights( idx_agent );    // Get incoming weights
-            k_buffer[idx_agent]   = -opinion( idx_agent );
-            // Loop through neighbouring agents
-            for( size_t j = 0; j < neighbour_buffer.size(); j++ )
+            const auto neighbour_buffer = network.get_neighbours( idx_agent );
+            if( neighbour_buffer.empty() )
+                continue;
+            coupled_agents.push_back( idx_agent );
+            for( const auto idx_neighbour : neighbour_buffer )
             {
-                j_index = neighbour_buffer[j];
-                k_buffer[idx_agent] += 1.0 / network.agents[idx_agent].data.reluctance * K * weight_buffer[j]
-                                       * std::tanh( alpha * opinion( j_index ) );
+                source_flags[idx_neighbour] = true;
             }
-            // Here, we won't multiply by the timestep.
-            // Instead multiply in the update rule
         }
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            if( source_flags[idx_agent] && network.get_neighbours( idx_agent ).empty() )
+                isolated_sources.push_back( idx_agent );
+        }
+    }
+
+    // The agents of the ascending list agents in [begin, end)
+    static std::span<const size_t> agents_in_range( const std::vector<size_t> & agents, size_t begin, size_t end )
+    {
+        const auto first = std::lower_bound( agents.begin(), agents.end(), begin );
+        const auto last  = std::lower_bound( first, agents.end(), end );
+        return { first, last };
+    }
+
+    // Hoists the factor 1/r_i * K of the slopes out of the loops over the edges
+    void update_coupling_coefficients()
+    {
+        coupling_buffer.resize( network.n_agents() );
+        for_agent_chunks(
+            [this]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+                {
+                    coupling_buffer[idx_agent] = 1.0 / network.agents[idx_agent].data.reluctance * K;
+                }
+            } );
+    }
+
+    /*
+    The slope -x_i + 1/r_i * K * sum_j w_ij tanh( alpha * x_j ) of agent idx_agent, where activations holds
+    tanh( alpha * x_j ) of all agents. Expects update_coupling_coefficients to be called before. The terms are summed
+    in the order of the incoming neighbours, so that the slope is the same for any way the activations are computed.
+    */
+    double slope_from_activations( size_t idx_agent, double opinion, const std::vector<double> & activations ) const
+    {
+        const auto neighbour_buffer = network.get_neighbours( idx_agent ); // Get the incoming neighbours
+        const auto weight_buffer    = network.get_weights( idx_agent );    // Get incoming weights
+        const double coupling       = coupling_buffer[idx_agent];
+        double slope                = -opinion;
+        for( size_t j = 0; j < neighbour_buffer.size(); j++ )
+        {
+            slope += coupling * weight_buffer[j] * activations[neighbour_buffer[j]];
+        }
+        return slope;
+    }
+
+    /*
+    Places the terms of the pushed slopes for a network that holds the outgoing edges, like toggle_incoming_outgoing
+    with a thread pool places the transposed edges: the sources are split into chunks of about equal numbers of
+    outgoing edges, every chunk counts its edges per target, and an exclusive prefix sum over the chunks gives the
+    position of the term of every edge. The terms of every target are thus in the order of its incoming neighbours.
+    The agent chunks are balanced by the incoming edges, which are the terms that each thread sums.
+    */
+    void update_push_layout()
+    {
+        const size_t n_agents = network.n_agents();
+        const size_t n_chunks = thread_pool->n_threads();
+        Parallel::balanced_chunk_bounds(
+            n_agents, n_chunks, [this]( size_t idx_agent ) { return network.get_neighbours( idx_agent ).size() + 1; },
+            push_source_chunk_bounds );
+        push_chunk_offsets.resize( n_chunks );
+
+        // Count the edges of every chunk of sources per target
+        thread_pool->run(
+            [&]( size_t idx_chunk )
+            {
+                auto & counts = push_chunk_offsets[idx_chunk];
+                counts.assign( n_agents, 0 );
+                for( size_t idx_source = push_source_chunk_bounds[idx_chunk];
+                     idx_source < push_source_chunk_bounds[idx_chunk + 1]; ++idx_source )
+                {
+                    for( const auto idx_target : network.get_neighbours( idx_source ) )
+                        counts[idx_target]++;
+                }
+            } );
+
+        // Exclusive prefix sum over the chunks for every target, which leaves the number of terms of the target
+        push_term_offsets.resize( n_agents + 1 );
+        thread_pool->run(
+            [&]( size_t idx_chunk )
+            {
+                auto [begin, end] = Parallel::chunk_range( n_agents, n_chunks, idx_chunk );
+                for( size_t idx_target = begin; idx_target < end; ++idx_target )
+                {
+                    size_t running_offset = 0;
+                    for( auto & chunk_offsets : push_chunk_offsets )
+                    {
+                        const size_t count        = chunk_offsets[idx_target];
+                        chunk_offsets[idx_target] = running_offset;
+                        running_offset += count;
+                    }
+                    push_term_offsets[idx_target + 1] = running_offset;
+                }
+            } );
+
+        push_term_offsets[0] = 0;
+        push_source_offsets.resize( n_agents + 1 );
+        push_source_offsets[0] = 0;
+        for( size_t idx_agent = 0; idx_agent < n_agents; ++idx_agent )
+        {
+            push_term_offsets[idx_agent + 1] += push_term_offsets[idx_agent];
+            push_source_offsets[idx_agent + 1]
+                = push_source_offsets[idx_agent] + network.get_neighbours( idx_agent ).size();
+        }
+        push_term_positions.resize( push_source_offsets[n_agents] );
+        push_terms.resize( push_source_offsets[n_agents] );
+
+        thread_pool->run(
+            [&]( size_t idx_chunk )
+            {
+                auto & offsets = push_chunk_offsets[idx_chunk];
+                for( size_t idx_source = push_source_chunk_bounds[idx_chunk];
+                     idx_source < push_source_chunk_bounds[idx_chunk + 1]; ++idx_source )
+                {
+                    const auto neighbour_buffer = network.get_neighbours( idx_source );
+                    for( size_t j = 0; j < neighbour_buffer.size(); j++ )
+                    {
+                        const size_t idx_target = neighbour_buffer[j];
+                        push_term_positions[push_source_offsets[idx_source] + j]
+                            = push_term_offsets[idx_target] + offsets[idx_target]++;
+                    }
+                }
+            } );
+
+        Parallel::balanced_chunk_bounds(
+            n_agents, n_chunks,
+            [this]( size_t idx_agent ) { return push_term_offsets[idx_agent + 1] - push_term_offsets[idx_agent] + 1; },
+            agent_chunk_bounds );
+    }
+
+    /*
+    The slopes of all agents, like slope_from_activations, for a network that holds the outgoing edges. Every source
+    adds its terms to the slopes of its targets. The terms of every target are added in the order of its incoming
+    neighbours after toggle_incoming_outgoing, so the slopes are bit-identical to the ones of the transposed network.
+    With a thread pool, every thread computes the terms of its chunk of sources into the positions given by
+    update_push_layout, and then sums the terms of its chunk of targets, so the result does not depend on the number
+    of threads.
+    */
+    void push_slopes_from_activations(
+        const std::vector<double> & opinions, const std::vector<double> & activations, std::vector<double> & slopes )
+    {
+        slopes.resize( network.n_agents() );
+        if( !thread_pool )
+        {
+            for( size_t idx_agent = 0; idx_agent < network.n_agents(); ++idx_agent )
+            {
+                slopes[idx_agent] = -opinions[idx_agent];
+            }
+            for( size_t idx_source = 0; idx_source < network.n_agents(); ++idx_source )
+            {
+                const auto neighbour_buffer = network.get_neighbours( idx_source ); // Get the outgoing neighbours
+                const auto weight_buffer    = network.get_weights( idx_source );
+                const double activation     = activations[idx_source];
+                for( size_t j = 0; j < neighbour_buffer.size(); j++ )
+                {
+                    const size_t idx_target = neighbour_buffer[j];
+                    slopes[idx_target] += coupling_buffer[idx_target] * weight_buffer[j] * activation;
+                }
+            }
+            return;
+        }
+
+        if( agent_chunk_bounds.empty() || agent_chunk_bounds.back() != network.n_agents() )
+            update_agent_chunks();
+        thread_pool->run(
+            [&]( size_t idx_chunk )
+            {
+                for( size_t idx_source = push_source_chunk_bounds[idx_chunk];
+                     idx_source < push_source_chunk_bounds[idx_chunk + 1]; ++idx_source )
+                {
+                    const auto neighbour_buffer = network.get_neighbours( idx_source ); // Get the outgoing neighbours
+                    const auto weight_buffer    = network.get_weights( idx_source );
+                    const double activation     = activations[idx_source];
+                    const size_t first_edge     = push_source_offsets[idx_source];
+                    for( size_t j = 0; j < neighbour_buffer.size(); j++ )
+                    {
+                        push_terms[push_term_positions[first_edge + j]]
+                            = coupling_buffer[neighbour_buffer[j]] * weight_buffer[j] * activation;
+                    }
+                }
+            } );
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+                {
+                    double slope = -opinions[idx_agent];
+                    for( size_t k = push_term_offsets[idx_agent]; k < push_term_offsets[idx_agent + 1]; k++ )
+                    {
+                        slope += push_terms[k];
+                    }
+                    slopes[idx_agent] = slope;
+                }
+            } );
+    }
+
+    /*
+    True if the slopes of all agents are computed at once by all_slopes_from_activations instead of agent by agent,
+    because the network holds the outgoing edges or the mean field weights are not stored.
+    */
+    [[nodiscard]] bool slopes_computed_at_once() const
+    {
+        return ( mean_weights && !mean_field_weights_stored() )
+               || network.direction() == NetworkT::EdgeDirection::Outgoing;
+    }
+
+    void all_slopes_from_activations(
+        const std::vector<double> & opinions, const std::vector<double> & activations, std::vector<double> & slopes )
+    {
+        if( mean_weights && !mean_field_weights_stored() )
+            mean_field_slopes_from_activations( opinions, activations, slopes );
+        else
+            push_slopes_from_activations( opinions, activations, slopes );
+    }
+
+    template<typename Opinion_Callback>
+    void get_euler_slopes( std::vector<double> & k_buffer, Opinion_Callback opinion )
+    {
+        k_buffer.resize( network.n_agents() );
+        activation_buffer.resize( network.n_agents() );
+        update_coupling_coefficients();
+
+        // One tanh per agent instead of one per edge
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+                {
+                    activation_buffer[idx_agent] = std::tanh( alpha * opinion( idx_agent ) );
+                }
+            } );
+
+        if( slopes_computed_at_once() )
+        {
+            stage_opinion_buffer.resize( network.n_agents() );
+            for_agent_chunks(
+                [&]( size_t begin, size_t end )
+                {
+                    for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+                    {
+                        stage_opinion_buffer[idx_agent] = opinion( idx_agent );
+                    }
+                } );
+            all_slopes_from_activations( stage_opinion_buffer, activation_buffer, k_buffer );
+            return;
+        }
+
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+                {
+                    // Here, we won't multiply by the timestep.
+                    // Instead multiply in the update rule
+                    k_buffer[idx_agent] = slope_from_activations( idx_agent, opinion( idx_agent ), activation_buffer );
+                }
+            } );
     }
 };
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "connectivity.hpp"
+#include "util/parallel.hpp"
 #include <fmt/format.h>
 #include <algorithm>
 #include <cstddef>
@@ -7,6 +8,7 @@
 #include <optional>
 #include <span>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace Seldon
@@ -224,6 +226,89 @@ public:
         switch_direction_flag();
     }
 
+    /*
+    Same as toggle_incoming_outgoing, on the threads of thread_pool. The source agents are split into chunks of about
+    equal numbers of edges. Every chunk counts its edges per target, an exclusive prefix sum over the chunks gives the
+    position of the first edge of each chunk in every transposed list, and every chunk scatters its edges to these
+    positions. The sources in the transposed lists are thus in the same order as in the serial version.
+    Since every chunk counts over all targets, the serial version is used if there are fewer edges than chunks times
+    agents.
+    */
+    void toggle_incoming_outgoing( Parallel::ThreadPool & thread_pool )
+    {
+        const size_t n_chunks = thread_pool.n_threads();
+        if( n_chunks <= 1 || n_edges() < n_chunks * n_agents() )
+        {
+            toggle_incoming_outgoing();
+            return;
+        }
+
+        auto & source_bounds = toggle_source_bounds;
+        Parallel::balanced_chunk_bounds(
+            n_agents(), n_chunks, [&]( size_t i_agent ) { return 1 + neighbour_list[i_agent].size(); },
+            source_bounds );
+
+        std::vector<std::vector<size_t>> neighbour_list_transpose( n_agents() );
+        std::vector<std::vector<WeightT>> weight_list_transpose( n_agents() );
+        auto & offsets = toggle_chunk_offsets;
+        offsets.resize( n_chunks );
+
+        // Count the edges of every chunk of sources per target
+        thread_pool.run(
+            [&]( size_t idx_chunk )
+            {
+                auto & counts = offsets[idx_chunk];
+                counts.assign( n_agents(), 0 );
+                for( size_t i_agent = source_bounds[idx_chunk]; i_agent < source_bounds[idx_chunk + 1]; i_agent++ )
+                {
+                    for( const auto neighbour : neighbour_list[i_agent] )
+                        counts[neighbour]++;
+                }
+            } );
+
+        // Exclusive prefix sum over the chunks, for every target of a range of targets
+        thread_pool.run(
+            [&]( size_t idx_chunk )
+            {
+                auto [begin, end] = Parallel::chunk_range( n_agents(), n_chunks, idx_chunk );
+                for( size_t neighbour = begin; neighbour < end; neighbour++ )
+                {
+                    size_t running_offset = 0;
+                    for( auto & chunk_offsets : offsets )
+                    {
+                        const size_t count       = chunk_offsets[neighbour];
+                        chunk_offsets[neighbour] = running_offset;
+                        running_offset += count;
+                    }
+                    neighbour_list_transpose[neighbour].resize( running_offset );
+                    weight_list_transpose[neighbour].resize( running_offset );
+                }
+            } );
+
+        // Scatter the edges of every chunk of sources
+        thread_pool.run(
+            [&]( size_t idx_chunk )
+            {
+                auto & offset = offsets[idx_chunk];
+                for( size_t i_agent = source_bounds[idx_chunk]; i_agent < source_bounds[idx_chunk + 1]; i_agent++ )
+                {
+                    for( size_t i_neighbour = 0; i_neighbour < neighbour_list[i_agent].size(); i_neighbour++ )
+                    {
+                        const auto neighbour  = neighbour_list[i_agent][i_neighbour];
+                        const size_t position = offset[neighbour]++;
+                        neighbour_list_transpose[neighbour][position] = i_agent;
+                        weight_list_transpose[neighbour][position]    = weight_list[i_agent][i_neighbour];
+                    }
+                }
+            } );
+
+        neighbour_list = std::move( neighbour_list_transpose );
+        weight_list    = std::move( weight_list_transpose );
+
+        // Swap the edge direction
+        switch_direction_flag();
+    }
+
     /*
     Only switches the direction flag. This effectively transposes the network and, simultaneously, changes its
     representation.
@@ -305,10 +390,24 @@ public:
             n.clear();
     }
 
+    /*
+    Swaps the edges and their direction with the ones of other, but keeps the agents of both networks
+    */
+    void swap_edges( Network & other )
+    {
+        std::swap( neighbour_list, other.neighbour_list );
+        std::swap( weight_list, other.weight_list );
+        std::swap( _direction, other._direction );
+    }
+
 private:
     std::vector<std::vector<size_t>> neighbour_list{}; // Neighbour list for the connections
     std::vector<std::vector<WeightT>> weight_list{};   // List for the interaction weights of each connection
     EdgeDirection _direction{};
+
+    // Buffers of the threaded toggle_incoming_outgoing, kept between the calls
+    std::vector<size_t> toggle_source_bounds{};
+    std::vector<std::vector<size_t>> toggle_chunk_offsets{};
 };
 
 } // namespace Seldon
\ No newline at end of file
@@ -1,9 +1,16 @@
 #pragma once
 #include "network.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
 #include <cstddef>
+#include <cstdint>
 #include <random>
+#include <stdexcept>
+#include <string_view>
 #include <util/math.hpp>
 #include <util/misc.hpp>
+#include <util/parallel.hpp>
 #include <vector>
 
 namespace Seldon::NetworkGeneration
@@ -238,6 +245,193 @@ Network<AgentType> generate_from_file( const std::string & file )
     return NetworkT( std::move( neighbour_list ), std::move( weight_list ), NetworkT::EdgeDirection::Incoming );
 }
 
+/*
+Reads a network from an edge list (COO) file. Every line contains one directed edge
+    idx_source, idx_target[, weight]
+where the columns may be separated by commas and/or whitespace. A missing weight defaults to 1.0, anything after the
+weight is an error. Lines starting with '#' are comments. The number of agents is one plus the largest index found in
+the file.
+The file is parsed in n_threads chunks, the edges are radix sorted by (target, source) and edges that appear more than
+once are merged by summing their weights (like Network::remove_double_counting). The incoming neighbours of every
+agent end up sorted by index.
+*/
+template<typename AgentType>
+Network<AgentType> generate_from_edge_list_file( const std::string & file, size_t n_threads = 1 )
+{
+    using NetworkT = Network<AgentType>;
+    using WeightT  = typename NetworkT::WeightT;
+
+    // The key packs (target, source) into 64 bits, so that sorting by key sorts by target first
+    constexpr size_t n_bits_index = 32;
+    constexpr uint64_t max_index  = ( uint64_t( 1 ) << n_bits_index ) - 1;
+
+    struct Edge
+    {
+        uint64_t key;
+        WeightT weight;
+    };
+
+    const std::string file_contents = get_file_contents( file );
+    const std::string_view contents( file_contents );
+    n_threads = std::max<size_t>( 1, n_threads );
+
+    // Gives the line number of the line that starts at begin_of_line, only needed for the error messages
+    auto line_number = [&]( size_t begin_of_line )
+    { return 1 + std::count( contents.begin(), contents.begin() + begin_of_line, '\n' ); };
+
+    auto parse_line = [&]( size_t begin_of_line, std::string_view line, std::vector<Edge> & edges )
+    {
+        auto is_separator = []( char c ) { return c == ',' || c == ' ' || c == '\t' || c == '\r'; };
+
+        size_t pos          = 0;
+        auto skip_separator = [&]()
+        {
+            while( pos < line.size() && is_separator( line[pos] ) )
+                pos++;
+        };
+
+        skip_separator();
+        if( pos == line.size() || line[pos] == '#' )
+            return;
+
+        uint64_t indices[2] = { 0, 0 };
+        for( auto & idx : indices )
+        {
+            skip_separator();
+            auto [ptr, ec] = std::from_chars( line.data() + pos, line.data() + line.size(), idx );
+            if( ec != std::errc() || idx > max_index )
+            {
+                throw std::runtime_error( fmt::format(
+                    "generate_from_edge_list_file: could not parse the edge '{}' in line {} of {}", line,
+                    line_number( begin_of_line ), file ) );
+            }
+            pos = ptr - line.data();
+        }
+
+        WeightT weight = 1.0;
+        skip_separator();
+        if( pos < line.size() )
+        {
+            auto [ptr, ec] = std::from_chars( line.data() + pos, line.data() + line.size(), weight );
+            if( ec != std::errc() )
+            {
+                throw std::runtime_error( fmt::format(
+                    "generate_from_edge_list_file: could not parse the weight in '{}' in line {} of {}", line,
+                    line_number( begin_of_line ), file ) );
+            }
+            pos = ptr - line.data();
+        }
+
+        skip_separator();
+        if( pos < line.size() )
+        {
+            throw std::runtime_error( fmt::format(
+                "generate_from_edge_list_file: unexpected '{}' after the edge '{}' in line {} of {}",
+                line.substr( pos ), line, line_number( begin_of_line ), file ) );
+        }
+
+        edges.push_back( { ( indices[1] << n_bits_index ) | indices[0], weight } );
+    };
+
+    // Parse the file in chunks. Every chunk starts at the beginning of a line and owns all the lines that start in it
+    std::vector<std::vector<Edge>> edges_per_chunk( n_threads );
+    const size_t n_chunks = Parallel::parallel_for_chunks(
+        contents.size(), n_threads,
+        [&]( size_t idx_chunk, size_t begin, size_t end )
+        {
+            if( begin > 0 && contents[begin - 1] != '\n' )
+            {
+                auto start_of_line = contents.find( '\n', begin );
+                begin              = ( start_of_line == std::string_view::npos ) ? contents.size() : start_of_line + 1;
+            }
+
+            auto & edges = edges_per_chunk[idx_chunk];
+            while( begin < end )
+            {
+                auto end_of_line = contents.find( '\n', begin );
+                if( end_of_line == std::string_view::npos )
+                    end_of_line = contents.size();
+                parse_line( begin, contents.substr( begin, end_of_line - begin ), edges );
+                begin = end_of_line + 1;
+            }
+        } );
+
+    // Concatenate the edges of all chunks, preserving the file order
+    std::vector<size_t> chunk_offsets( n_chunks + 1, 0 );
+    for( size_t idx_chunk = 0; idx_chunk < n_chunks; idx_chunk++ )
+        chunk_offsets[idx_chunk + 1] = chunk_offsets[idx_chunk] + edges_per_chunk[idx_chunk].size();
+
+    std::vector<Edge> edges( chunk_offsets.back() );
+    std::vector<uint64_t> max_index_per_chunk( n_chunks, 0 );
+    Parallel::run_chunks(
+        n_chunks,
+        [&]( size_t idx_chunk )
+        {
+            auto & chunk_edges = edges_per_chunk[idx_chunk];
+            for( const auto & edge : chunk_edges )
+            {
+                max_index_per_chunk[idx_chunk] = std::max(
+                    { max_index_per_chunk[idx_chunk], edge.key >> n_bits_index, edge.key & max_index } );
+            }
+            std::copy( chunk_edges.begin(), chunk_edges.end(), edges.begin() + chunk_offsets[idx_chunk] );
+            chunk_edges = std::vector<Edge>{};
+        } );
+
+    const size_t n_agents
+        = edges.empty() ? 0 : *std::max_element( max_index_per_chunk.begin(), max_index_per_chunk.end() ) + 1;
+
+    Parallel::radix_sort(
+        edges, []( const Edge & edge ) { return edge.key; },
+        n_agents == 0 ? 0 : ( uint64_t( n_agents - 1 ) << n_bits_index ) | max_index, n_threads );
+
+    // Find the first edge of every target agent. The edges are sorted, so every chunk only has to look at its own
+    // range and sets the offsets of the targets that begin in it
+    std::vector<size_t> row_offsets( n_agents + 1, edges.size() );
+    Parallel::parallel_for_chunks(
+        edges.size(), n_threads,
+        [&]( size_t idx_chunk [[maybe_unused]], size_t begin, size_t end )
+        {
+            for( size_t i = begin; i < end; i++ )
+            {
+                const size_t target          = edges[i].key >> n_bits_index;
+                const size_t previous_target = ( i == 0 ) ? 0 : ( edges[i - 1].key >> n_bits_index ) + 1;
+                for( size_t t = previous_target; t <= target; t++ )
+                    row_offsets[t] = i;
+            }
+        } );
+
+    // Build the incoming neighbour lists, merging doubly counted edges by summing their weights
+    std::vector<std::vector<size_t>> neighbour_list( n_agents );
+    std::vector<std::vector<WeightT>> weight_list( n_agents );
+    Parallel::parallel_for_chunks(
+        n_agents, n_threads,
+        [&]( size_t idx_chunk [[maybe_unused]], size_t begin, size_t end )
+        {
+            for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+            {
+                auto & neighbours = neighbour_list[idx_agent];
+                auto & weights    = weight_list[idx_agent];
+                neighbours.reserve( row_offsets[idx_agent + 1] - row_offsets[idx_agent] );
+                weights.reserve( row_offsets[idx_agent + 1] - row_offsets[idx_agent] );
+
+                for( size_t i = row_offsets[idx_agent]; i < row_offsets[idx_agent + 1]; i++ )
+                {
+                    if( i > row_offsets[idx_agent] && edges[i].key == edges[i - 1].key )
+                    {
+                        weights.back() += edges[i].weight;
+                    }
+                    else
+                    {
+                        neighbours.push_back( edges[i].key & max_index );
+                        weights.push_back( edges[i].weight );
+                    }
+                }
+            }
+        } );
+
+    return NetworkT( std::move( neighbour_list ), std::move( weight_list ), NetworkT::EdgeDirection::Incoming );
+}
+
 /* Constructs a new network on a square lattice of edge length n_edge (with PBCs)*/
 template<typename AgentType>
 Network<AgentType> generate_square_lattice( size_t n_edge, typename Network<AgentType>::WeightT weight = 0.0 )
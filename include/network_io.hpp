@@ -1,11 +1,14 @@
 #pragma once
 #include "fstream"
 #include "network.hpp"
+#include "util/buffered_writer.hpp"
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
 #include <cstddef>
+#include <iterator>
 #include <string>
+#include <string_view>
 namespace Seldon
 {
 
@@ -36,34 +39,39 @@ void network_to_dot_file( const Network<AgentT> & network, const std::string & f
 }
 
 template<typename AgentT>
-void network_to_file( const Network<AgentT> & network, const std::string & file_path )
+void network_to_file( const Network<AgentT> & network, const std::string & file_path, size_t n_threads = 1 )
 {
-    std::fstream fs;
-    fs.open( file_path, std::fstream::in | std::fstream::out | std::fstream::trunc );
-
-    size_t n_agents = network.n_agents();
+    // The files hold the incoming neighbours, so a network that holds the outgoing edges is written transposed
+    if( network.direction() == Network<AgentT>::EdgeDirection::Outgoing )
+    {
+        auto network_incoming = network;
+        network_incoming.toggle_incoming_outgoing();
+        network_to_file( network_incoming, file_path, n_threads );
+        return;
+    }
 
-    fmt::print( fs, "# idx_agent, n_neighbours_in, indices_neighbours_in[...], weights_in[...]\n" );
+    const size_t n_agents = network.n_agents();
 
-    for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+    auto format_row = [&]( fmt::memory_buffer & buffer, size_t idx_agent )
     {
+        auto out               = std::back_inserter( buffer );
         auto buffer_neighbours = network.get_neighbours( idx_agent );
         auto buffer_weights    = network.get_weights( idx_agent );
 
-        std::string row = fmt::format( "{:>5}, {:>5}", idx_agent, buffer_neighbours.size() );
+        fmt::format_to( out, "{:>5}, {:>5}", idx_agent, buffer_neighbours.size() );
 
         if( buffer_neighbours.empty() )
         {
-            row += "\n";
+            buffer.push_back( '\n' );
         }
         else
         {
-            row += ", ";
+            buffer.append( std::string_view( ", " ) );
         }
 
         for( const auto & idx_neighbour : buffer_neighbours )
         {
-            row += fmt::format( "{:>5}, ", idx_neighbour );
+            fmt::format_to( out, "{:>5}, ", idx_neighbour );
         }
 
         const auto n_weights = buffer_weights.size();
@@ -74,22 +82,23 @@ void network_to_file( const Network<AgentT> & network, const std::string & file_
             {
                 if( idx_agent == n_agents - 1 ) // At the end of the file
                 {
-                    row += fmt::format( "{:>25}", weight );
+                    fmt::format_to( out, "{:>25}", weight );
                 }
                 else
                 {
-                    row += fmt::format( "{:>25}\n", weight );
+                    fmt::format_to( out, "{:>25}\n", weight );
                 }
             }
             else
             {
-                row += fmt::format( "{:>25}, ", weight );
+                fmt::format_to( out, "{:>25}, ", weight );
             }
         }
+    };
 
-        fs << row;
-    }
-    fs.close();
+    write_rows_to_file(
+        file_path, "# idx_agent, n_neighbours_in, indices_neighbours_in[...], weights_in[...]\n", n_agents, format_row,
+        n_threads );
 }
 
 } // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+#include "config_parser.hpp"
+#include "util/parallel.hpp"
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Reductions of the opinions of all agents, computed during the simulation instead of from the opinion files.
+
+    mean, variance : mean and (population) variance of the opinions
+    mean_abs       : mean of the absolute values of the opinions
+    polarization   : ( 1 - |n_+ - n_-| / n ) * ( mean_+ - mean_- ) / 2, where n_+ and n_- are the numbers of agents
+                     with positive and negative opinions, and mean_+ and mean_- the mean opinions of these two groups.
+                     Two equally large groups at +x and -x have a polarization of x, a consensus has a polarization of 0
+    histogram      : number of agents in each of histogram_bins equally wide bins in [histogram_min, histogram_max)
+    clusters       : number of opinion clusters, where sorted opinions that are closer than cluster_threshold
+                     belong to the same cluster
+*/
+struct ObservableValues
+{
+    double mean         = 0;
+    double variance     = 0;
+    double mean_abs     = 0;
+    double polarization = 0;
+    size_t n_clusters   = 0;
+    std::vector<size_t> histogram{};
+};
+
+/*
+Computes the observables of the opinions. Everything but the clusters is computed in one parallel sweep over the
+opinions, with per-thread partial results that are merged in a fixed order.
+*/
+ObservableValues compute_observables(
+    const std::vector<double> & opinions, const Config::OutputSettings & settings, size_t n_threads = 1 );
+
+/*
+Computes the configured observables every time write is called and appends them as a row to a single text file.
+*/
+class ObservablesWriter
+{
+public:
+    ObservablesWriter( const std::string & file_path, const Config::OutputSettings & settings, size_t n_threads = 1 );
+
+    template<typename AgentT>
+    void write( size_t step, const std::vector<AgentT> & agents )
+    {
+        if constexpr( std::is_arithmetic_v<decltype( AgentT{}.data.opinion )> )
+        {
+            opinions.resize( agents.size() );
+            Parallel::parallel_for_chunks(
+                agents.size(), n_threads,
+                [&]( size_t, size_t begin, size_t end )
+                {
+                    for( size_t i = begin; i < end; i++ )
+                        opinions[i] = agents[i].data.opinion;
+                } );
+            write_row( step );
+        }
+        else
+        {
+            throw std::runtime_error( "Observables are only supported for agents with a scalar opinion" );
+        }
+    }
+
+private:
+    std::ofstream fs{};
+    Config::OutputSettings settings{};
+    size_t n_threads = 1;
+    std::vector<double> opinions{};
+
+    void write_row( size_t step );
+};
+
+} // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Publishes snapshots of the agents, and optionally the network, to a POSIX shared memory segment, from which local
+processes can read them without any file I/O.
+
+The segment holds a header, the column names, the indices of the published agents and a ring of n_slots slots.
+Every snapshot goes to the next slot of the ring. Each slot is guarded by a sequence number (seqlock): the sequence
+is odd while the slot is written and even once it is complete. A reader reads the sequence, reads the data and
+checks that the sequence did not change. Since the publisher moves on to the next slot, a reader can take up to
+n_slots - 1 publications to read a snapshot before it is overwritten.
+
+    slot   : sequence, step, n_edges, padded to 64 bytes, followed by the columns ( n_columns * n_rows doubles, column
+             after column, like the frames of TrajectoryWriter ), and if the network is published the CSR adjacency:
+             offsets ( n_network_agents + 1 uint64 ), neighbours ( max_edges uint64 ) and weights ( max_edges doubles )
+
+The adjacency holds the incoming neighbours of every agent, like the network files, also for a network that holds the
+outgoing edges. If a network has more than max_edges edges, n_edges is set to no_edges and only the agents are
+published.
+*/
+namespace SharedState
+{
+constexpr char magic[8]      = { 'S', 'E', 'L', 'D', 'S', 'H', 'M', '1' };
+constexpr uint32_t version   = 1;
+constexpr size_t name_length = 32; // Bytes reserved for each column name
+constexpr uint64_t no_edges  = UINT64_MAX;
+
+struct SegmentHeader
+{
+    char magic[8]{};
+    uint32_t version          = 0;
+    uint32_t n_slots          = 0;
+    uint64_t n_rows           = 0; // Number of published agents
+    uint32_t n_columns        = 0;
+    uint32_t has_network      = 0;
+    uint64_t n_network_agents = 0;
+    uint64_t max_edges        = 0;
+    uint64_t slot_size        = 0; // Bytes per slot
+    uint64_t slots_offset     = 0; // Offset of the first slot from the start of the segment
+    std::atomic<uint64_t> n_published{};
+};
+
+struct alignas( 64 ) SlotHeader
+{
+    std::atomic<uint64_t> sequence{};
+    uint64_t step    = 0;
+    uint64_t n_edges = 0;
+};
+
+static_assert( std::atomic<uint64_t>::is_always_lock_free );
+} // namespace SharedState
+
+class SharedStatePublisher
+{
+public:
+    /*
+    Creates the segment name, which has to start with a '/'. An existing segment of the same name is replaced. The
+    segment is removed again when the publisher is destroyed, processes that mapped it can keep reading it.
+    */
+    SharedStatePublisher(
+        const std::string & name, const std::vector<std::string> & column_names,
+        const std::vector<size_t> & agent_indices, size_t n_slots, size_t n_network_agents = 0,
+        size_t max_edges = 0 );
+
+    SharedStatePublisher( const SharedStatePublisher & )             = delete;
+    SharedStatePublisher & operator=( const SharedStatePublisher & ) = delete;
+
+    ~SharedStatePublisher();
+
+    // Publishes the columns of the agents (see agents_to_columns) and, if enabled, the network
+    template<typename NetworkT>
+    void publish( size_t step, std::span<const double> columns, const NetworkT & network )
+    {
+        auto * slot = begin_slot( step, columns );
+        if( header->has_network != 0 )
+        {
+            const size_t n_edges = network.n_edges();
+            if( n_edges > header->max_edges || network.n_agents() != header->n_network_agents )
+            {
+                slot->n_edges = SharedState::no_edges;
+            }
+            else
+            {
+                auto * offsets    = slot_offsets( slot );
+                auto * neighbours = offsets + header->n_network_agents + 1;
+                auto * weights    = reinterpret_cast<double *>( neighbours + header->max_edges );
+                if( network.direction() == NetworkT::EdgeDirection::Outgoing )
+                    write_transposed_adjacency( network, offsets, neighbours, weights );
+                else
+                    write_adjacency( network, offsets, neighbours, weights );
+                slot->n_edges = n_edges;
+            }
+        }
+        end_slot( slot );
+    }
+
+private:
+    template<typename NetworkT>
+    static void write_adjacency( const NetworkT & network, uint64_t * offsets, uint64_t * neighbours, double * weights )
+    {
+        uint64_t offset = 0;
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            offsets[idx_agent]      = offset;
+            const auto neighbours_i = network.get_neighbours( idx_agent );
+            const auto weights_i    = network.get_weights( idx_agent );
+            for( size_t j = 0; j < neighbours_i.size(); j++ )
+            {
+                neighbours[offset + j] = neighbours_i[j];
+                weights[offset + j]    = weights_i[j];
+            }
+            offset += neighbours_i.size();
+        }
+        offsets[network.n_agents()] = offset;
+    }
+
+    // The incoming neighbours of a network that holds the outgoing edges, in the order of toggle_incoming_outgoing
+    template<typename NetworkT>
+    static void write_transposed_adjacency(
+        const NetworkT & network, uint64_t * offsets, uint64_t * neighbours, double * weights )
+    {
+        const size_t n_agents = network.n_agents();
+        std::fill( offsets, offsets + n_agents + 1, 0 );
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            for( const auto idx_target : network.get_neighbours( idx_agent ) )
+                offsets[idx_target + 1]++;
+        }
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+            offsets[idx_agent + 1] += offsets[idx_agent];
+
+        // Every target moves its offset to its end while its neighbours are written, and is shifted back afterwards
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            const auto neighbours_i = network.get_neighbours( idx_agent );
+            const auto weights_i    = network.get_weights( idx_agent );
+            for( size_t j = 0; j < neighbours_i.size(); j++ )
+            {
+                const uint64_t position = offsets[neighbours_i[j]]++;
+                neighbours[position]    = idx_agent;
+                weights[position]       = weights_i[j];
+            }
+        }
+        std::copy_backward( offsets, offsets + n_agents, offsets + n_agents + 1 );
+        offsets[0] = 0;
+    }
+
+    std::string name{};
+    size_t segment_size                 = 0;
+    char * segment                      = nullptr;
+    SharedState::SegmentHeader * header = nullptr;
+
+    SharedState::SlotHeader * slot_at( uint64_t idx_slot );
+    uint64_t * slot_offsets( SharedState::SlotHeader * slot );
+    SharedState::SlotHeader * begin_slot( size_t step, std::span<const double> columns );
+    void end_slot( SharedState::SlotHeader * slot );
+};
+
+/*
+A snapshot in a slot of the segment. The spans point into the shared memory, so the data can change while it is read.
+SharedStateReader::validate tells if the data was consistent.
+*/
+struct SharedStateView
+{
+    uint64_t sequence = 0;
+    uint64_t idx_slot = 0;
+    uint64_t step     = 0;
+    std::span<const double> columns{};
+    bool has_network = false; // False if the network is not published or did not fit into the slot
+    std::span<const uint64_t> offsets{};
+    std::span<const uint64_t> neighbours{};
+    std::span<const double> weights{};
+};
+
+// A consistent copy of a snapshot
+struct SharedStateSnapshot
+{
+    uint64_t step = 0;
+    std::vector<double> columns{};
+    bool has_network = false;
+    std::vector<uint64_t> offsets{};
+    std::vector<uint64_t> neighbours{};
+    std::vector<double> weights{};
+};
+
+class SharedStateReader
+{
+public:
+    explicit SharedStateReader( const std::string & name );
+
+    SharedStateReader( const SharedStateReader & )             = delete;
+    SharedStateReader & operator=( const SharedStateReader & ) = delete;
+
+    ~SharedStateReader();
+
+    [[nodiscard]] const std::vector<std::string> & column_names() const
+    {
+        return column_names_;
+    }
+
+    [[nodiscard]] const std::vector<size_t> & agent_indices() const
+    {
+        return agent_indices_;
+    }
+
+    // Number of snapshots published so far
+    [[nodiscard]] uint64_t n_published() const;
+
+    // Gives a view of the latest complete snapshot without copying it, nullopt if nothing has been published yet
+    std::optional<SharedStateView> view_latest() const;
+
+    // True if the slot of view has not been written to since view_latest, i.e. everything read from view is consistent
+    bool validate( const SharedStateView & view ) const;
+
+    // Copies the latest snapshot, retrying until the copy is consistent. Returns false if nothing has been published
+    bool read_latest( SharedStateSnapshot & snapshot ) const;
+
+private:
+    size_t segment_size                       = 0;
+    const char * segment                      = nullptr;
+    const SharedState::SegmentHeader * header = nullptr;
+    std::vector<std::string> column_names_{};
+    std::vector<size_t> agent_indices_{};
+};
+
+} // namespace Seldon
\ No newline at end of file
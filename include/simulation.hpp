@@ -1,11 +1,13 @@
 #pragma once
 
+#include "checkpoint.hpp"
 #include "config_parser.hpp"
 #include "fmt/core.h"
 #include "model_factory.hpp"
 #include "network.hpp"
 #include <fmt/chrono.h>
 #include <fmt/format.h>
+#include <algorithm>
 #include <filesystem>
 #include <memory>
 #include <models/ActivityDrivenModel.hpp>
@@ -13,8 +15,19 @@
 #include <models/DeffuantModel.hpp>
 #include <network_generation.hpp>
 #include <network_io.hpp>
+#include <numeric>
+#include <observables.hpp>
 #include <optional>
+#include <random>
+#include <shared_state.hpp>
+#include <snapshot_writer.hpp>
+#include <stdexcept>
 #include <string>
+#include <trajectory.hpp>
+#include <type_traits>
+#include <util/math.hpp>
+#include <variant>
+#include <vector>
 namespace fs = std::filesystem;
 
 namespace Seldon
@@ -23,8 +36,9 @@ namespace Seldon
 class SimulationInterface
 {
 public:
-    virtual void run( const fs::path & output_dir_path ) = 0;
-    virtual ~SimulationInterface()                       = default;
+    virtual void run( const fs::path & output_dir_path )          = 0;
+    virtual void restart( const fs::path & checkpoint_file_path ) = 0;
+    virtual ~SimulationInterface()                                = default;
 };
 
 template<typename AgentType>
@@ -33,12 +47,121 @@ class Simulation : public SimulationInterface
 
 private:
     std::mt19937 gen;
+    std::unique_ptr<AsyncSnapshotWriter<AgentType>> snapshot_writer{}; // Only used for asynchronous output
+    std::unique_ptr<TrajectoryWriter> trajectory_writer{};              // Only used for the trajectory output format
+    std::vector<size_t> trajectory_agent_indices{};                     // Agents written to the trajectory
+    std::vector<double> trajectory_columns{};                           // Buffer for the frames of the trajectory
+    std::vector<AgentType> output_agents_buffer{};                      // Gathered subset of the agents
+    std::unique_ptr<ObservablesWriter> observables_writer{};            // Only used if observables are written
+    std::unique_ptr<CheckpointWriter> checkpoint_writer{};              // Created with the first checkpoint
+    std::vector<char> checkpoint_buffer{};                              // Serialized state of the next checkpoint
+    std::vector<char> model_state_buffer{};                             // State of the model in the next checkpoint
+    std::optional<size_t> restart_n_iterations = std::nullopt;          // Set if restarted from a checkpoint
+    std::vector<char> restart_model_state{};                            // State of the model in the checkpoint
+    std::unique_ptr<SharedStatePublisher> shared_state_publisher{};     // Only used if the state is published
+    std::vector<size_t> shared_state_agent_indices{};                   // Agents published to shared memory
+    std::vector<double> shared_state_columns{};                         // Buffer for the published agents
+
+    // The agents written to the trajectory or published to shared memory: the selected subset, or all agents
+    std::vector<size_t> column_output_agent_indices() const
+    {
+        if( output_agent_indices.has_value() )
+            return output_agent_indices.value();
+        std::vector<size_t> agent_indices( network.n_agents() );
+        std::iota( agent_indices.begin(), agent_indices.end(), 0 );
+        return agent_indices;
+    }
+
+    void publish_shared_state( size_t step )
+    {
+        agents_to_columns( network.agents, shared_state_agent_indices, shared_state_columns, n_threads );
+        shared_state_publisher->publish( step, shared_state_columns, network );
+    }
+
+    void write_agents( const fs::path & output_dir_path, size_t step )
+    {
+        if( trajectory_writer )
+        {
+            agents_to_columns( network.agents, trajectory_agent_indices, trajectory_columns, n_threads );
+            trajectory_writer->write_frame( step, trajectory_columns );
+            return;
+        }
+
+        auto file_path = output_dir_path / fs::path( fmt::format( "opinions_{}.txt", step ) );
+        if( output_agent_indices.has_value() )
+        {
+            const auto & agent_indices = output_agent_indices.value();
+            if( snapshot_writer )
+            {
+                snapshot_writer->write_agents( network, agent_indices, file_path.string() );
+            }
+            else
+            {
+                output_agents_buffer.resize( agent_indices.size() );
+                for( size_t i = 0; i < agent_indices.size(); i++ )
+                {
+                    output_agents_buffer[i] = network.agents[agent_indices[i]];
+                }
+                Seldon::agents_to_file( output_agents_buffer, agent_indices, file_path.string(), n_threads );
+            }
+        }
+        else if( snapshot_writer )
+        {
+            snapshot_writer->write_agents( network, file_path.string() );
+        }
+        else
+        {
+            Seldon::agents_to_file( network, file_path.string(), n_threads );
+        }
+    }
+
+    void write_checkpoint( const fs::path & output_dir_path )
+    {
+        if( !checkpoint_writer )
+        {
+            checkpoint_writer
+                = std::make_unique<CheckpointWriter>( ( output_dir_path / fs::path( "checkpoint.bin" ) ).string() );
+        }
+        model_state_buffer.clear();
+        this->model->state_to_buffer( model_state_buffer );
+        checkpoint_to_buffer( checkpoint_buffer, this->model->n_iterations(), gen, network, model_state_buffer );
+        checkpoint_writer->write( checkpoint_buffer );
+    }
+
+    // The model as an activity driven model, nullptr for the other models
+    ActivityDrivenModelAbstract<AgentType> * activity_driven_model()
+    {
+        if constexpr( std::is_same_v<AgentType, ActivityAgent> || std::is_same_v<AgentType, InertialAgent> )
+        {
+            return dynamic_cast<ActivityDrivenModelAbstract<AgentType> *>( model.get() );
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
+    void write_network( const fs::path & file_path )
+    {
+        if( snapshot_writer )
+        {
+            snapshot_writer->write_network( network, file_path.string() );
+        }
+        else
+        {
+            Seldon::network_to_file( network, file_path.string(), n_threads );
+        }
+    }
 
 public:
     std::unique_ptr<Model<AgentType>> model;
     Network<AgentType> network;
 
     Config::OutputSettings output_settings;
+    size_t n_threads = 1;
+
+    // The agents that are written to the opinion files or the trajectory, nullopt means all agents
+    std::optional<std::vector<size_t>> output_agent_indices = std::nullopt;
 
     void
     create_network( const Config::SimulationOptions & options, const std::optional<std::string> & cli_network_file )
@@ -50,7 +173,14 @@ public:
 
         if( file.has_value() )
         {
-            network = NetworkGeneration::generate_from_file<AgentType>( file.value() );
+            if( options.network_settings.file_format == Config::NetworkFileFormat::EdgeList )
+            {
+                network = NetworkGeneration::generate_from_edge_list_file<AgentType>( file.value(), options.n_threads );
+            }
+            else
+            {
+                network = NetworkGeneration::generate_from_file<AgentType>( file.value() );
+            }
         }
         else
         {
@@ -91,41 +221,184 @@ public:
         {
             network.agents = agents_from_file<AgentType>( cli_agent_file.value() );
         }
+
+        if( auto * activity_model = activity_driven_model() )
+        {
+            activity_model->set_n_threads( options.n_threads );
+        }
+    }
+
+    void select_output_agents( const Config::SimulationOptions & options )
+    {
+        const auto & settings = options.output_settings;
+        const size_t n_agents = network.n_agents();
+
+        if( settings.output_agents_file.has_value() )
+        {
+            auto agent_indices = agent_indices_from_file( settings.output_agents_file.value() );
+            for( auto idx_agent : agent_indices )
+            {
+                if( idx_agent >= n_agents )
+                {
+                    throw std::runtime_error( fmt::format(
+                        "Agent index {} in {} is out of range for {} agents", idx_agent,
+                        settings.output_agents_file.value(), n_agents ) );
+                }
+            }
+            output_agent_indices = std::move( agent_indices );
+        }
+        else if( settings.output_agents_sample.has_value() )
+        {
+            const size_t n_sample = settings.output_agents_sample.value();
+            if( n_sample > n_agents )
+            {
+                throw std::runtime_error(
+                    fmt::format( "Cannot sample {} agents for the output from {} agents", n_sample, n_agents ) );
+            }
+            // The sample uses its own generator, so that the random numbers of the simulation do not change
+            std::seed_seq seed{ options.rng_seed, 1 };
+            std::mt19937 gen_sample( seed );
+            std::vector<size_t> agent_indices{};
+            draw_unique_k_from_n( std::nullopt, n_sample, n_agents, agent_indices, gen_sample );
+            output_agent_indices = std::move( agent_indices );
+        }
+        else if( settings.output_bots_only )
+        {
+            size_t n_bots = 0;
+            if( const auto * model_settings = std::get_if<Config::ActivityDrivenSettings>( &options.model_settings ) )
+            {
+                n_bots = model_settings->n_bots;
+            }
+            else if(
+                const auto * model_settings
+                = std::get_if<Config::ActivityDrivenInertialSettings>( &options.model_settings ) )
+            {
+                n_bots = model_settings->n_bots;
+            }
+            else
+            {
+                throw std::runtime_error( "output_bots_only is only supported by the activity driven models" );
+            }
+            std::vector<size_t> agent_indices( std::min( n_bots, n_agents ) );
+            std::iota( agent_indices.begin(), agent_indices.end(), 0 );
+            output_agent_indices = std::move( agent_indices );
+        }
     }
 
     Simulation(
         const Config::SimulationOptions & options, const std::optional<std::string> & cli_network_file,
         const std::optional<std::string> & cli_agent_file )
-            : output_settings( options.output_settings )
+            : output_settings( options.output_settings ), n_threads( options.n_threads )
     {
         // Initialize the rng
         gen = std::mt19937( options.rng_seed );
 
         create_network( options, cli_network_file );
         create_model( options, cli_agent_file );
+        select_output_agents( options );
+    }
+
+    /*
+    Continues from the state in a checkpoint file. The random number generator, the agents and the network are replaced
+    by the ones in the checkpoint, and run continues with the iteration after the checkpoint.
+    */
+    void restart( const fs::path & checkpoint_file_path ) override
+    {
+        restart_n_iterations = checkpoint_from_file( checkpoint_file_path.string(), gen, network, restart_model_state );
     }
 
     void run( const fs::path & output_dir_path ) override
     {
-        auto n_output_agents     = this->output_settings.n_output_agents;
-        auto n_output_network    = this->output_settings.n_output_network;
-        auto start_output        = this->output_settings.start_output;
-        auto initial_step_number = this->output_settings.start_numbering_from;
-        auto output_initial      = this->output_settings.output_initial;
+        auto n_output_agents      = this->output_settings.n_output_agents;
+        auto n_output_network     = this->output_settings.n_output_network;
+        auto n_output_observables = this->output_settings.n_output_observables;
+        auto start_output         = this->output_settings.start_output;
+        auto initial_step_number  = this->output_settings.start_numbering_from;
+        auto output_initial       = this->output_settings.output_initial && !restart_n_iterations.has_value();
+        auto n_output_checkpoint    = this->output_settings.n_output_checkpoint;
+        auto n_output_shared_memory = this->output_settings.n_output_shared_memory;
+
+        // The files that are appended to in every step are not continued after a restart, but written anew, with the
+        // step of the checkpoint in the file name
+        auto single_output_file_path = [&]( const std::string & name, const std::string & extension )
+        {
+            if( restart_n_iterations.has_value() )
+            {
+                auto restart_step = restart_n_iterations.value() + initial_step_number;
+                return output_dir_path / fs::path( fmt::format( "{}_restart_{}{}", name, restart_step, extension ) );
+            }
+            return output_dir_path / fs::path( name + extension );
+        };
 
         fmt::print( "-----------------------------------------------------------------\n" );
         fmt::print( "Starting simulation\n" );
         fmt::print( "-----------------------------------------------------------------\n" );
 
+        if( this->output_settings.async_output )
+        {
+            snapshot_writer = std::make_unique<AsyncSnapshotWriter<AgentType>>();
+        }
+
+        if( this->output_settings.agent_output_format == Config::AgentOutputFormat::Trajectory )
+        {
+            trajectory_agent_indices = column_output_agent_indices();
+            trajectory_writer = std::make_unique<TrajectoryWriter>(
+                single_output_file_path( "trajectory", ".bin" ).string(), agent_to_string_column_names<AgentType>(),
+                trajectory_agent_indices, output_settings.trajectory_compression,
+                output_settings.trajectory_error_bound, output_settings.trajectory_keyframe_interval );
+        }
+
+        if( n_output_observables.has_value() )
+        {
+            observables_writer = std::make_unique<ObservablesWriter>(
+                single_output_file_path( "observables", ".txt" ).string(), output_settings, n_threads );
+        }
+
+        if( n_output_shared_memory.has_value() )
+        {
+            size_t max_edges = 0;
+            if( output_settings.shared_memory_network )
+            {
+                max_edges = output_settings.shared_memory_max_edges;
+                if( max_edges == 0 )
+                    max_edges = std::max( 2 * size_t( network.n_edges() ), network.n_agents() );
+            }
+            shared_state_agent_indices = column_output_agent_indices();
+            shared_state_publisher     = std::make_unique<SharedStatePublisher>(
+                output_settings.shared_memory_name, agent_to_string_column_names<AgentType>(),
+                shared_state_agent_indices, output_settings.shared_memory_slots,
+                output_settings.shared_memory_network ? network.n_agents() : 0, max_edges );
+        }
+
+        if( this->output_settings.output_contact_events )
+        {
+            auto * activity_model = activity_driven_model();
+            if( activity_model == nullptr )
+            {
+                throw std::runtime_error( "output_contact_events is only supported by the activity driven models" );
+            }
+            activity_model->record_contact_events(
+                single_output_file_path( "contacts", ".bin" ).string(), initial_step_number );
+        }
+
         if( output_initial )
         {
-            Seldon::network_to_file(
-                network,
-                ( output_dir_path / fs::path( fmt::format( "network_{}.txt", initial_step_number ) ) ).string() );
-            auto filename = fmt::format( "opinions_{}.txt", initial_step_number );
-            Seldon::agents_to_file( network, ( output_dir_path / fs::path( filename ) ).string() );
+            write_network( output_dir_path / fs::path( fmt::format( "network_{}.txt", initial_step_number ) ) );
+            write_agents( output_dir_path, initial_step_number );
+            if( observables_writer )
+                observables_writer->write( initial_step_number, network.agents );
+            if( shared_state_publisher )
+                publish_shared_state( initial_step_number );
+        }
+        if( restart_n_iterations.has_value() )
+        {
+            this->model->restart_iterations( restart_n_iterations.value() );
+            this->model->state_from_buffer( restart_model_state );
+        }
+        else
+        {
+            this->model->initialize_iterations();
         }
-        this->model->initialize_iterations();
 
         typedef std::chrono::milliseconds ms;
         auto t_simulation_start = std::chrono::high_resolution_clock::now();
@@ -150,8 +423,21 @@ public:
             if( n_output_agents.has_value() && ( this->model->n_iterations() >= start_output )
                 && ( this->model->n_iterations() % n_output_agents.value() == 0 ) )
             {
-                auto filename = fmt::format( "opinions_{}.txt", this->model->n_iterations() + initial_step_number );
-                Seldon::agents_to_file( network, ( output_dir_path / fs::path( filename ) ).string() );
+                write_agents( output_dir_path, this->model->n_iterations() + initial_step_number );
+            }
+
+            // Write out the observables?
+            if( n_output_observables.has_value() && ( this->model->n_iterations() >= start_output )
+                && ( this->model->n_iterations() % n_output_observables.value() == 0 ) )
+            {
+                observables_writer->write( this->model->n_iterations() + initial_step_number, network.agents );
+            }
+
+            // Publish the state to shared memory?
+            if( n_output_shared_memory.has_value() && ( this->model->n_iterations() >= start_output )
+                && ( this->model->n_iterations() % n_output_shared_memory.value() == 0 ) )
+            {
+                publish_shared_state( this->model->n_iterations() + initial_step_number );
             }
 
             // Write out the network?
@@ -159,8 +445,50 @@ public:
                 && ( this->model->n_iterations() % n_output_network.value() == 0 ) )
             {
                 auto filename = fmt::format( "network_{}.txt", this->model->n_iterations() + initial_step_number );
-                Seldon::network_to_file( network, ( output_dir_path / fs::path( filename ) ).string() );
+                write_network( output_dir_path / fs::path( filename ) );
             }
+
+            // Write a checkpoint? The final state of the simulation needs none
+            auto checkpoint_request = take_checkpoint_request();
+            bool checkpoint_due     = n_output_checkpoint.has_value()
+                                  && ( this->model->n_iterations() % n_output_checkpoint.value() == 0 )
+                                  && !this->model->finished();
+            if( checkpoint_due || checkpoint_request != CheckpointRequest::None )
+            {
+                write_checkpoint( output_dir_path );
+            }
+            if( checkpoint_request == CheckpointRequest::CheckpointAndStop )
+            {
+                fmt::print( "Stopping after the checkpoint of iteration {}\n", this->model->n_iterations() );
+                break;
+            }
+        }
+
+        // Wait for the asynchronous output to be written
+        if( snapshot_writer )
+        {
+            snapshot_writer->flush();
+            snapshot_writer.reset();
+        }
+
+        observables_writer.reset();
+        shared_state_publisher.reset();
+
+        if( this->output_settings.output_contact_events )
+            activity_driven_model()->stop_recording_contact_events();
+
+        // Wait for the last checkpoint to be written
+        if( checkpoint_writer )
+        {
+            checkpoint_writer->wait();
+            checkpoint_writer.reset();
+        }
+
+        // Write the index of the trajectory file
+        if( trajectory_writer )
+        {
+            trajectory_writer->close();
+            trajectory_writer.reset();
         }
 
         auto t_simulation_end = std::chrono::high_resolution_clock::now();
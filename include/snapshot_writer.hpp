@@ -0,0 +1,211 @@
+#pragma once
+#include "agent_io.hpp"
+#include "network.hpp"
+#include "network_io.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Writes opinion and network snapshots on a background thread, so that the simulation can continue
+while the output is being formatted and written to disk.
+The calling thread copies the state into a snapshot buffer and hands it to the writer thread through a bounded queue.
+Snapshot buffers are recycled, so that after the first few snapshots no allocations happen for copying the state.
+If the writer thread falls behind and the queue is full, the calling thread blocks until a buffer is free again.
+*/
+template<typename AgentT>
+class AsyncSnapshotWriter
+{
+public:
+    using NetworkT = Network<AgentT>;
+
+    AsyncSnapshotWriter( size_t queue_capacity = 2 ) : queue_capacity( std::max<size_t>( 1, queue_capacity ) )
+    {
+        writer_thread = std::thread( [this]() { writer_loop(); } );
+    }
+
+    AsyncSnapshotWriter( const AsyncSnapshotWriter & )             = delete;
+    AsyncSnapshotWriter & operator=( const AsyncSnapshotWriter & ) = delete;
+
+    ~AsyncSnapshotWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stop = true;
+        }
+        cv_pending.notify_all();
+        writer_thread.join();
+    }
+
+    /*
+    Queues the agents of the network to be written with agents_to_file. Only the agents are copied.
+    */
+    void write_agents( const NetworkT & network, const std::string & file_path )
+    {
+        auto snapshot         = acquire_snapshot();
+        snapshot.kind         = Snapshot::Kind::Agents;
+        snapshot.path         = file_path;
+        snapshot.state.agents = network.agents;
+        submit( std::move( snapshot ) );
+    }
+
+    /*
+    Queues the agents given by agent_indices to be written with agents_to_file. Only these agents are copied.
+    */
+    void write_agents(
+        const NetworkT & network, const std::vector<size_t> & agent_indices, const std::string & file_path )
+    {
+        auto snapshot          = acquire_snapshot();
+        snapshot.kind          = Snapshot::Kind::AgentSubset;
+        snapshot.path          = file_path;
+        snapshot.agent_indices = agent_indices;
+        snapshot.state.agents.resize( agent_indices.size() );
+        for( size_t i = 0; i < agent_indices.size(); i++ )
+        {
+            snapshot.state.agents[i] = network.agents[agent_indices[i]];
+        }
+        submit( std::move( snapshot ) );
+    }
+
+    /*
+    Queues the network to be written with network_to_file. The agents and the adjacency lists are copied.
+    */
+    void write_network( const NetworkT & network, const std::string & file_path )
+    {
+        auto snapshot  = acquire_snapshot();
+        snapshot.kind  = Snapshot::Kind::Network;
+        snapshot.path  = file_path;
+        snapshot.state = network;
+        submit( std::move( snapshot ) );
+    }
+
+    /*
+    Blocks until all queued snapshots have been written. Rethrows the first error that happened on the writer thread.
+    */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        cv_free.wait( lock, [this]() { return ( pending.empty() && !busy ) || error; } );
+        rethrow_error();
+    }
+
+private:
+    struct Snapshot
+    {
+        enum class Kind
+        {
+            Agents,
+            AgentSubset, // state.agents holds the agents given by agent_indices
+            Network
+        };
+
+        Kind kind = Kind::Agents;
+        std::string path{};
+        NetworkT state{};
+        std::vector<size_t> agent_indices{};
+    };
+
+    size_t queue_capacity;
+    std::deque<Snapshot> pending{};   // Snapshots waiting to be written, in order
+    std::vector<Snapshot> recycled{}; // Recycled snapshot buffers
+    bool busy = false;                // True while the writer thread is writing a snapshot
+    bool stop = false;
+    std::exception_ptr error{};
+
+    std::mutex mutex{};
+    std::condition_variable cv_pending{}; // Signals new pending snapshots (or stop) to the writer thread
+    std::condition_variable cv_free{};    // Signals free queue slots (or an error) to the calling thread
+    std::thread writer_thread{};
+
+    void rethrow_error()
+    {
+        if( error )
+        {
+            auto e = std::exchange( error, nullptr );
+            std::rethrow_exception( e );
+        }
+    }
+
+    Snapshot acquire_snapshot()
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        // Backpressure: wait until there is room in the queue
+        cv_free.wait( lock, [this]() { return pending.size() + ( busy ? 1 : 0 ) < queue_capacity || error; } );
+        rethrow_error();
+
+        if( recycled.empty() )
+            return Snapshot{};
+
+        auto snapshot = std::move( recycled.back() );
+        recycled.pop_back();
+        return snapshot;
+    }
+
+    void submit( Snapshot && snapshot )
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            pending.push_back( std::move( snapshot ) );
+        }
+        cv_pending.notify_one();
+    }
+
+    void writer_loop()
+    {
+        while( true )
+        {
+            Snapshot snapshot;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                cv_pending.wait( lock, [this]() { return !pending.empty() || stop; } );
+                if( pending.empty() )
+                    return; // Stopped and nothing left to write
+                snapshot = std::move( pending.front() );
+                pending.pop_front();
+                busy = true;
+            }
+
+            std::exception_ptr snapshot_error{};
+            try
+            {
+                if( snapshot.kind == Snapshot::Kind::Agents )
+                {
+                    agents_to_file( snapshot.state, snapshot.path );
+                }
+                else if( snapshot.kind == Snapshot::Kind::AgentSubset )
+                {
+                    agents_to_file( snapshot.state.agents, snapshot.agent_indices, snapshot.path );
+                }
+                else
+                {
+                    network_to_file( snapshot.state, snapshot.path );
+                }
+            }
+            catch( ... )
+            {
+                snapshot_error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                busy = false;
+                if( snapshot_error && !error )
+                    error = snapshot_error;
+                recycled.push_back( std::move( snapshot ) );
+            }
+            cv_free.notify_all();
+        }
+    }
+};
+
+} // namespace Seldon
\ No newline at end of file
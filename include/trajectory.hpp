@@ -0,0 +1,221 @@
+#pragma once
+#include "agent_io.hpp"
+#include "config_parser.hpp"
+#include "util/parallel.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+A trajectory file stores the agent data of many output steps in a single, append-only binary file, instead of one
+opinions_N.txt file per output step. All integers and doubles are stored in native byte order.
+
+    file header   : magic "SELDTRAJ", version, n_columns, n_agents, column names, agent indices
+    frame records : frame header ( magic, encoding, step, payload size, checksum ), followed by the payload,
+                    which holds the columns one after another ( n_agents values each )
+    index footer  : ( step, offset ) of every frame, followed by the number of frames, the offset of the index,
+                    the checksum of the index and the magic "SELDTIDX"
+
+Without compression, the payload holds the columns as raw doubles. With compression, every column is stored as
+( method, quantization step if quantized, number of bytes, encoded column ). XOR encoded columns store every value
+XORed with its reference, as in the Gorilla time series compression: a single bit for unchanged values, and otherwise
+only the bits between the leading and trailing zeros of the XOR. Quantized columns (only the opinions, for lossy
+compression) store the difference of the quantized value to the quantized reference as a zigzag varint. The reference of
+a value is the value of the same agent in the previous frame, except in keyframes, where it is the previous value in the
+column. Every keyframe_interval-th frame is a keyframe, so reading a frame only requires decoding the frames since the
+last keyframe.
+
+Frames are flushed as soon as they are written. The index footer is only written when the writer is closed, so if the
+simulation is interrupted the file ends after the last frame (or in the middle of it). The reader then rebuilds the
+index by scanning the frame records, and discards a truncated or corrupted last frame.
+*/
+namespace Trajectory
+{
+constexpr char file_magic[8]         = { 'S', 'E', 'L', 'D', 'T', 'R', 'A', 'J' };
+constexpr char index_magic[8]        = { 'S', 'E', 'L', 'D', 'T', 'I', 'D', 'X' };
+constexpr uint32_t frame_magic       = 0x454d5246; // "FRME"
+constexpr uint32_t version           = 1;
+constexpr uint32_t encoding_raw      = 0;          // Payload holds the columns as raw doubles
+constexpr uint32_t encoding_keyframe = 1;          // Compressed, does not depend on other frames
+constexpr uint32_t encoding_delta    = 2;          // Compressed, relative to the previous frame
+constexpr uint8_t column_xor         = 0;
+constexpr uint8_t column_quantized   = 1;
+constexpr size_t max_name_length     = 1024;
+
+struct FrameHeader
+{
+    uint32_t magic        = frame_magic;
+    uint32_t encoding     = encoding_raw;
+    uint64_t step         = 0;
+    uint64_t payload_size = 0; // In bytes
+    uint64_t checksum     = 0; // Checksum of the payload
+};
+
+struct IndexEntry
+{
+    uint64_t step   = 0;
+    uint64_t offset = 0; // Offset of the frame header from the beginning of the file
+};
+
+struct Footer
+{
+    uint64_t n_frames     = 0;
+    uint64_t index_offset = 0;
+    uint64_t checksum     = 0; // Checksum of the index entries
+    char magic[8]         = {};
+};
+
+// Fast checksum over 64 bit words, used to detect torn writes
+uint64_t checksum( const char * data, size_t n_bytes );
+} // namespace Trajectory
+
+class TrajectoryWriter
+{
+public:
+    // Creates (or overwrites) the file and writes the file header
+    TrajectoryWriter(
+        const std::string & file_path, const std::vector<std::string> & column_names,
+        const std::vector<size_t> & agent_indices,
+        Config::TrajectoryCompression compression = Config::TrajectoryCompression::None, double error_bound = 1e-6,
+        size_t keyframe_interval = 64 );
+
+    TrajectoryWriter( const TrajectoryWriter & )             = delete;
+    TrajectoryWriter & operator=( const TrajectoryWriter & ) = delete;
+
+    ~TrajectoryWriter();
+
+    // Appends a frame. columns has to hold n_columns() columns of n_agents() values each, one column after the other
+    void write_frame( size_t step, std::span<const double> columns );
+
+    // Writes the index footer and closes the file. Called by the destructor, if it has not been called before
+    void close();
+
+    size_t n_columns() const
+    {
+        return n_columns_;
+    }
+
+    size_t n_agents() const
+    {
+        return n_agents_;
+    }
+
+private:
+    std::ofstream fs{};
+    size_t n_columns_ = 0;
+    size_t n_agents_  = 0;
+    uint64_t offset   = 0; // Current end of the file
+    std::vector<Trajectory::IndexEntry> index{};
+
+    Config::TrajectoryCompression compression = Config::TrajectoryCompression::None;
+    double quantization_step                  = 0;
+    size_t keyframe_interval                  = 1;
+    std::optional<size_t> idx_quantized_column{}; // The opinion column, for lossy compression
+    std::vector<double> reference{};              // The previous frame, as the reader will decode it
+    std::vector<char> payload{};
+
+    void encode_frame( std::span<const double> columns, bool keyframe );
+};
+
+class TrajectoryReader
+{
+public:
+    explicit TrajectoryReader( const std::string & file_path );
+
+    size_t n_frames() const
+    {
+        return index.size();
+    }
+
+    size_t step( size_t idx_frame ) const
+    {
+        return index[idx_frame].step;
+    }
+
+    // False if the index footer was missing or damaged and the index had to be rebuilt by scanning the file
+    bool has_footer() const
+    {
+        return footer_found;
+    }
+
+    const std::vector<std::string> & column_names() const
+    {
+        return column_names_;
+    }
+
+    const std::vector<size_t> & agent_indices() const
+    {
+        return agent_indices_;
+    }
+
+    // Reads the columns of a frame into columns, in the layout of TrajectoryWriter::write_frame
+    void read_frame( size_t idx_frame, std::vector<double> & columns );
+
+    std::vector<double> read_frame( size_t idx_frame )
+    {
+        std::vector<double> columns{};
+        read_frame( idx_frame, columns );
+        return columns;
+    }
+
+private:
+    std::ifstream fs{};
+    std::string file_path{};
+    std::vector<std::string> column_names_{};
+    std::vector<size_t> agent_indices_{};
+    std::vector<Trajectory::IndexEntry> index{};
+    std::vector<char> payload{};
+    bool footer_found = false;
+
+    std::vector<double> decoded{}; // The last decoded frame
+    std::optional<size_t> idx_decoded{};
+
+    bool read_footer( uint64_t data_begin, uint64_t file_size );
+    void scan_frames( uint64_t data_begin, uint64_t file_size );
+    Trajectory::FrameHeader read_frame_header( size_t idx_frame );
+    void decode_frame( size_t idx_frame );
+};
+
+/*
+Writes every frame of the trajectory file to output_dir/opinions_{step}.txt, in the same format as agents_to_file
+*/
+void trajectory_to_text_files(
+    const std::string & trajectory_path, const std::filesystem::path & output_dir, size_t n_threads = 1 );
+
+/*
+Gathers the agents given by agent_indices into columns, in the layout of TrajectoryWriter::write_frame
+*/
+template<typename AgentT>
+void agents_to_columns(
+    const std::vector<AgentT> & agents, const std::vector<size_t> & agent_indices, std::vector<double> & columns,
+    size_t n_threads = 1 )
+{
+    const size_t n_columns = agent_to_string_column_names<AgentT>().size();
+    const size_t n_rows    = agent_indices.size();
+    columns.resize( n_columns * n_rows );
+
+    Parallel::parallel_for_chunks(
+        n_rows, n_threads,
+        [&]( size_t, size_t begin, size_t end )
+        {
+            std::vector<double> values( n_columns );
+            for( size_t idx_row = begin; idx_row < end; idx_row++ )
+            {
+                agent_to_columns( agents[agent_indices[idx_row]], std::span<double>( values ) );
+                for( size_t idx_col = 0; idx_col < n_columns; idx_col++ )
+                {
+                    columns[idx_col * n_rows + idx_row] = values[idx_col];
+                }
+            }
+        } );
+}
+
+} // namespace Seldon
\ No newline at end of file
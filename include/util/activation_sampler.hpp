@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Draws which agents are activated, where agent i is activated with probability a_i independently of the others, in
+time proportional to the number of activated agents instead of the number of agents.
+
+The agents are grouped into buckets of activities a in [p_max / 2, p_max), with p_max a power of two. Activities of at
+least one go into the bucket with p_max = 1, and are always activated. Within a bucket, candidates are drawn with
+probability p_max each by geometric skips over the agents, and a candidate is activated with probability a_i / p_max.
+In the bucket with p_max = 1 every agent is a candidate.
+Every agent is thus activated with probability a_i, and at least every second candidate is activated.
+*/
+class ActivationSampler
+{
+public:
+    // Sorts the agents into the buckets of their activities activity( idx_agent )
+    template<typename ActivityCallbackT>
+    void build( size_t n_agents, ActivityCallbackT activity )
+    {
+        std::map<int, Bucket> buckets_by_exponent{};
+        for( size_t idx_agent = 0; idx_agent < n_agents; idx_agent++ )
+        {
+            const double a = activity( idx_agent );
+            if( !( a > 0 ) )
+                continue; // Never activated
+            int exponent = 0;
+            std::frexp( a, &exponent ); // a in [2^(exponent - 1), 2^exponent)
+            exponent      = std::min( exponent, 0 );
+            auto & bucket = buckets_by_exponent[exponent];
+            bucket.p_max  = std::ldexp( 1.0, exponent );
+            bucket.agents.push_back( idx_agent );
+            bucket.activities.push_back( a );
+        }
+
+        buckets.clear();
+        for( auto & [exponent, bucket] : buckets_by_exponent )
+        {
+            buckets.push_back( std::move( bucket ) );
+        }
+        n_agents_ = n_agents;
+    }
+
+    // The number of agents at the last build
+    [[nodiscard]] size_t n_agents() const
+    {
+        return n_agents_;
+    }
+
+    // Writes the activated agents, in ascending order, to activated_agents
+    void sample( std::mt19937 & gen, std::vector<size_t> & activated_agents )
+    {
+        activated_agents.clear();
+        std::uniform_real_distribution<double> dis_acceptance( 0.0, 1.0 );
+        for( const auto & bucket : buckets )
+        {
+            // Every agent of the top bucket is a candidate, the geometric distribution needs p_max < 1
+            if( bucket.p_max >= 1.0 )
+            {
+                for( size_t position = 0; position < bucket.agents.size(); position++ )
+                {
+                    if( dis_acceptance( gen ) < bucket.activities[position] )
+                        activated_agents.push_back( bucket.agents[position] );
+                }
+                continue;
+            }
+            std::geometric_distribution<size_t> dis_skip( bucket.p_max );
+            for( size_t position = dis_skip( gen ); position < bucket.agents.size(); position += 1 + dis_skip( gen ) )
+            {
+                if( dis_acceptance( gen ) * bucket.p_max < bucket.activities[position] )
+                    activated_agents.push_back( bucket.agents[position] );
+            }
+        }
+        std::sort( activated_agents.begin(), activated_agents.end() );
+    }
+
+private:
+    struct Bucket
+    {
+        double p_max = 0;
+        std::vector<size_t> agents{}; // Ascending
+        std::vector<double> activities{};
+    };
+
+    std::vector<Bucket> buckets{};
+    size_t n_agents_ = 0;
+};
+
+} // namespace Seldon
\ No newline at end of file
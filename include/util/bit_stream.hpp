@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Appends bit fields of 1 to 64 bits to a byte buffer. Bits are packed least significant bit first into 64 bit words,
+which push_bytes stores byte by byte in little endian order, so the buffer does not depend on the byte order of the
+host.
+*/
+class BitWriter
+{
+public:
+    explicit BitWriter( std::vector<char> & out ) : out( out ) {}
+
+    // Writes the n_bits lowest bits of bits, 1 <= n_bits <= 64
+    void write( uint64_t bits, int n_bits )
+    {
+        if( n_bits < 64 )
+            bits &= ( uint64_t( 1 ) << n_bits ) - 1;
+
+        accumulator |= bits << n_accumulated;
+        if( n_accumulated + n_bits >= 64 )
+        {
+            push_bytes( accumulator, 8 );
+            const int n_spilled = n_accumulated + n_bits - 64;
+            accumulator         = n_spilled > 0 ? bits >> ( n_bits - n_spilled ) : 0;
+            n_accumulated       = n_spilled;
+        }
+        else
+        {
+            n_accumulated += n_bits;
+        }
+    }
+
+    // Writes the remaining bits, padded with zeros to a full byte
+    void finish()
+    {
+        push_bytes( accumulator, ( n_accumulated + 7 ) / 8 );
+        accumulator   = 0;
+        n_accumulated = 0;
+    }
+
+private:
+    std::vector<char> & out;
+    uint64_t accumulator = 0;
+    int n_accumulated    = 0;
+
+    void push_bytes( uint64_t word, int n_bytes )
+    {
+        for( int i = 0; i < n_bytes; i++ )
+        {
+            out.push_back( char( ( word >> ( 8 * i ) ) & 0xff ) );
+        }
+    }
+};
+
+/*
+Reads bit fields written by BitWriter. Throws if more bits are read than the buffer holds.
+*/
+class BitReader
+{
+public:
+    BitReader( const char * data, size_t n_bytes ) : data( data ), n_bytes( n_bytes ) {}
+
+    // Reads n_bits bits, 1 <= n_bits <= 64
+    uint64_t read( int n_bits )
+    {
+        if( n_available >= n_bits )
+            return take( n_bits );
+
+        const int n_low    = n_available;
+        const uint64_t low = take( n_low );
+        refill();
+        if( n_available < n_bits - n_low )
+            throw std::runtime_error( "Unexpected end of bit stream" );
+        return low | ( take( n_bits - n_low ) << n_low );
+    }
+
+private:
+    const char * data;
+    size_t n_bytes;
+    size_t position      = 0;
+    uint64_t accumulator = 0;
+    int n_available      = 0;
+
+    uint64_t take( int n_bits )
+    {
+        if( n_bits == 0 )
+            return 0;
+        if( n_bits == 64 )
+        {
+            const uint64_t result = accumulator;
+            accumulator           = 0;
+            n_available           = 0;
+            return result;
+        }
+        const uint64_t result = accumulator & ( ( uint64_t( 1 ) << n_bits ) - 1 );
+        accumulator >>= n_bits;
+        n_available -= n_bits;
+        return result;
+    }
+
+    void refill()
+    {
+        const size_t n_load = std::min<size_t>( 8, n_bytes - position );
+        accumulator         = 0;
+        for( size_t i = 0; i < n_load; i++ )
+        {
+            accumulator |= uint64_t( uint8_t( data[position + i] ) ) << ( 8 * i );
+        }
+        position += n_load;
+        n_available = int( 8 * n_load );
+    }
+};
+
+// Appends value as a LEB128 variable length integer
+inline void write_varint( std::vector<char> & out, uint64_t value )
+{
+    while( value >= 0x80 )
+    {
+        out.push_back( char( ( value & 0x7f ) | 0x80 ) );
+        value >>= 7;
+    }
+    out.push_back( char( value ) );
+}
+
+// Reads a LEB128 variable length integer starting at data[position] and advances position
+inline uint64_t read_varint( const char * data, size_t n_bytes, size_t & position )
+{
+    uint64_t value = 0;
+    for( int shift = 0; shift < 64; shift += 7 )
+    {
+        if( position >= n_bytes )
+            throw std::runtime_error( "Unexpected end of varint stream" );
+        const auto byte = uint8_t( data[position++] );
+        value |= uint64_t( byte & 0x7f ) << shift;
+        if( ( byte & 0x80 ) == 0 )
+            return value;
+    }
+    throw std::runtime_error( "Invalid varint" );
+}
+
+// Maps signed integers to unsigned ones, so that numbers with a small absolute value stay small
+inline uint64_t zigzag_encode( int64_t value )
+{
+    return ( uint64_t( value ) << 1 ) ^ uint64_t( value >> 63 );
+}
+
+inline int64_t zigzag_decode( uint64_t value )
+{
+    return int64_t( value >> 1 ) ^ -int64_t( value & 1 );
+}
+
+} // namespace Seldon
\ No newline at end of file
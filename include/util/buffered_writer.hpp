@@ -0,0 +1,70 @@
+#pragma once
+#include "util/parallel.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Writes a file consisting of a header followed by n_rows rows.
+The rows are produced by format_row( buffer, idx_row ), which has to append row idx_row to the fmt::memory_buffer
+buffer. Rows are formatted in blocks of rows_per_block rows per thread, straight into reusable buffers, and every block
+is written with a single call to write. The file contents therefore do not depend on n_threads.
+*/
+template<typename FormatRowT>
+void write_rows_to_file(
+    const std::string & file_path, std::string_view header, size_t n_rows, FormatRowT format_row, size_t n_threads = 1,
+    size_t rows_per_block = 16384 )
+{
+    std::ofstream fs( file_path, std::ios::out | std::ios::binary | std::ios::trunc );
+    if( !fs.is_open() )
+        return;
+
+    fs.write( header.data(), header.size() );
+
+    n_threads                   = std::max<size_t>( 1, n_threads );
+    rows_per_block              = std::max<size_t>( 1, rows_per_block );
+    const size_t rows_per_sweep = n_threads * rows_per_block;
+    std::vector<fmt::memory_buffer> buffers( n_threads );
+
+    for( size_t sweep_begin = 0; sweep_begin < n_rows; sweep_begin += rows_per_sweep )
+    {
+        const size_t n_rows_sweep = std::min( rows_per_sweep, n_rows - sweep_begin );
+        const size_t n_chunks     = Parallel::parallel_for_chunks(
+            n_rows_sweep, n_threads,
+            [&]( size_t idx_chunk, size_t begin, size_t end )
+            {
+                auto & buffer = buffers[idx_chunk];
+                buffer.clear();
+                for( size_t idx_row = sweep_begin + begin; idx_row < sweep_begin + end; idx_row++ )
+                {
+                    format_row( buffer, idx_row );
+                }
+            } );
+
+        for( size_t idx_chunk = 0; idx_chunk < n_chunks; idx_chunk++ )
+        {
+            fs.write( buffers[idx_chunk].data(), buffers[idx_chunk].size() );
+        }
+    }
+}
+
+/*
+Appends str to the buffer, right aligned in a field of the given width. Equivalent to formatting with "{:>width}".
+*/
+inline void append_right_aligned( fmt::memory_buffer & buffer, std::string_view str, size_t width )
+{
+    for( size_t i = str.size(); i < width; i++ )
+    {
+        buffer.push_back( ' ' );
+    }
+    buffer.append( str );
+}
+
+} // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+A set of directed edges ( i, j ), stored as packed 64-bit keys in a flat open-addressing hash table with linear
+probing. Clearing keeps the memory, so a set that is refilled every step only allocates while it grows.
+*/
+class EdgeHashSet
+{
+public:
+    // Removes all edges and makes room for at least n_edges edges
+    void clear( size_t n_edges = 0 )
+    {
+        n_stored = 0;
+        if( 2 * n_edges > slots.size() )
+            resize_slots( 2 * n_edges );
+        else
+            std::fill( slots.begin(), slots.end(), empty );
+    }
+
+    void insert( size_t i, size_t j )
+    {
+        if( 2 * ( n_stored + 1 ) > slots.size() )
+            grow();
+        const uint64_t key = pack( i, j );
+        size_t idx_slot    = slot_of( key );
+        while( slots[idx_slot] != empty )
+        {
+            if( slots[idx_slot] == key )
+                return;
+            idx_slot = ( idx_slot + 1 ) & mask;
+        }
+        slots[idx_slot] = key;
+        n_stored++;
+    }
+
+    [[nodiscard]] bool contains( size_t i, size_t j ) const
+    {
+        if( n_stored == 0 )
+            return false;
+        const uint64_t key = pack( i, j );
+        for( size_t idx_slot = slot_of( key ); slots[idx_slot] != empty; idx_slot = ( idx_slot + 1 ) & mask )
+        {
+            if( slots[idx_slot] == key )
+                return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return n_stored;
+    }
+
+private:
+    static constexpr uint64_t empty = UINT64_MAX; // Agent indices are below 2^32, so no edge packs to this
+
+    std::vector<uint64_t> slots{}; // The number of slots is a power of two
+    size_t mask     = 0;
+    size_t n_stored = 0;
+
+    static uint64_t pack( size_t i, size_t j )
+    {
+        return ( uint64_t( i ) << 32 ) | uint64_t( j );
+    }
+
+    [[nodiscard]] size_t slot_of( uint64_t key ) const
+    {
+        // Fibonacci hashing, the high bits of the product are well mixed
+        return size_t( ( key * 0x9e3779b97f4a7c15ULL ) >> 32 ) & mask;
+    }
+
+    void resize_slots( size_t n_slots )
+    {
+        size_t capacity = 16;
+        while( capacity < n_slots )
+            capacity *= 2;
+        slots.assign( capacity, empty );
+        mask = capacity - 1;
+    }
+
+    void grow()
+    {
+        std::vector<uint64_t> old_slots = std::move( slots );
+        resize_slots( 2 * old_slots.size() );
+        for( const auto key : old_slots )
+        {
+            if( key == empty )
+                continue;
+            size_t idx_slot = slot_of( key );
+            while( slots[idx_slot] != empty )
+                idx_slot = ( idx_slot + 1 ) & mask;
+            slots[idx_slot] = key;
+        }
+    }
+};
+
+} // namespace Seldon
\ No newline at end of file
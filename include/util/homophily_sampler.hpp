@@ -0,0 +1,239 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace Seldon
+{
+
+/*
+Draws the contacts of an agent i in the activity driven model, where agent j is contacted with the weight
+w_ij = max( tolerance, |x_i - x_j| )^(-homophily), without evaluating the weights of all agents.
+
+The agents are kept sorted by opinion. Around x_i the other agents are grouped into shells of opinion distance:
+[0, tolerance] and, on either side, ( d_l, d_l * ratio ], where ratio is chosen such that the weights within a shell
+differ at most by a factor of two. A binary search gives the agents of each shell. A partner is drawn by picking a
+shell with probability proportional to the number of its agents times its largest weight, then an agent of the shell
+uniformly, which is accepted with probability w_ij / (largest weight). Accepted agents are removed from their shell, so
+that the draws are successive sampling without replacement, the same distribution as reservoir_sampling_A_ExpJ.
+
+The shells take O( n_shells log N ) per contacting agent, where n_shells grows with the logarithm of the opinion range
+over the tolerance, and each partner O( n_shells ) with at most two proposals on average.
+*/
+class HomophilySampler
+{
+public:
+    static constexpr double tolerance = 1e-10; // The smallest opinion distance in the weights
+
+    struct Shell
+    {
+        size_t begin      = 0; // The agents at the positions [begin, end) of the sorted agents
+        size_t end        = 0;
+        double max_weight = 0; // The largest weight of the agents in the shell
+        size_t n_drawn    = 0; // Agents of the shell that were drawn already
+        double mass       = 0; // ( end - begin - n_drawn ) * max_weight
+    };
+
+    // The memory used by sample, one per thread that samples concurrently
+    struct Workspace
+    {
+        std::vector<Shell> shells{};           // Sorted by position
+        std::vector<size_t> drawn_positions{}; // Sorted positions of the drawn agents
+    };
+
+    /*
+    Sorts the agents by their opinions opinion( idx_agent ). Starts from the order of the previous call, which is
+    nearly sorted if the opinions changed little since.
+    */
+    template<typename OpinionCallbackT>
+    void update( size_t n_agents, OpinionCallbackT opinion )
+    {
+        if( order.size() != n_agents )
+        {
+            order.resize( n_agents );
+            std::iota( order.begin(), order.end(), 0 );
+        }
+        sorted_opinions.resize( n_agents );
+        for( size_t position = 0; position < n_agents; position++ )
+        {
+            sorted_opinions[position] = opinion( order[position] );
+        }
+
+        // Ties are ordered by the agent index, so that the order does not depend on the previous order
+        auto less = [&]( double x1, size_t idx1, double x2, size_t idx2 )
+        { return x1 < x2 || ( x1 == x2 && idx1 < idx2 ); };
+
+        // Insertion sort, which is linear for nearly sorted opinions, with a fall back for too many moves
+        const size_t max_moves = 8 * n_agents;
+        size_t n_moves         = 0;
+        for( size_t position = 1; position < n_agents && n_moves <= max_moves; position++ )
+        {
+            const double x   = sorted_opinions[position];
+            const size_t idx = order[position];
+            size_t hole      = position;
+            while( hole > 0 && less( x, idx, sorted_opinions[hole - 1], order[hole - 1] ) )
+            {
+                sorted_opinions[hole] = sorted_opinions[hole - 1];
+                order[hole]           = order[hole - 1];
+                hole--;
+            }
+            sorted_opinions[hole] = x;
+            order[hole]           = idx;
+            n_moves += position - hole;
+        }
+
+        if( n_moves > max_moves )
+        {
+            std::sort(
+                order.begin(), order.end(),
+                [&]( size_t idx1, size_t idx2 ) { return less( opinion( idx1 ), idx1, opinion( idx2 ), idx2 ); } );
+            for( size_t position = 0; position < n_agents; position++ )
+            {
+                sorted_opinions[position] = opinion( order[position] );
+            }
+        }
+
+        ranks.resize( n_agents );
+        for( size_t position = 0; position < n_agents; position++ )
+        {
+            ranks[order[position]] = position;
+        }
+    }
+
+    /*
+    Draws min( k, N - 1 ) distinct agents other than idx_agent into buffer, with the opinions of the last update.
+    */
+    void sample( size_t idx_agent, size_t k, double homophily, std::vector<size_t> & buffer, std::mt19937 & gen )
+    {
+        sample( idx_agent, k, homophily, buffer, gen, default_workspace );
+    }
+
+    // Same as sample, with the given workspace, so that several threads can sample at the same time
+    void sample(
+        size_t idx_agent, size_t k, double homophily, std::vector<size_t> & buffer, std::mt19937 & gen,
+        Workspace & workspace ) const
+    {
+        auto & shells          = workspace.shells;
+        auto & drawn_positions = workspace.drawn_positions;
+
+        buffer.clear();
+        const size_t n_agents = order.size();
+        const size_t n_draws  = std::min( k, n_agents > 0 ? n_agents - 1 : 0 );
+        if( n_draws == 0 )
+            return;
+
+        const double x = sorted_opinions[ranks[idx_agent]];
+        auto weight    = [&]( size_t position )
+        { return std::pow( std::max( tolerance, std::abs( x - sorted_opinions[position] ) ), -homophily ); };
+
+        build_shells( x, homophily, weight, shells );
+
+        // The contacting agent itself is never drawn
+        drawn_positions.assign( 1, ranks[idx_agent] );
+        shells[shell_of( ranks[idx_agent], shells )].n_drawn++;
+
+        std::uniform_real_distribution<double> distribution( 0.0, 1.0 );
+        double total_mass = update_masses( shells );
+        while( buffer.size() < n_draws && total_mass > 0 )
+        {
+            // Pick a shell in proportion to its mass
+            double u         = distribution( gen ) * total_mass;
+            size_t idx_shell = 0;
+            while( idx_shell + 1 < shells.size() && u >= shells[idx_shell].mass )
+            {
+                u -= shells[idx_shell].mass;
+                idx_shell++;
+            }
+            auto & shell             = shells[idx_shell];
+            const size_t n_available = shell.end - shell.begin - shell.n_drawn;
+            if( n_available == 0 )
+                continue;
+
+            // Pick one of the agents of the shell, that have not been drawn yet, uniformly
+            std::uniform_int_distribution<size_t> dist_position( 0, n_available - 1 );
+            size_t position = shell.begin + dist_position( gen );
+            for( auto it = std::lower_bound( drawn_positions.begin(), drawn_positions.end(), shell.begin );
+                 it != drawn_positions.end() && *it <= position; it++ )
+            {
+                position++;
+            }
+
+            if( distribution( gen ) * shell.max_weight < weight( position ) )
+            {
+                buffer.push_back( order[position] );
+                drawn_positions.insert(
+                    std::upper_bound( drawn_positions.begin(), drawn_positions.end(), position ), position );
+                shell.n_drawn++;
+                total_mass = update_masses( shells );
+            }
+        }
+    }
+
+private:
+    std::vector<size_t> order{};           // The agents sorted by opinion
+    std::vector<double> sorted_opinions{}; // The opinions of the agents in order
+    std::vector<size_t> ranks{};           // The position of every agent in order
+    Workspace default_workspace{};         // For sample without a workspace
+
+    template<typename WeightT>
+    void build_shells( double x, double homophily, WeightT weight, std::vector<Shell> & shells ) const
+    {
+        const size_t n_agents = order.size();
+        const double ratio    = std::pow( 2.0, 1.0 / std::max( 1.0, std::abs( homophily ) ) );
+        const auto first      = sorted_opinions.begin();
+        const auto last       = sorted_opinions.end();
+
+        // The weight is monotonic in the distance, so the largest weight is at one of the ends of a shell
+        auto push_shell = [&]( size_t begin, size_t end )
+        {
+            if( begin < end )
+                shells.push_back( { begin, end, std::max( weight( begin ), weight( end - 1 ) ), 0, 0 } );
+        };
+
+        // The shells to the left, collected from the outside in, and [x - tolerance, x + tolerance]
+        shells.clear();
+        const size_t begin_center = std::lower_bound( first, last, x - tolerance ) - first;
+        const size_t end_center   = std::upper_bound( first + begin_center, last, x + tolerance ) - first;
+        size_t end                = begin_center;
+        for( double distance = tolerance; end > 0; distance *= ratio )
+        {
+            const size_t begin = std::lower_bound( first, first + end, x - distance * ratio ) - first;
+            push_shell( begin, end );
+            end = begin;
+        }
+        std::reverse( shells.begin(), shells.end() );
+        push_shell( begin_center, end_center );
+
+        // The shells to the right
+        size_t begin = end_center;
+        for( double distance = tolerance; begin < n_agents; distance *= ratio )
+        {
+            const size_t end_right = std::upper_bound( first + begin, last, x + distance * ratio ) - first;
+            push_shell( begin, end_right );
+            begin = end_right;
+        }
+    }
+
+    static size_t shell_of( size_t position, const std::vector<Shell> & shells )
+    {
+        auto it = std::upper_bound(
+            shells.begin(), shells.end(), position, []( size_t p, const Shell & shell ) { return p < shell.begin; } );
+        return it - shells.begin() - 1;
+    }
+
+    static double update_masses( std::vector<Shell> & shells )
+    {
+        double total_mass = 0;
+        for( auto & shell : shells )
+        {
+            shell.mass = double( shell.end - shell.begin - shell.n_drawn ) * shell.max_weight;
+            total_mass += shell.mass;
+        }
+        return total_mass;
+    }
+};
+
+} // namespace Seldon
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include "fmt/core.h"
 #include "util/erfinv.hpp"
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <limits>
 #include <optional>
 #include <queue>
 #include <random>
@@ -110,6 +112,71 @@ void reservoir_sampling_A_ExpJ(
     }
 }
 
+// Memory reused by reservoir_sampling_A_ExpJ_log between calls, so that the sampling does not allocate
+struct ReservoirWorkspace
+{
+    std::vector<std::pair<size_t, double>> heap{}; // Min-heap of the sampled indices and their log keys
+    std::vector<double> weights{};                 // For the caller, to fill in the weights of the candidates
+};
+
+/*
+Same as reservoir_sampling_A_ExpJ, with the weights of all n = weights.size() candidates given as an array.
+The keys r = u^(1/w) are kept as log( r ) = log( u ) / w, which needs no pow, and the heap lives in the workspace.
+The random numbers are drawn at the same points as in reservoir_sampling_A_ExpJ, so that the samples agree with it up
+to rounding in the comparison of the keys.
+*/
+inline void reservoir_sampling_A_ExpJ_log(
+    size_t k, std::span<const double> weights, std::vector<std::size_t> & buffer, std::mt19937 & mt,
+    ReservoirWorkspace & workspace )
+{
+    if( k == 0 )
+        return;
+
+    std::uniform_real_distribution<double> distribution( 0.0, 1.0 );
+
+    using HeapItemT = std::pair<size_t, double>;
+    auto compare    = []( const HeapItemT & item1, const HeapItemT & item2 ) { return item1.second > item2.second; };
+    auto & H        = workspace.heap;
+    H.clear();
+
+    // log( u^(1/w) ), a weight of zero gives the key u^inf = 0
+    auto log_key = []( double u, double w )
+    { return w > 0 ? std::log( u ) / w : -std::numeric_limits<double>::infinity(); };
+
+    const size_t n = weights.size();
+    size_t idx     = 0;
+    while( ( idx < n ) && ( H.size() < k ) )
+    {
+        H.emplace_back( idx, log_key( distribution( mt ), weights[idx] ) );
+        std::push_heap( H.begin(), H.end(), compare );
+        idx++;
+    }
+
+    auto X = std::log( distribution( mt ) ) / H.front().second;
+    while( idx < n )
+    {
+        const double w = weights[idx];
+        X -= w;
+        if( X <= 0 )
+        {
+            const double t                     = w > 0 ? std::exp( w * H.front().second ) : 1.0; // top key^w
+            const double uniform_from_t_to_one = distribution( mt ) * ( 1.0 - t ) + t; // Random number in [t, 1.0]
+            std::pop_heap( H.begin(), H.end(), compare );
+            H.back() = { idx, log_key( uniform_from_t_to_one, w ) };
+            std::push_heap( H.begin(), H.end(), compare );
+            X = std::log( distribution( mt ) ) / H.front().second;
+        }
+        idx++;
+    }
+
+    buffer.resize( H.size() );
+    for( size_t i = 0; i < buffer.size(); i++ )
+    {
+        buffer[i] = H.front().first;
+        std::pop_heap( H.begin(), H.end() - i, compare );
+    }
+}
+
 /**
  * @brief Power law distribution for random numbers.
  * A continuous random distribution on the range [eps, infty)
@@ -0,0 +1,391 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Seldon::Parallel
+{
+
+/*
+Gives the half-open range [begin, end) of the chunk idx_chunk, when n_items are split into n_chunks
+contiguous chunks of (almost) equal size
+*/
+inline std::pair<size_t, size_t> chunk_range( size_t n_items, size_t n_chunks, size_t idx_chunk )
+{
+    const size_t chunk_size = n_items / n_chunks;
+    const size_t remainder  = n_items % n_chunks;
+    const size_t begin      = idx_chunk * chunk_size + std::min( idx_chunk, remainder );
+    const size_t end        = begin + chunk_size + ( idx_chunk < remainder ? 1 : 0 );
+    return { begin, end };
+}
+
+/*
+Runs func( idx_chunk ) for idx_chunk in [0, n_chunks), using one thread per chunk.
+The first chunk is executed on the calling thread. Exceptions thrown by any chunk are re-thrown
+(the first one, in chunk order) after all threads have been joined.
+*/
+template<typename FuncT>
+void run_chunks( size_t n_chunks, FuncT func )
+{
+    if( n_chunks <= 1 )
+    {
+        if( n_chunks == 1 )
+            func( size_t( 0 ) );
+        return;
+    }
+
+    std::vector<std::exception_ptr> exceptions( n_chunks );
+    std::vector<std::thread> threads{};
+    threads.reserve( n_chunks - 1 );
+
+    auto guarded = [&]( size_t idx_chunk )
+    {
+        try
+        {
+            func( idx_chunk );
+        }
+        catch( ... )
+        {
+            exceptions[idx_chunk] = std::current_exception();
+        }
+    };
+
+    for( size_t idx_chunk = 1; idx_chunk < n_chunks; idx_chunk++ )
+    {
+        threads.emplace_back( guarded, idx_chunk );
+    }
+    guarded( 0 );
+
+    for( auto & t : threads )
+    {
+        t.join();
+    }
+
+    for( const auto & e : exceptions )
+    {
+        if( e )
+            std::rethrow_exception( e );
+    }
+}
+
+/*
+Splits [0, n_items) into at most n_threads contiguous chunks and calls func( idx_chunk, begin, end ) for each of them
+in parallel. Returns the number of chunks that were used, which is never larger than n_items.
+*/
+template<typename FuncT>
+size_t parallel_for_chunks( size_t n_items, size_t n_threads, FuncT func )
+{
+    const size_t n_chunks = std::max<size_t>( 1, std::min( n_threads, n_items ) );
+    run_chunks(
+        n_chunks,
+        [&]( size_t idx_chunk )
+        {
+            auto [begin, end] = chunk_range( n_items, n_chunks, idx_chunk );
+            func( idx_chunk, begin, end );
+        } );
+    return n_chunks;
+}
+
+/*
+Splits [0, n_items) into n_chunks contiguous chunks of about equal total cost, where cost( i ) is the cost of item i.
+Writes the n_chunks + 1 boundaries of the chunks to bounds, so that chunk idx_chunk is
+[bounds[idx_chunk], bounds[idx_chunk + 1]).
+*/
+template<typename CostFuncT>
+void balanced_chunk_bounds( size_t n_items, size_t n_chunks, CostFuncT cost, std::vector<size_t> & bounds )
+{
+    bounds.assign( n_chunks + 1, n_items );
+    bounds[0] = 0;
+
+    size_t total_cost = 0;
+    for( size_t i = 0; i < n_items; i++ )
+        total_cost += cost( i );
+
+    // Chunk idx_chunk starts at the first item, at which the cost of all items before reaches idx_chunk / n_chunks
+    size_t idx_chunk   = 1;
+    size_t prefix_cost = 0;
+    for( size_t i = 0; i < n_items && idx_chunk < n_chunks; i++ )
+    {
+        while( idx_chunk < n_chunks && prefix_cost * n_chunks >= total_cost * idx_chunk )
+            bounds[idx_chunk++] = i;
+        prefix_cost += cost( i );
+    }
+}
+
+/*
+A fixed set of threads for loops that are run many times, e.g. in every iteration of a model, where starting new
+threads for every loop would cost more than the loop itself. Like run_chunks, run( func ) calls func( idx_chunk ) for
+idx_chunk in [0, n_threads), the first chunk on the calling thread, and re-throws the first exception.
+*/
+class ThreadPool
+{
+public:
+    explicit ThreadPool( size_t n_threads ) : exceptions( std::max<size_t>( 1, n_threads ) )
+    {
+        for( size_t idx_chunk = 1; idx_chunk < exceptions.size(); idx_chunk++ )
+        {
+            workers.emplace_back( [this, idx_chunk]() { work( idx_chunk ); } );
+        }
+    }
+
+    ThreadPool( const ThreadPool & )             = delete;
+    ThreadPool & operator=( const ThreadPool & ) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stop = true;
+        }
+        start_condition.notify_all();
+        for( auto & t : workers )
+        {
+            t.join();
+        }
+    }
+
+    [[nodiscard]] size_t n_threads() const
+    {
+        return exceptions.size();
+    }
+
+    void run( const std::function<void( size_t )> & func )
+    {
+        if( workers.empty() )
+        {
+            func( 0 );
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            task        = &func;
+            n_remaining = workers.size();
+            generation++;
+        }
+        start_condition.notify_all();
+
+        run_guarded( func, 0 );
+
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            done_condition.wait( lock, [this]() { return n_remaining == 0; } );
+            task = nullptr;
+        }
+
+        for( auto & e : exceptions )
+        {
+            if( e )
+                std::rethrow_exception( std::exchange( e, nullptr ) );
+        }
+    }
+
+private:
+    std::vector<std::thread> workers{};
+    std::vector<std::exception_ptr> exceptions{};
+    std::mutex mutex{};
+    std::condition_variable start_condition{};
+    std::condition_variable done_condition{};
+    const std::function<void( size_t )> * task = nullptr;
+    size_t generation                           = 0; // Counts the calls of run, every worker runs each task once
+    size_t n_remaining                          = 0; // Workers that have not finished the current task
+    bool stop                                   = false;
+
+    void run_guarded( const std::function<void( size_t )> & func, size_t idx_chunk )
+    {
+        try
+        {
+            func( idx_chunk );
+        }
+        catch( ... )
+        {
+            exceptions[idx_chunk] = std::current_exception();
+        }
+    }
+
+    void work( size_t idx_chunk )
+    {
+        size_t last_generation = 0;
+        while( true )
+        {
+            const std::function<void( size_t )> * current_task = nullptr;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                start_condition.wait( lock, [&]() { return stop || generation != last_generation; } );
+                if( stop )
+                    return;
+                last_generation = generation;
+                current_task    = task;
+            }
+
+            run_guarded( *current_task, idx_chunk );
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                n_remaining--;
+            }
+            done_condition.notify_one();
+        }
+    }
+};
+
+/*
+One thread that runs tasks in the background of the calling thread, e.g. to prepare the next iteration of a model while
+the current one is computed, without starting a new thread for every task. start( func ) hands func to the thread and
+wait() blocks until it has finished and re-throws its exception. Only one task runs at a time.
+*/
+class BackgroundWorker
+{
+public:
+    BackgroundWorker() : worker( [this]() { work(); } ) {}
+
+    BackgroundWorker( const BackgroundWorker & )             = delete;
+    BackgroundWorker & operator=( const BackgroundWorker & ) = delete;
+
+    ~BackgroundWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stop = true;
+        }
+        start_condition.notify_one();
+        worker.join();
+    }
+
+    // Waits for the previous task, then starts func
+    void start( std::function<void()> func )
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            task    = std::move( func );
+            running = true;
+        }
+        start_condition.notify_one();
+    }
+
+    void wait()
+    {
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            done_condition.wait( lock, [this]() { return !running; } );
+        }
+        if( exception )
+            std::rethrow_exception( std::exchange( exception, nullptr ) );
+    }
+
+private:
+    std::mutex mutex{};
+    std::condition_variable start_condition{};
+    std::condition_variable done_condition{};
+    std::function<void()> task{};
+    std::exception_ptr exception{};
+    bool running = false; // Set from start until the task has finished
+    bool stop    = false;
+    std::thread worker{}; // Last, so that the thread starts after the other members are initialized
+
+    void work()
+    {
+        while( true )
+        {
+            std::function<void()> current_task{};
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                start_condition.wait( lock, [this]() { return stop || running; } );
+                if( stop )
+                    return;
+                current_task = std::move( task );
+            }
+
+            std::exception_ptr current_exception{};
+            try
+            {
+                current_task();
+            }
+            catch( ... )
+            {
+                current_exception = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                exception = current_exception;
+                running   = false;
+            }
+            done_condition.notify_one();
+        }
+    }
+};
+
+/*
+Stable least-significant-digit radix sort of items by an unsigned 64 bit key, given by key( item ).
+Only as many 8 bit passes as are needed to represent max_key are performed.
+Each pass builds per-chunk histograms in parallel, computes the scatter offsets from them and scatters in parallel,
+so that the result does not depend on n_threads.
+*/
+template<typename T, typename KeyFuncT>
+void radix_sort( std::vector<T> & items, KeyFuncT key, uint64_t max_key, size_t n_threads )
+{
+    constexpr size_t n_bits_digit = 8;
+    constexpr size_t n_buckets    = size_t( 1 ) << n_bits_digit;
+
+    size_t n_passes = 0;
+    while( n_passes < 64 / n_bits_digit && ( max_key >> ( n_passes * n_bits_digit ) ) != 0 )
+        n_passes++;
+
+    const size_t n_items  = items.size();
+    const size_t n_chunks = std::max<size_t>( 1, std::min( n_threads, n_items ) );
+
+    std::vector<T> buffer( n_items );
+    std::vector<std::vector<size_t>> offsets( n_chunks, std::vector<size_t>( n_buckets ) );
+
+    for( size_t pass = 0; pass < n_passes; pass++ )
+    {
+        const size_t shift = pass * n_bits_digit;
+        auto digit         = [&]( const T & item ) { return ( key( item ) >> shift ) & ( n_buckets - 1 ); };
+
+        run_chunks(
+            n_chunks,
+            [&]( size_t idx_chunk )
+            {
+                auto [begin, end] = chunk_range( n_items, n_chunks, idx_chunk );
+                auto & histogram  = offsets[idx_chunk];
+                std::fill( histogram.begin(), histogram.end(), 0 );
+                for( size_t i = begin; i < end; i++ )
+                    histogram[digit( items[i] )]++;
+            } );
+
+        // Exclusive prefix sum, ordered first by digit and then by chunk, which keeps the sort stable
+        size_t running_offset = 0;
+        for( size_t d = 0; d < n_buckets; d++ )
+        {
+            for( size_t idx_chunk = 0; idx_chunk < n_chunks; idx_chunk++ )
+            {
+                const size_t count    = offsets[idx_chunk][d];
+                offsets[idx_chunk][d] = running_offset;
+                running_offset += count;
+            }
+        }
+
+        run_chunks(
+            n_chunks,
+            [&]( size_t idx_chunk )
+            {
+                auto [begin, end] = chunk_range( n_items, n_chunks, idx_chunk );
+                auto & offset     = offsets[idx_chunk];
+                for( size_t i = begin; i < end; i++ )
+                    buffer[offset[digit( items[i] )]++] = items[i];
+            } );
+
+        items.swap( buffer );
+    }
+}
+
+} // namespace Seldon::Parallel
\ No newline at end of file
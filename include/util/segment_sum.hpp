@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace Seldon
+{
+
+/*
+Approximates sum_{p = begin}^{end - 1} weight( p ) * value( p ) for a weight that changes smoothly with the position,
+e.g. a kernel of the opinion distance over the agents sorted by opinion, in about O( log( end - begin ) / tolerance )
+evaluations instead of end - begin.
+
+A range of positions, whose weights at both ends differ by at most twice the relative tolerance and whose weight in the
+middle is within the tolerance of their mean, is summed as the mean weight times range_sum( begin, end ), the sum of the
+values over the range. Other ranges are split in halves, and ranges of at most n_exact positions are summed exactly.
+If the weight is monotonic over every range, every weight is thus approximated to the relative tolerance. Otherwise
+the test of the ends and the middle can miss a change of the weight inside the range, and the tolerance only steers
+the accuracy, without bounding the error.
+*/
+namespace Detail
+{
+// approximate_weighted_sum of a range of more than two positions, whose weights at the ends are known already
+template<typename WeightT, typename ValueT, typename RangeSumT>
+double approximate_weighted_sum(
+    size_t begin, size_t end, double w_first, double w_last, const WeightT & weight, const ValueT & value,
+    const RangeSumT & range_sum, double tolerance, size_t n_exact )
+{
+    if( end - begin <= n_exact )
+    {
+        double sum = 0;
+        for( size_t position = begin; position < end; position++ )
+        {
+            sum += weight( position ) * value( position );
+        }
+        return sum;
+    }
+
+    const size_t middle   = begin + ( end - begin ) / 2;
+    const double w_middle = weight( middle );
+    const double w_mean   = 0.5 * ( w_first + w_last );
+    const double accuracy = tolerance * std::min( std::abs( w_first ), std::abs( w_last ) );
+    if( std::abs( w_first - w_last ) <= 2.0 * accuracy && std::abs( w_middle - w_mean ) <= accuracy )
+    {
+        return w_mean * range_sum( begin, end );
+    }
+
+    return approximate_weighted_sum(
+               begin, middle, w_first, weight( middle - 1 ), weight, value, range_sum, tolerance, n_exact )
+           + approximate_weighted_sum( middle, end, w_middle, w_last, weight, value, range_sum, tolerance, n_exact );
+}
+} // namespace Detail
+
+template<typename WeightT, typename ValueT, typename RangeSumT>
+double approximate_weighted_sum(
+    size_t begin, size_t end, const WeightT & weight, const ValueT & value, const RangeSumT & range_sum,
+    double tolerance, size_t n_exact = 16 )
+{
+    if( end <= begin )
+        return 0.0;
+    return Detail::approximate_weighted_sum(
+        begin, end, weight( begin ), weight( end - 1 ), weight, value, range_sum, tolerance,
+        std::max<size_t>( n_exact, 2 ) );
+}
+
+} // namespace Seldon
\ No newline at end of file
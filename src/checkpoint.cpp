@@ -0,0 +1,136 @@
+#include "checkpoint.hpp"
+#include "trajectory.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+namespace Seldon
+{
+
+namespace Checkpoint
+{
+uint64_t checksum( const char * data, size_t n_bytes )
+{
+    return Trajectory::checksum( data, n_bytes );
+}
+
+std::vector<char> read_file( const std::string & file_path, size_t & position )
+{
+    std::ifstream fs( file_path, std::ios::in | std::ios::binary );
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open checkpoint {}", file_path ) );
+    }
+    std::vector<char> contents( ( std::istreambuf_iterator<char>( fs ) ), std::istreambuf_iterator<char>() );
+
+    constexpr size_t n_header = sizeof( file_magic ) + sizeof( byte_order_mark ) + sizeof( version );
+    if( contents.size() < n_header + sizeof( uint64_t )
+        || !std::equal( std::begin( file_magic ), std::end( file_magic ), contents.begin() ) )
+    {
+        throw std::runtime_error( fmt::format( "{} is not a checkpoint", file_path ) );
+    }
+
+    position = sizeof( file_magic );
+    if( extract_pod<uint32_t>( contents, position ) != byte_order_mark )
+    {
+        throw std::runtime_error(
+            fmt::format( "The checkpoint {} was written on a host of a different byte order", file_path ) );
+    }
+    const auto file_version = extract_pod<uint32_t>( contents, position );
+    if( file_version != version )
+    {
+        throw std::runtime_error(
+            fmt::format( "Unsupported version {} of the checkpoint {}", file_version, file_path ) );
+    }
+
+    size_t position_checksum = contents.size() - sizeof( uint64_t );
+    const auto file_checksum = extract_pod<uint64_t>( contents, position_checksum );
+    if( file_checksum != checksum( contents.data(), contents.size() - sizeof( uint64_t ) ) )
+    {
+        throw std::runtime_error( fmt::format( "The checkpoint {} is corrupted", file_path ) );
+    }
+    contents.resize( contents.size() - sizeof( uint64_t ) );
+
+    return contents;
+}
+} // namespace Checkpoint
+
+CheckpointWriter::~CheckpointWriter()
+{
+    if( writer_thread.joinable() )
+        writer_thread.join();
+}
+
+void CheckpointWriter::write( std::vector<char> & buffer )
+{
+    wait();
+    std::swap( buffer, buffer_in_flight );
+
+    writer_thread = std::thread(
+        [this]()
+        {
+            try
+            {
+                const auto tmp_path = file_path + ".tmp";
+                {
+                    std::ofstream fs( tmp_path, std::ios::out | std::ios::binary | std::ios::trunc );
+                    if( !fs.is_open() )
+                    {
+                        throw std::runtime_error( fmt::format( "Could not open checkpoint {}", tmp_path ) );
+                    }
+                    fs.write( buffer_in_flight.data(), std::streamsize( buffer_in_flight.size() ) );
+                    fs.close();
+                    if( !fs )
+                    {
+                        throw std::runtime_error( fmt::format( "Could not write checkpoint {}", tmp_path ) );
+                    }
+                }
+                std::filesystem::rename( tmp_path, file_path );
+            }
+            catch( ... )
+            {
+                error = std::current_exception();
+            }
+        } );
+}
+
+void CheckpointWriter::wait()
+{
+    if( writer_thread.joinable() )
+        writer_thread.join();
+    if( error )
+        std::rethrow_exception( std::exchange( error, nullptr ) );
+}
+
+namespace
+{
+volatile std::sig_atomic_t pending_request = 0; // Holds a CheckpointRequest
+
+extern "C" void checkpoint_signal_handler( int signal )
+{
+    if( signal == SIGTERM )
+        pending_request = int( CheckpointRequest::CheckpointAndStop );
+    else if( pending_request == int( CheckpointRequest::None ) )
+        pending_request = int( CheckpointRequest::Checkpoint );
+}
+} // namespace
+
+void install_checkpoint_signal_handlers()
+{
+    std::signal( SIGTERM, checkpoint_signal_handler );
+    std::signal( SIGUSR1, checkpoint_signal_handler );
+}
+
+CheckpointRequest take_checkpoint_request()
+{
+    const auto request = CheckpointRequest( int( pending_request ) );
+    if( request != CheckpointRequest::None )
+        pending_request = int( CheckpointRequest::None );
+    return request;
+}
+
+} // namespace Seldon
\ No newline at end of file
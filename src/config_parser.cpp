@@ -36,6 +36,151 @@ Model model_string_to_enum( std::string_view model_string )
     throw std::runtime_error( fmt::format( "Invalid model string {}", model_string ) );
 }
 
+NetworkFileFormat network_file_format_string_to_enum( std::string_view format_string )
+{
+    if( format_string == "adjacency_list" )
+    {
+        return NetworkFileFormat::AdjacencyList;
+    }
+    else if( format_string == "edge_list" )
+    {
+        return NetworkFileFormat::EdgeList;
+    }
+    throw std::runtime_error( fmt::format( "Invalid network file format string {}", format_string ) );
+}
+
+AgentOutputFormat agent_output_format_string_to_enum( std::string_view format_string )
+{
+    if( format_string == "text" )
+    {
+        return AgentOutputFormat::Text;
+    }
+    else if( format_string == "trajectory" )
+    {
+        return AgentOutputFormat::Trajectory;
+    }
+    throw std::runtime_error( fmt::format( "Invalid agent output format string {}", format_string ) );
+}
+
+ContactSampling contact_sampling_string_to_enum( std::string_view sampling_string )
+{
+    if( sampling_string == "reservoir" )
+    {
+        return ContactSampling::Reservoir;
+    }
+    else if( sampling_string == "opinion_index" )
+    {
+        return ContactSampling::OpinionIndex;
+    }
+    throw std::runtime_error( fmt::format( "Invalid contact sampling string {}", sampling_string ) );
+}
+
+ActivationSampling activation_sampling_string_to_enum( std::string_view sampling_string )
+{
+    if( sampling_string == "per_agent" )
+    {
+        return ActivationSampling::PerAgent;
+    }
+    else if( sampling_string == "buckets" )
+    {
+        return ActivationSampling::Buckets;
+    }
+    throw std::runtime_error( fmt::format( "Invalid activation sampling string {}", sampling_string ) );
+}
+
+MeanFieldMode mean_field_mode_string_to_enum( std::string_view mode_string )
+{
+    if( mode_string == "matrix" )
+    {
+        return MeanFieldMode::Matrix;
+    }
+    else if( mode_string == "matrix_free" )
+    {
+        return MeanFieldMode::MatrixFree;
+    }
+    else if( mode_string == "binned" )
+    {
+        return MeanFieldMode::Binned;
+    }
+    else if( mode_string == "incremental" )
+    {
+        return MeanFieldMode::Incremental;
+    }
+    throw std::runtime_error( fmt::format( "Invalid mean field mode string {}", mode_string ) );
+}
+
+std::string mean_field_mode_to_string( MeanFieldMode mode )
+{
+    switch( mode )
+    {
+        case MeanFieldMode::Matrix: return "matrix";
+        case MeanFieldMode::MatrixFree: return "matrix_free";
+        case MeanFieldMode::Binned: return "binned";
+        case MeanFieldMode::Incremental: return "incremental";
+    }
+    return "";
+}
+
+TrajectoryCompression trajectory_compression_string_to_enum( std::string_view compression_string )
+{
+    if( compression_string == "none" )
+    {
+        return TrajectoryCompression::None;
+    }
+    else if( compression_string == "lossless" )
+    {
+        return TrajectoryCompression::Lossless;
+    }
+    else if( compression_string == "lossy" )
+    {
+        return TrajectoryCompression::Lossy;
+    }
+    throw std::runtime_error( fmt::format( "Invalid trajectory compression string {}", compression_string ) );
+}
+
+Observable observable_string_to_enum( std::string_view observable_string )
+{
+    if( observable_string == "mean" )
+    {
+        return Observable::Mean;
+    }
+    else if( observable_string == "variance" )
+    {
+        return Observable::Variance;
+    }
+    else if( observable_string == "mean_abs" )
+    {
+        return Observable::MeanAbs;
+    }
+    else if( observable_string == "polarization" )
+    {
+        return Observable::Polarization;
+    }
+    else if( observable_string == "histogram" )
+    {
+        return Observable::Histogram;
+    }
+    else if( observable_string == "clusters" )
+    {
+        return Observable::Clusters;
+    }
+    throw std::runtime_error( fmt::format( "Invalid observable string {}", observable_string ) );
+}
+
+std::string observable_to_string( Observable observable )
+{
+    switch( observable )
+    {
+        case Observable::Mean: return "mean";
+        case Observable::Variance: return "variance";
+        case Observable::MeanAbs: return "mean_abs";
+        case Observable::Polarization: return "polarization";
+        case Observable::Histogram: return "histogram";
+        case Observable::Clusters: return "clusters";
+    }
+    return "";
+}
+
 void set_if_specified( auto & opt, const auto & toml_opt )
 {
     using T    = typename std::remove_reference<decltype( opt )>::type;
@@ -58,6 +203,27 @@ void parse_activity_settings( auto & model_settings, const auto & toml_model_opt
     // Mean activity model options
     set_if_specified( model_settings.mean_activities, toml_model_opt["mean_activities"] );
     set_if_specified( model_settings.mean_weights, toml_model_opt["mean_weights"] );
+    // Replay of recorded contacts
+    model_settings.contact_events_file = toml_model_opt["contact_events_file"].template value<std::string>();
+    // Sampling of the contacts
+    auto contact_sampling = toml_model_opt["contact_sampling"].template value<std::string>();
+    if( contact_sampling.has_value() )
+        model_settings.contact_sampling = contact_sampling_string_to_enum( contact_sampling.value() );
+    auto activation_sampling = toml_model_opt["activation_sampling"].template value<std::string>();
+    if( activation_sampling.has_value() )
+        model_settings.activation_sampling = activation_sampling_string_to_enum( activation_sampling.value() );
+    set_if_specified( model_settings.per_agent_streams, toml_model_opt["per_agent_streams"] );
+    set_if_specified( model_settings.push_slopes, toml_model_opt["push_slopes"] );
+    auto mean_field_mode = toml_model_opt["mean_field_mode"].template value<std::string>();
+    if( mean_field_mode.has_value() )
+        model_settings.mean_field_mode = mean_field_mode_string_to_enum( mean_field_mode.value() );
+    set_if_specified( model_settings.mean_field_tolerance, toml_model_opt["mean_field_tolerance"] );
+    set_if_specified( model_settings.mean_field_drift_tolerance, toml_model_opt["mean_field_drift_tolerance"] );
+    set_if_specified(
+        model_settings.mean_field_normalization_tolerance, toml_model_opt["mean_field_normalization_tolerance"] );
+    set_if_specified( model_settings.mean_field_refresh_interval, toml_model_opt["mean_field_refresh_interval"] );
+    set_if_specified( model_settings.exact_isolated_decay, toml_model_opt["exact_isolated_decay"] );
+    set_if_specified( model_settings.pipelined_sampling, toml_model_opt["pipelined_sampling"] );
     // Reluctances
     set_if_specified( model_settings.covariance_factor, toml_model_opt["covariance_factor"] );
     set_if_specified( model_settings.use_reluctances, toml_model_opt["reluctances"] );
@@ -114,14 +280,54 @@ SimulationOptions parse_config_file( std::string_view config_file_path )
     tbl = toml::parse_file( config_file_path );
 
     options.rng_seed = tbl["simulation"]["rng_seed"].value_or( int( options.rng_seed ) );
+    set_if_specified( options.n_threads, tbl["simulation"]["n_threads"] );
 
     // Parse output settings
     options.output_settings.n_output_network = tbl["io"]["n_output_network"].value<size_t>();
     options.output_settings.n_output_agents  = tbl["io"]["n_output_agents"].value<size_t>();
     set_if_specified( options.output_settings.print_progress, tbl["io"]["print_progress"] );
     set_if_specified( options.output_settings.output_initial, tbl["io"]["output_initial"] );
+    set_if_specified( options.output_settings.async_output, tbl["io"]["async_output"] );
     set_if_specified( options.output_settings.start_output, tbl["io"]["start_output"] );
     set_if_specified( options.output_settings.start_numbering_from, tbl["io"]["start_numbering_from"] );
+    std::optional<std::string> agent_output_format = tbl["io"]["agent_output_format"].value<std::string>();
+    if( agent_output_format.has_value() )
+        options.output_settings.agent_output_format = agent_output_format_string_to_enum( agent_output_format.value() );
+    std::optional<std::string> compression = tbl["io"]["trajectory_compression"].value<std::string>();
+    if( compression.has_value() )
+        options.output_settings.trajectory_compression = trajectory_compression_string_to_enum( compression.value() );
+    set_if_specified( options.output_settings.trajectory_error_bound, tbl["io"]["trajectory_error_bound"] );
+    set_if_specified( options.output_settings.trajectory_keyframe_interval, tbl["io"]["trajectory_keyframe_interval"] );
+    options.output_settings.output_agents_file   = tbl["io"]["output_agents_file"].value<std::string>();
+    options.output_settings.output_agents_sample = tbl["io"]["output_agents_sample"].value<size_t>();
+    set_if_specified( options.output_settings.output_bots_only, tbl["io"]["output_bots_only"] );
+
+    // Observables
+    options.output_settings.n_output_observables = tbl["io"]["n_output_observables"].value<size_t>();
+    if( tbl["io"]["observables"].is_array() )
+    {
+        options.output_settings.observables.clear();
+        tbl["io"]["observables"].as_array()->for_each(
+            [&]( auto && elem )
+            {
+                if( !elem.is_string() )
+                    throw std::runtime_error( "io.observables has to be an array of strings" );
+                options.output_settings.observables.push_back( observable_string_to_enum( elem.as_string()->get() ) );
+            } );
+    }
+    set_if_specified( options.output_settings.histogram_bins, tbl["io"]["histogram_bins"] );
+    set_if_specified( options.output_settings.histogram_min, tbl["io"]["histogram_min"] );
+    set_if_specified( options.output_settings.histogram_max, tbl["io"]["histogram_max"] );
+    set_if_specified( options.output_settings.cluster_threshold, tbl["io"]["cluster_threshold"] );
+    set_if_specified( options.output_settings.output_contact_events, tbl["io"]["output_contact_events"] );
+    options.output_settings.n_output_checkpoint = tbl["io"]["n_output_checkpoint"].value<size_t>();
+
+    // Shared memory
+    options.output_settings.n_output_shared_memory = tbl["io"]["n_output_shared_memory"].value<size_t>();
+    set_if_specified( options.output_settings.shared_memory_name, tbl["io"]["shared_memory_name"] );
+    set_if_specified( options.output_settings.shared_memory_slots, tbl["io"]["shared_memory_slots"] );
+    set_if_specified( options.output_settings.shared_memory_network, tbl["io"]["shared_memory_network"] );
+    set_if_specified( options.output_settings.shared_memory_max_edges, tbl["io"]["shared_memory_max_edges"] );
 
     // Check if the 'model' keyword exists
     std::optional<std::string> model_string = tbl["simulation"]["model"].value<std::string>();
@@ -170,6 +376,9 @@ SimulationOptions parse_config_file( std::string_view config_file_path )
     options.network_settings = InitialNetworkSettings();
     set_if_specified( options.network_settings.n_agents, tbl["network"]["number_of_agents"] );
     set_if_specified( options.network_settings.n_connections, tbl["network"]["connections_per_agent"] );
+    std::optional<std::string> file_format = tbl["network"]["file_format"].value<std::string>();
+    if( file_format.has_value() )
+        options.network_settings.file_format = network_file_format_string_to_enum( file_format.value() );
 
     return options;
 }
@@ -199,9 +408,48 @@ void validate_settings( const SimulationOptions & options )
     auto g_zero   = []( auto x ) { return x > 0; };
     auto geq_zero = []( auto x ) { return x >= 0; };
 
+    check( name_and_var( options.n_threads ), g_zero );
+
     // @TODO: Check that start_output is less than the max_iterations?
     check( name_and_var( options.output_settings.start_output ), g_zero );
     check( name_and_var( options.output_settings.start_numbering_from ), geq_zero );
+    check( name_and_var( options.output_settings.trajectory_error_bound ), g_zero );
+    check( name_and_var( options.output_settings.trajectory_keyframe_interval ), g_zero );
+    check(
+        name_and_var( options.output_settings.output_agents_sample ),
+        []( auto x ) { return !x.has_value() || x.value() > 0; } );
+    check(
+        name_and_var( options.output_settings.n_output_observables ),
+        []( auto x ) { return !x.has_value() || x.value() > 0; } );
+    check( name_and_var( options.output_settings.histogram_bins ), g_zero );
+    check(
+        name_and_var( options.output_settings.histogram_max ),
+        [&]( auto x ) { return x > options.output_settings.histogram_min; }, "Needs to be larger than histogram_min" );
+    check( name_and_var( options.output_settings.cluster_threshold ), g_zero );
+    check(
+        name_and_var( options.output_settings.n_output_checkpoint ),
+        []( auto x ) { return !x.has_value() || x.value() > 0; } );
+    check(
+        name_and_var( options.output_settings.n_output_shared_memory ),
+        []( auto x ) { return !x.has_value() || x.value() > 0; } );
+    check(
+        name_and_var( options.output_settings.shared_memory_name ),
+        []( auto x ) { return x.size() > 1 && x[0] == '/' && x.find( '/', 1 ) == std::string::npos; },
+        "Needs to be of the form /name" );
+    check( name_and_var( options.output_settings.shared_memory_slots ), []( auto x ) { return x >= 2; } );
+    const int n_agent_subsets = int( options.output_settings.output_agents_file.has_value() )
+                                + int( options.output_settings.output_agents_sample.has_value() )
+                                + int( options.output_settings.output_bots_only );
+    if( n_agent_subsets > 1 )
+    {
+        throw std::runtime_error(
+            "Only one of output_agents_file, output_agents_sample and output_bots_only can be specified" );
+    }
+    if( options.output_settings.output_contact_events && options.model != Model::ActivityDrivenModel
+        && options.model != Model::ActivityDrivenInertial )
+    {
+        throw std::runtime_error( "output_contact_events is only supported by the activity driven models" );
+    }
 
     auto validate_activity = [&]( const auto & model_settings )
     {
@@ -217,6 +465,9 @@ void validate_settings( const SimulationOptions & options )
         check( name_and_var( model_settings.reluctance_sigma ), g_zero );
         check( name_and_var( model_settings.reluctance_eps ), g_zero );
         check( name_and_var( model_settings.covariance_factor ), []( auto x ) { return x >= -1.0 && x <= 1.0; } );
+        check( name_and_var( model_settings.mean_field_tolerance ), g_zero );
+        check( name_and_var( model_settings.mean_field_drift_tolerance ), geq_zero );
+        check( name_and_var( model_settings.mean_field_normalization_tolerance ), geq_zero );
         // Bot options
         size_t n_bots             = model_settings.n_bots;
         auto check_bot_size       = [&]( auto x ) { return x.size() >= n_bots; };
@@ -225,6 +476,14 @@ void validate_settings( const SimulationOptions & options )
         check( name_and_var( model_settings.bot_activity ), check_bot_size, bot_msg );
         check( name_and_var( model_settings.bot_opinion ), check_bot_size, bot_msg );
         check( name_and_var( model_settings.bot_homophily ), check_bot_size, bot_msg );
+        if( options.output_settings.output_contact_events && model_settings.mean_weights )
+        {
+            throw std::runtime_error( "output_contact_events cannot be used with mean_weights" );
+        }
+        if( model_settings.contact_events_file.has_value() && model_settings.mean_weights )
+        {
+            throw std::runtime_error( "contact_events_file cannot be used with mean_weights" );
+        }
     };
 
     if( options.model == Model::ActivityDrivenModel )
@@ -264,6 +523,7 @@ void validate_settings( const SimulationOptions & options )
 void print_settings( const SimulationOptions & options )
 {
     fmt::print( "Random seed: {}\n", options.rng_seed );
+    fmt::print( "Number of threads: {}\n", options.n_threads );
 
     fmt::print( "[Model]\n" );
     fmt::print( "    type {}\n", options.model_string );
@@ -281,6 +541,23 @@ void print_settings( const SimulationOptions & options )
         fmt::print( "    K {} \n", model_settings.K );
         fmt::print( "    mean_activities {} \n", model_settings.mean_activities );
         fmt::print( "    mean_weights {} \n", model_settings.mean_weights );
+        fmt::print( "    contact_events_file {} \n", model_settings.contact_events_file );
+        fmt::print(
+            "    contact_sampling {} \n",
+            model_settings.contact_sampling == ContactSampling::OpinionIndex ? "opinion_index" : "reservoir" );
+        fmt::print(
+            "    activation_sampling {} \n",
+            model_settings.activation_sampling == ActivationSampling::Buckets ? "buckets" : "per_agent" );
+        fmt::print( "    per_agent_streams {} \n", model_settings.per_agent_streams );
+        fmt::print( "    push_slopes {} \n", model_settings.push_slopes );
+        fmt::print( "    mean_field_mode {} \n", mean_field_mode_to_string( model_settings.mean_field_mode ) );
+        fmt::print( "    mean_field_tolerance {} \n", model_settings.mean_field_tolerance );
+        fmt::print( "    mean_field_drift_tolerance {} \n", model_settings.mean_field_drift_tolerance );
+        fmt::print(
+            "    mean_field_normalization_tolerance {} \n", model_settings.mean_field_normalization_tolerance );
+        fmt::print( "    mean_field_refresh_interval {} \n", model_settings.mean_field_refresh_interval );
+        fmt::print( "    exact_isolated_decay {} \n", model_settings.exact_isolated_decay );
+        fmt::print( "    pipelined_sampling {} \n", model_settings.pipelined_sampling );
         fmt::print( "    n_bots           {}\n", model_settings.n_bots );
         if( model_settings.n_bots > 0 )
         {
@@ -333,12 +610,46 @@ void print_settings( const SimulationOptions & options )
     fmt::print( "[Network]\n" );
     fmt::print( "    n_agents {}\n", options.network_settings.n_agents );
     fmt::print( "    n_connections {}\n", options.network_settings.n_connections );
+    fmt::print(
+        "    file_format {}\n",
+        options.network_settings.file_format == NetworkFileFormat::EdgeList ? "edge_list" : "adjacency_list" );
 
     fmt::print( "[Output]\n" );
     fmt::print( "    n_output_agents  {}\n", options.output_settings.n_output_agents );
     fmt::print( "    n_output_network {}\n", options.output_settings.n_output_network );
     fmt::print( "    print_progress {}\n", options.output_settings.print_progress );
     fmt::print( "    output_initial {}\n", options.output_settings.output_initial );
+    fmt::print( "    async_output {}\n", options.output_settings.async_output );
+    fmt::print(
+        "    agent_output_format {}\n",
+        options.output_settings.agent_output_format == AgentOutputFormat::Trajectory ? "trajectory" : "text" );
+    std::string compression_string = "none";
+    if( options.output_settings.trajectory_compression == TrajectoryCompression::Lossless )
+        compression_string = "lossless";
+    else if( options.output_settings.trajectory_compression == TrajectoryCompression::Lossy )
+        compression_string = "lossy";
+    fmt::print( "    trajectory_compression {}\n", compression_string );
+    fmt::print( "    trajectory_error_bound {}\n", options.output_settings.trajectory_error_bound );
+    fmt::print( "    trajectory_keyframe_interval {}\n", options.output_settings.trajectory_keyframe_interval );
+    fmt::print( "    output_agents_file {}\n", options.output_settings.output_agents_file );
+    fmt::print( "    output_agents_sample {}\n", options.output_settings.output_agents_sample );
+    fmt::print( "    output_bots_only {}\n", options.output_settings.output_bots_only );
+    fmt::print( "    n_output_observables {}\n", options.output_settings.n_output_observables );
+    std::vector<std::string> observable_strings{};
+    for( auto observable : options.output_settings.observables )
+        observable_strings.push_back( observable_to_string( observable ) );
+    fmt::print( "    observables {}\n", observable_strings );
+    fmt::print( "    histogram_bins {}\n", options.output_settings.histogram_bins );
+    fmt::print( "    histogram_min {}\n", options.output_settings.histogram_min );
+    fmt::print( "    histogram_max {}\n", options.output_settings.histogram_max );
+    fmt::print( "    cluster_threshold {}\n", options.output_settings.cluster_threshold );
+    fmt::print( "    output_contact_events {}\n", options.output_settings.output_contact_events );
+    fmt::print( "    n_output_checkpoint {}\n", options.output_settings.n_output_checkpoint );
+    fmt::print( "    n_output_shared_memory {}\n", options.output_settings.n_output_shared_memory );
+    fmt::print( "    shared_memory_name {}\n", options.output_settings.shared_memory_name );
+    fmt::print( "    shared_memory_slots {}\n", options.output_settings.shared_memory_slots );
+    fmt::print( "    shared_memory_network {}\n", options.output_settings.shared_memory_network );
+    fmt::print( "    shared_memory_max_edges {}\n", options.output_settings.shared_memory_max_edges );
     fmt::print( "    start_output {}\n", options.output_settings.start_output );
     fmt::print( "    start_numbering_from {}\n", options.output_settings.start_numbering_from );
 }
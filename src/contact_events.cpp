@@ -0,0 +1,142 @@
+#include "contact_events.hpp"
+#include "util/bit_stream.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace Seldon
+{
+
+namespace
+{
+// The header fields are written byte by byte, so that the files do not depend on the byte order of the host
+template<typename T>
+void write_little_endian( std::ofstream & fs, T value )
+{
+    char bytes[sizeof( T )];
+    for( size_t idx_byte = 0; idx_byte < sizeof( T ); idx_byte++ )
+        bytes[idx_byte] = char( ( value >> ( 8 * idx_byte ) ) & 0xff );
+    fs.write( bytes, sizeof( T ) );
+}
+
+template<typename T>
+bool read_little_endian( std::ifstream & fs, T & value )
+{
+    unsigned char bytes[sizeof( T )];
+    fs.read( reinterpret_cast<char *>( bytes ), sizeof( T ) );
+    value = 0;
+    for( size_t idx_byte = 0; idx_byte < sizeof( T ); idx_byte++ )
+        value |= T( bytes[idx_byte] ) << ( 8 * idx_byte );
+    return bool( fs );
+}
+} // namespace
+
+ContactEventWriter::ContactEventWriter( const std::string & file_path, size_t n_agents )
+        : fs( file_path, std::ios::out | std::ios::binary | std::ios::trunc )
+{
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open contact event file {}", file_path ) );
+    }
+    fs.write( ContactEvents::file_magic, sizeof( ContactEvents::file_magic ) );
+    write_little_endian( fs, ContactEvents::version );
+    write_little_endian( fs, uint64_t( n_agents ) );
+}
+
+void ContactEventWriter::write_step( size_t step, std::span<const ContactEvent> events )
+{
+    payload.clear();
+    size_t previous_source = 0;
+    for( const auto & [source, target] : events )
+    {
+        write_varint( payload, zigzag_encode( int64_t( source ) - int64_t( previous_source ) ) );
+        write_varint( payload, target );
+        previous_source = source;
+    }
+
+    write_little_endian( fs, uint64_t( step ) );
+    write_little_endian( fs, uint64_t( events.size() ) );
+    write_little_endian( fs, uint64_t( payload.size() ) );
+    fs.write( payload.data(), std::streamsize( payload.size() ) );
+}
+
+void ContactEventWriter::close()
+{
+    if( fs.is_open() )
+        fs.close();
+}
+
+ContactEventReader::ContactEventReader( const std::string & file_path )
+        : fs( file_path, std::ios::in | std::ios::binary ), file_path( file_path )
+{
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open contact event file {}", file_path ) );
+    }
+
+    char magic[sizeof( ContactEvents::file_magic )];
+    uint32_t file_version = 0;
+    uint64_t n_agents     = 0;
+    fs.read( magic, sizeof( magic ) );
+    if( !fs || !std::equal( std::begin( magic ), std::end( magic ), std::begin( ContactEvents::file_magic ) )
+        || !read_little_endian( fs, file_version ) || !read_little_endian( fs, n_agents ) )
+    {
+        throw std::runtime_error( fmt::format( "{} is not a contact event file", file_path ) );
+    }
+    if( file_version != ContactEvents::version )
+    {
+        throw std::runtime_error(
+            fmt::format( "Unsupported version {} of the contact event file {}", file_version, file_path ) );
+    }
+    n_agents_ = n_agents;
+
+    const auto header_end = fs.tellg();
+    fs.seekg( 0, std::ios::end );
+    file_size = fs.tellg();
+    fs.seekg( header_end );
+}
+
+bool ContactEventReader::read_step( size_t & step, std::vector<ContactEvent> & events )
+{
+    uint64_t file_step = 0;
+    uint64_t n_events  = 0;
+    uint64_t n_bytes   = 0;
+    if( !read_little_endian( fs, file_step ) || !read_little_endian( fs, n_events )
+        || !read_little_endian( fs, n_bytes ) )
+        return false;
+
+    // Validate the header before allocating anything, a truncated payload ends the stream like a truncated header
+    if( n_bytes > uint64_t( file_size - std::streamoff( fs.tellg() ) ) )
+        return false;
+    // Every event takes at least one byte for the source and one for the target
+    if( n_events > n_bytes / 2 )
+    {
+        throw std::runtime_error( fmt::format(
+            "Step {} in {} has {} contact events in only {} bytes", file_step, file_path, n_events, n_bytes ) );
+    }
+
+    payload.resize( n_bytes );
+    fs.read( payload.data(), std::streamsize( n_bytes ) );
+    if( !fs )
+        return false;
+
+    events.resize( n_events );
+    size_t position = 0;
+    int64_t source  = 0;
+    for( auto & event : events )
+    {
+        source += zigzag_decode( read_varint( payload.data(), payload.size(), position ) );
+        const auto target = read_varint( payload.data(), payload.size(), position );
+        if( source < 0 || uint64_t( source ) >= n_agents_ || target >= n_agents_ )
+        {
+            throw std::runtime_error(
+                fmt::format( "Contact event of step {} in {} is out of range", file_step, file_path ) );
+        }
+        event = { size_t( source ), size_t( target ) };
+    }
+    step = file_step;
+    return true;
+}
+
+} // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "trajectory.hpp"
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+#include <argparse/argparse.hpp>
+#include <filesystem>
+#include <string>
+namespace fs = std::filesystem;
+
+// Converts a trajectory file back into the opinions_N.txt files, that the simulation writes with agents_to_file
+int main( int argc, char * argv[] )
+{
+    argparse::ArgumentParser program( "seldon_export_trajectory" );
+
+    program.add_argument( "trajectory_file" ).help( "The trajectory file written by the simulation." );
+    program.add_argument( "-o", "--output" )
+        .help( "Specify the output directory. Defaults to the directory of the trajectory file" );
+    program.add_argument( "-t", "--threads" )
+        .help( "Number of threads used to format the files" )
+        .default_value( size_t( 1 ) )
+        .scan<'u', size_t>();
+
+    try
+    {
+        program.parse_args( argc, argv );
+    }
+    catch( const std::runtime_error & err )
+    {
+        fmt::print( stderr, "{}\n{}", err.what(), fmt::streamed( program ) );
+        return 1;
+    }
+
+    fs::path trajectory_path = program.get<std::string>( "trajectory_file" );
+    fs::path output_dir_path = program.present<std::string>( "-o" ).value_or( trajectory_path.parent_path().string() );
+    size_t n_threads         = program.get<size_t>( "-t" );
+
+    fs::create_directories( output_dir_path );
+    Seldon::trajectory_to_text_files( trajectory_path.string(), output_dir_path, n_threads );
+
+    return 0;
+}
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include "checkpoint.hpp"
 #include "config_parser.hpp"
 #include "models/DeGroot.hpp"
 #include "models/DeffuantModel.hpp"
@@ -22,6 +23,8 @@ int main( int argc, char * argv[] )
     program.add_argument( "-a", "--agents" )
         .help( "Specify initial agent opinions in a file. Overwrites TOML config." );
     program.add_argument( "-n", "--network" ).help( "Specify initial network in a file. Overwrites TOML config." );
+    program.add_argument( "-r", "--restart" )
+        .help( "Continue the simulation from a checkpoint file, written with the same config file." );
 
     try
     {
@@ -37,6 +40,7 @@ int main( int argc, char * argv[] )
     std::optional<std::string> agent_file          = program.present<std::string>( "-a" );
     std::optional<std::string> network_file        = program.present<std::string>( "-n" );
     std::optional<std::string> output_dir_path_cli = program.present<std::string>( "-o" );
+    std::optional<std::string> checkpoint_file     = program.present<std::string>( "-r" );
     fs::path output_dir_path                       = output_dir_path_cli.value_or( fs::path( "./output" ) );
 
     fmt::print( "=================================================================\n" );
@@ -95,6 +99,15 @@ int main( int argc, char * argv[] )
         throw std::runtime_error( "Model has not been created" );
     }
 
+    if( checkpoint_file.has_value() )
+    {
+        fmt::print( "Restarting from checkpoint {}\n", checkpoint_file.value() );
+        simulation->restart( checkpoint_file.value() );
+    }
+
+    // SIGUSR1 writes a checkpoint, SIGTERM writes a checkpoint and stops the simulation
+    Seldon::install_checkpoint_signal_handlers();
+
     simulation->run( output_dir_path );
 
     return 0;
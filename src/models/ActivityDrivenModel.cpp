@@ -1,8 +1,12 @@
 #include "models/ActivityDrivenModel.hpp"
 #include "network.hpp"
 #include "util/math.hpp"
+#include <array>
+#include <cmath>
 #include <cstddef>
 #include <random>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace Seldon
@@ -17,27 +21,102 @@ void ActivityDrivenModelAbstract<ActivityAgent>::iteration()
 
     // Integrate the ODE using 4th order Runge-Kutta
     // k_1 =   hf(x_n,y_n)
-    get_euler_slopes( k1_buffer, [this]( size_t i ) { return network.agents[i].data.opinion; } );
     // k_2  =   hf(x_n+1/2h,y_n+1/2k_1)
-    get_euler_slopes(
-        k2_buffer, [this]( size_t i ) { return network.agents[i].data.opinion + 0.5 * dt * this->k1_buffer[i]; } );
     // k_3  =   hf(x_n+1/2h,y_n+1/2k_2)
-    get_euler_slopes(
-        k3_buffer, [this]( size_t i ) { return network.agents[i].data.opinion + 0.5 * dt * this->k2_buffer[i]; } );
     // k_4  =   hf(x_n+h,y_n+k_3)
-    get_euler_slopes(
-        k4_buffer, [this]( size_t i ) { return network.agents[i].data.opinion + dt * this->k3_buffer[i]; } );
+    // The stages are fused: the pass over the agents that computes k_s also computes the state y_n + c k_s of the next
+    // stage and its activations tanh( alpha * y ), so that tanh is evaluated once per agent and stage
+    constexpr std::array<double, 4> stage_weights    = { 1.0, 2.0, 2.0, 1.0 };
+    constexpr std::array<double, 3> next_stage_steps = { 0.5, 0.5, 1.0 };
 
-    // Update the agent opinions
-    for( size_t idx_agent = 0; idx_agent < network.n_agents(); ++idx_agent )
+    // With exact_isolated_decay, only the coupled agents are integrated with Runge-Kutta. The agents without incoming
+    // edges follow x e^(-t), which also gives the states of the isolated sources in the stages
+    const std::array<double, 3> next_stage_decays
+        = { std::exp( -next_stage_steps[0] * dt ), std::exp( -next_stage_steps[1] * dt ),
+            std::exp( -next_stage_steps[2] * dt ) };
+    const double decay = std::exp( -dt );
+
+    const size_t n_agents = network.n_agents();
+    update_coupling_coefficients();
+    update_coupled_agents();
+    stage_opinion_buffer.resize( n_agents );
+    activation_buffer.resize( n_agents );
+    next_stage_opinion_buffer.resize( n_agents );
+    next_activation_buffer.resize( n_agents );
+    rk4_increment_buffer.assign( n_agents, 0.0 );
+
+    for_agent_chunks(
+        [this]( size_t begin, size_t end )
+        {
+            for( const auto * agents : { &coupled_agents, &isolated_sources } )
+            {
+                for( const auto idx_agent : agents_in_range( *agents, begin, end ) )
+                {
+                    stage_opinion_buffer[idx_agent] = network.agents[idx_agent].data.opinion;
+                    activation_buffer[idx_agent]    = std::tanh( alpha * stage_opinion_buffer[idx_agent] );
+                }
+            }
+        } );
+
+    for( size_t stage = 0; stage < stage_weights.size(); stage++ )
     {
-        // y_(n+1) =   y_n+1/6k_1+1/3k_2+1/3k_3+1/6k_4+O(h^5)
-        network.agents[idx_agent].data.opinion
-            += dt
-               * ( k1_buffer[idx_agent] + 2 * k2_buffer[idx_agent] + 2 * k3_buffer[idx_agent] + k4_buffer[idx_agent] )
-               / 6.0;
+        // Every chunk reads the activations of all agents, but writes only the state of its own agents
+        const bool last_stage     = stage + 1 == stage_weights.size();
+        const bool slopes_at_once = slopes_computed_at_once();
+        if( slopes_at_once )
+            all_slopes_from_activations( stage_opinion_buffer, activation_buffer, slope_buffer );
+        for_agent_chunks(
+            [&]( size_t begin, size_t end )
+            {
+                for( const auto idx_agent : agents_in_range( coupled_agents, begin, end ) )
+                {
+                    const double k
+                        = slopes_at_once
+                              ? slope_buffer[idx_agent]
+                              : slope_from_activations( idx_agent, stage_opinion_buffer[idx_agent], activation_buffer );
+                    rk4_increment_buffer[idx_agent] += stage_weights[stage] * k;
+                    if( !last_stage )
+                    {
+                        const double next_opinion
+                            = network.agents[idx_agent].data.opinion + next_stage_steps[stage] * dt * k;
+                        next_stage_opinion_buffer[idx_agent] = next_opinion;
+                        next_activation_buffer[idx_agent]    = std::tanh( alpha * next_opinion );
+                    }
+                }
+                if( last_stage )
+                    return;
+                for( const auto idx_agent : agents_in_range( isolated_sources, begin, end ) )
+                {
+                    const double next_opinion = network.agents[idx_agent].data.opinion * next_stage_decays[stage];
+                    next_stage_opinion_buffer[idx_agent] = next_opinion;
+                    next_activation_buffer[idx_agent]    = std::tanh( alpha * next_opinion );
+                }
+            } );
+        std::swap( stage_opinion_buffer, next_stage_opinion_buffer );
+        std::swap( activation_buffer, next_activation_buffer );
     }
 
+    // Update the agent opinions
+    for_agent_chunks(
+        [&]( size_t begin, size_t end )
+        {
+            const auto coupled = agents_in_range( coupled_agents, begin, end );
+            auto it_coupled    = coupled.begin();
+            for( size_t idx_agent = begin; idx_agent < end; ++idx_agent )
+            {
+                if( it_coupled != coupled.end() && *it_coupled == idx_agent )
+                {
+                    // y_(n+1) =   y_n+1/6k_1+1/3k_2+1/3k_3+1/6k_4+O(h^5)
+                    network.agents[idx_agent].data.opinion += dt * rk4_increment_buffer[idx_agent] / 6.0;
+                    ++it_coupled;
+                }
+                else
+                {
+                    network.agents[idx_agent].data.opinion *= decay;
+                }
+            }
+        } );
+
     if( bot_present() )
     {
         for( size_t bot_idx = 0; bot_idx < n_bots; bot_idx++ )
@@ -23,15 +23,19 @@ void InertialModel::calc_position()
     // Calculating 'drift' = a(t)-friction
     get_euler_slopes( drift_t_buffer, [this]( size_t i ) { return network.agents[i].data.opinion; } );
 
-    for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
-    {
-        auto & agent_data    = network.agents[idx_agent].data;
-        auto accleration     = drift_t_buffer[idx_agent] - friction_coefficient * agent_data.velocity;
-        double next_position = agent_data.opinion + agent_data.velocity * dt + 0.5 * (accleration)*dt * dt;
+    for_agent_chunks(
+        [this]( size_t begin, size_t end )
+        {
+            for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+            {
+                auto & agent_data    = network.agents[idx_agent].data;
+                auto accleration     = drift_t_buffer[idx_agent] - friction_coefficient * agent_data.velocity;
+                double next_position = agent_data.opinion + agent_data.velocity * dt + 0.5 * (accleration)*dt * dt;
 
-        // Update the position to the new position
-        agent_data.opinion = next_position;
-    }
+                // Update the position to the new position
+                agent_data.opinion = next_position;
+            }
+        } );
 }
 
 // V(t+dt)
@@ -41,18 +45,22 @@ void InertialModel::calc_velocity()
     // Calculating new 'drift'
     get_euler_slopes( drift_next_t_buffer, [this]( size_t i ) { return network.agents[i].data.opinion; } );
 
-    for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
-    {
-        auto & agent_data    = network.agents[idx_agent].data;
-        double next_velocity = agent_data.velocity
-                               + 0.5 * dt
-                                     * ( drift_t_buffer[idx_agent] - friction_coefficient * agent_data.velocity
-                                         + drift_next_t_buffer[idx_agent] );
-        next_velocity /= 1.0 + 0.5 * friction_coefficient * dt;
+    for_agent_chunks(
+        [this]( size_t begin, size_t end )
+        {
+            for( size_t idx_agent = begin; idx_agent < end; idx_agent++ )
+            {
+                auto & agent_data    = network.agents[idx_agent].data;
+                double next_velocity = agent_data.velocity
+                                       + 0.5 * dt
+                                             * ( drift_t_buffer[idx_agent] - friction_coefficient * agent_data.velocity
+                                                 + drift_next_t_buffer[idx_agent] );
+                next_velocity /= 1.0 + 0.5 * friction_coefficient * dt;
 
-        // Update velocity
-        agent_data.velocity = next_velocity;
-    }
+                // Update velocity
+                agent_data.velocity = next_velocity;
+            }
+        } );
 }
 
 void InertialModel::iteration()
@@ -0,0 +1,186 @@
+#include "observables.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace Seldon
+{
+
+namespace
+{
+bool is_requested( const Config::OutputSettings & settings, Config::Observable observable )
+{
+    return std::find( settings.observables.begin(), settings.observables.end(), observable )
+           != settings.observables.end();
+}
+
+// Partial results of one chunk of the opinions
+struct PartialObservables
+{
+    size_t n       = 0;
+    double mean    = 0;
+    double m2      = 0; // Sum of the squared deviations from the mean
+    double sum_abs = 0;
+    size_t n_pos   = 0;
+    double sum_pos = 0;
+    size_t n_neg   = 0;
+    double sum_neg = 0;
+    std::vector<size_t> histogram{};
+
+    // Merges other into this, with the pairwise update of the mean and variance by Chan et al.
+    void merge( const PartialObservables & other )
+    {
+        if( other.n == 0 )
+            return;
+        const double n_total = double( n + other.n );
+        const double delta   = other.mean - mean;
+        mean += delta * double( other.n ) / n_total;
+        m2 += other.m2 + delta * delta * double( n ) * double( other.n ) / n_total;
+        n += other.n;
+        sum_abs += other.sum_abs;
+        n_pos += other.n_pos;
+        sum_pos += other.sum_pos;
+        n_neg += other.n_neg;
+        sum_neg += other.sum_neg;
+        for( size_t i = 0; i < histogram.size(); i++ )
+            histogram[i] += other.histogram[i];
+    }
+};
+} // namespace
+
+ObservableValues compute_observables(
+    const std::vector<double> & opinions, const Config::OutputSettings & settings, size_t n_threads )
+{
+    const bool with_histogram = is_requested( settings, Config::Observable::Histogram );
+    const size_t n_bins       = with_histogram ? settings.histogram_bins : 0;
+    const double bin_width    = ( settings.histogram_max - settings.histogram_min ) / double( settings.histogram_bins );
+
+    std::vector<PartialObservables> partials( std::max<size_t>( 1, n_threads ) );
+    const size_t n_chunks = Parallel::parallel_for_chunks(
+        opinions.size(), n_threads,
+        [&]( size_t idx_chunk, size_t begin, size_t end )
+        {
+            auto & p = partials[idx_chunk];
+            p        = PartialObservables{};
+            p.histogram.assign( n_bins, 0 );
+            for( size_t i = begin; i < end; i++ )
+            {
+                const double x = opinions[i];
+                p.n++;
+                const double delta = x - p.mean;
+                p.mean += delta / double( p.n );
+                p.m2 += delta * ( x - p.mean );
+                p.sum_abs += std::abs( x );
+                if( x > 0 )
+                {
+                    p.n_pos++;
+                    p.sum_pos += x;
+                }
+                else if( x < 0 )
+                {
+                    p.n_neg++;
+                    p.sum_neg += x;
+                }
+                if( with_histogram && !std::isnan( x ) )
+                {
+                    const double position = std::floor( ( x - settings.histogram_min ) / bin_width );
+                    const auto idx_bin    = size_t( std::clamp( position, 0.0, double( n_bins - 1 ) ) );
+                    p.histogram[idx_bin]++;
+                }
+            }
+        } );
+
+    auto total = std::move( partials[0] );
+    for( size_t idx_chunk = 1; idx_chunk < n_chunks; idx_chunk++ )
+        total.merge( partials[idx_chunk] );
+
+    ObservableValues values{};
+    if( total.n > 0 )
+    {
+        const double n        = double( total.n );
+        const double mean_pos = total.n_pos > 0 ? total.sum_pos / double( total.n_pos ) : 0.0;
+        const double mean_neg = total.n_neg > 0 ? total.sum_neg / double( total.n_neg ) : 0.0;
+        const double balance  = 1.0 - std::abs( double( total.n_pos ) - double( total.n_neg ) ) / n;
+
+        values.mean         = total.mean;
+        values.variance     = total.m2 / n;
+        values.mean_abs     = total.sum_abs / n;
+        values.polarization = balance * ( mean_pos - mean_neg ) / 2.0;
+    }
+    values.histogram = std::move( total.histogram );
+
+    if( is_requested( settings, Config::Observable::Clusters ) && !opinions.empty() )
+    {
+        auto sorted = opinions;
+        std::sort( sorted.begin(), sorted.end() );
+        values.n_clusters = 1;
+        for( size_t i = 1; i < sorted.size(); i++ )
+        {
+            if( sorted[i] - sorted[i - 1] > settings.cluster_threshold )
+                values.n_clusters++;
+        }
+    }
+
+    return values;
+}
+
+ObservablesWriter::ObservablesWriter(
+    const std::string & file_path, const Config::OutputSettings & settings, size_t n_threads )
+        : fs( file_path, std::ios::out | std::ios::trunc ), settings( settings ), n_threads( n_threads )
+{
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open observables file {}", file_path ) );
+    }
+
+    std::string header = "# step";
+    for( auto observable : settings.observables )
+    {
+        if( observable == Config::Observable::Histogram )
+        {
+            const double bin_width
+                = ( settings.histogram_max - settings.histogram_min ) / double( settings.histogram_bins );
+            for( size_t idx_bin = 0; idx_bin < settings.histogram_bins; idx_bin++ )
+            {
+                header += fmt::format( ", histogram[{}]", settings.histogram_min + double( idx_bin ) * bin_width );
+            }
+        }
+        else
+        {
+            header += ", " + Config::observable_to_string( observable );
+        }
+    }
+    fs << header << "\n";
+}
+
+void ObservablesWriter::write_row( size_t step )
+{
+    const auto values = compute_observables( opinions, settings, n_threads );
+
+    fmt::memory_buffer buffer;
+    auto append = [&]( auto value ) { fmt::format_to( std::back_inserter( buffer ), ", {}", value ); };
+
+    fmt::format_to( std::back_inserter( buffer ), "{}", step );
+    for( auto observable : settings.observables )
+    {
+        switch( observable )
+        {
+            case Config::Observable::Mean: append( values.mean ); break;
+            case Config::Observable::Variance: append( values.variance ); break;
+            case Config::Observable::MeanAbs: append( values.mean_abs ); break;
+            case Config::Observable::Polarization: append( values.polarization ); break;
+            case Config::Observable::Clusters: append( values.n_clusters ); break;
+            case Config::Observable::Histogram:
+                for( auto count : values.histogram )
+                    append( count );
+                break;
+        }
+    }
+    buffer.push_back( '\n' );
+
+    fs.write( buffer.data(), buffer.size() );
+    fs.flush();
+}
+
+} // namespace Seldon
\ No newline at end of file
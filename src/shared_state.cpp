@@ -0,0 +1,281 @@
+#include "shared_state.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Seldon
+{
+
+namespace
+{
+constexpr size_t align_64( size_t n_bytes )
+{
+    return ( n_bytes + 63 ) / 64 * 64;
+}
+
+std::runtime_error system_error( const std::string & what, const std::string & name )
+{
+    return std::runtime_error( fmt::format( "{} {}: {}", what, name, std::strerror( errno ) ) );
+}
+
+size_t column_bytes( const SharedState::SegmentHeader & header )
+{
+    return header.n_columns * header.n_rows * sizeof( double );
+}
+} // namespace
+
+SharedStatePublisher::SharedStatePublisher(
+    const std::string & name, const std::vector<std::string> & column_names,
+    const std::vector<size_t> & agent_indices, size_t n_slots, size_t n_network_agents, size_t max_edges )
+        : name( name )
+{
+    if( name.empty() || name[0] != '/' )
+    {
+        throw std::runtime_error( fmt::format( "The shared memory name {} has to start with a '/'", name ) );
+    }
+    if( n_slots < 2 )
+    {
+        throw std::runtime_error( "The shared memory ring buffer needs at least two slots" );
+    }
+    for( const auto & column_name : column_names )
+    {
+        if( column_name.size() >= SharedState::name_length )
+            throw std::runtime_error( fmt::format( "Column name {} is too long", column_name ) );
+    }
+
+    const size_t n_rows         = agent_indices.size();
+    const size_t n_columns      = column_names.size();
+    const bool has_network      = n_network_agents > 0;
+    const size_t names_offset   = sizeof( SharedState::SegmentHeader );
+    const size_t indices_offset = names_offset + n_columns * SharedState::name_length;
+    const size_t slots_offset   = align_64( indices_offset + n_rows * sizeof( uint64_t ) );
+    size_t network_bytes        = 0;
+    if( has_network )
+    {
+        network_bytes = ( n_network_agents + 1 ) * sizeof( uint64_t )
+                        + max_edges * ( sizeof( uint64_t ) + sizeof( double ) );
+    }
+    const size_t slot_size
+        = align_64( sizeof( SharedState::SlotHeader ) + n_columns * n_rows * sizeof( double ) + network_bytes );
+    segment_size = slots_offset + n_slots * slot_size;
+
+    const int fd = shm_open( name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644 );
+    if( fd == -1 )
+        throw system_error( "Could not create the shared memory", name );
+    if( ftruncate( fd, off_t( segment_size ) ) == -1 )
+    {
+        close( fd );
+        shm_unlink( name.c_str() );
+        throw system_error( "Could not resize the shared memory", name );
+    }
+    void * memory = mmap( nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( memory == MAP_FAILED )
+    {
+        shm_unlink( name.c_str() );
+        throw system_error( "Could not map the shared memory", name );
+    }
+    segment = static_cast<char *>( memory );
+
+    header                   = new( segment ) SharedState::SegmentHeader{};
+    header->version          = SharedState::version;
+    header->n_slots          = uint32_t( n_slots );
+    header->n_rows           = n_rows;
+    header->n_columns        = uint32_t( n_columns );
+    header->has_network      = has_network ? 1 : 0;
+    header->n_network_agents = n_network_agents;
+    header->max_edges        = max_edges;
+    header->slot_size        = slot_size;
+    header->slots_offset     = slots_offset;
+
+    for( size_t idx_col = 0; idx_col < n_columns; idx_col++ )
+    {
+        std::copy(
+            column_names[idx_col].begin(), column_names[idx_col].end(),
+            segment + names_offset + idx_col * SharedState::name_length );
+    }
+    auto * indices = reinterpret_cast<uint64_t *>( segment + indices_offset );
+    std::copy( agent_indices.begin(), agent_indices.end(), indices );
+
+    for( size_t idx_slot = 0; idx_slot < n_slots; idx_slot++ )
+    {
+        new( slot_at( idx_slot ) ) SharedState::SlotHeader{};
+    }
+
+    // Readers check the magic, so it is written last
+    std::atomic_thread_fence( std::memory_order_release );
+    std::copy( std::begin( SharedState::magic ), std::end( SharedState::magic ), header->magic );
+}
+
+SharedStatePublisher::~SharedStatePublisher()
+{
+    munmap( segment, segment_size );
+    shm_unlink( name.c_str() );
+}
+
+SharedState::SlotHeader * SharedStatePublisher::slot_at( uint64_t idx_slot )
+{
+    return reinterpret_cast<SharedState::SlotHeader *>(
+        segment + header->slots_offset + idx_slot * header->slot_size );
+}
+
+uint64_t * SharedStatePublisher::slot_offsets( SharedState::SlotHeader * slot )
+{
+    return reinterpret_cast<uint64_t *>( reinterpret_cast<char *>( slot + 1 ) + column_bytes( *header ) );
+}
+
+SharedState::SlotHeader * SharedStatePublisher::begin_slot( size_t step, std::span<const double> columns )
+{
+    if( columns.size() != size_t( header->n_columns ) * header->n_rows )
+    {
+        throw std::runtime_error( fmt::format(
+            "Expected {} values to publish, got {}", size_t( header->n_columns ) * header->n_rows, columns.size() ) );
+    }
+
+    const uint64_t n_published = header->n_published.load( std::memory_order_relaxed );
+    auto * slot                = slot_at( n_published % header->n_slots );
+
+    // An odd sequence marks the slot as being written
+    slot->sequence.store( slot->sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    slot->step    = step;
+    slot->n_edges = 0;
+    std::memcpy( static_cast<void *>( slot + 1 ), columns.data(), columns.size_bytes() );
+    return slot;
+}
+
+void SharedStatePublisher::end_slot( SharedState::SlotHeader * slot )
+{
+    slot->sequence.store( slot->sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    header->n_published.fetch_add( 1, std::memory_order_release );
+}
+
+SharedStateReader::SharedStateReader( const std::string & name )
+{
+    const int fd = shm_open( name.c_str(), O_RDONLY, 0 );
+    if( fd == -1 )
+        throw system_error( "Could not open the shared memory", name );
+    struct stat status = {};
+    if( fstat( fd, &status ) == -1 )
+    {
+        close( fd );
+        throw system_error( "Could not get the size of the shared memory", name );
+    }
+    segment_size  = size_t( status.st_size );
+    void * memory = mmap( nullptr, segment_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( memory == MAP_FAILED )
+        throw system_error( "Could not map the shared memory", name );
+    segment = static_cast<const char *>( memory );
+    header  = reinterpret_cast<const SharedState::SegmentHeader *>( segment );
+
+    if( segment_size < sizeof( SharedState::SegmentHeader )
+        || !std::equal( std::begin( SharedState::magic ), std::end( SharedState::magic ), header->magic ) )
+    {
+        munmap( const_cast<char *>( segment ), segment_size );
+        throw std::runtime_error( fmt::format( "{} is not a shared memory segment of a simulation", name ) );
+    }
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if( header->version != SharedState::version
+        || segment_size < header->slots_offset + size_t( header->n_slots ) * header->slot_size )
+    {
+        munmap( const_cast<char *>( segment ), segment_size );
+        throw std::runtime_error( fmt::format( "Unsupported shared memory segment {}", name ) );
+    }
+
+    const char * names = segment + sizeof( SharedState::SegmentHeader );
+    for( size_t idx_col = 0; idx_col < header->n_columns; idx_col++ )
+    {
+        const char * column_name = names + idx_col * SharedState::name_length;
+        column_names_.emplace_back( column_name, strnlen( column_name, SharedState::name_length ) );
+    }
+    const auto * indices = reinterpret_cast<const uint64_t *>( names + header->n_columns * SharedState::name_length );
+    agent_indices_.assign( indices, indices + header->n_rows );
+}
+
+SharedStateReader::~SharedStateReader()
+{
+    munmap( const_cast<char *>( segment ), segment_size );
+}
+
+uint64_t SharedStateReader::n_published() const
+{
+    return header->n_published.load( std::memory_order_acquire );
+}
+
+std::optional<SharedStateView> SharedStateReader::view_latest() const
+{
+    while( true )
+    {
+        const uint64_t n_published = header->n_published.load( std::memory_order_acquire );
+        if( n_published == 0 )
+            return std::nullopt;
+
+        const uint64_t idx_slot = ( n_published - 1 ) % header->n_slots;
+        const auto * slot       = reinterpret_cast<const SharedState::SlotHeader *>(
+            segment + header->slots_offset + idx_slot * header->slot_size );
+        const uint64_t sequence = slot->sequence.load( std::memory_order_acquire );
+        if( sequence % 2 == 1 )
+            continue; // The publisher already wraps around and overwrites this slot
+
+        SharedStateView view{};
+        view.sequence = sequence;
+        view.idx_slot = idx_slot;
+        view.step     = slot->step;
+
+        const auto * columns = reinterpret_cast<const double *>( slot + 1 );
+        view.columns         = std::span<const double>( columns, size_t( header->n_columns ) * header->n_rows );
+
+        const uint64_t n_edges = slot->n_edges;
+        if( header->has_network != 0 && n_edges <= header->max_edges )
+        {
+            const auto * offsets    = reinterpret_cast<const uint64_t *>( columns + view.columns.size() );
+            const auto * neighbours = offsets + header->n_network_agents + 1;
+            const auto * weights    = reinterpret_cast<const double *>( neighbours + header->max_edges );
+            view.has_network        = true;
+            view.offsets            = std::span<const uint64_t>( offsets, header->n_network_agents + 1 );
+            view.neighbours         = std::span<const uint64_t>( neighbours, n_edges );
+            view.weights            = std::span<const double>( weights, n_edges );
+        }
+        return view;
+    }
+}
+
+bool SharedStateReader::validate( const SharedStateView & view ) const
+{
+    const auto * slot = reinterpret_cast<const SharedState::SlotHeader *>(
+        segment + header->slots_offset + view.idx_slot * header->slot_size );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    return slot->sequence.load( std::memory_order_relaxed ) == view.sequence;
+}
+
+bool SharedStateReader::read_latest( SharedStateSnapshot & snapshot ) const
+{
+    while( true )
+    {
+        auto view = view_latest();
+        if( !view.has_value() )
+            return false;
+
+        snapshot.step = view->step;
+        snapshot.columns.assign( view->columns.begin(), view->columns.end() );
+        snapshot.has_network = view->has_network;
+        snapshot.offsets.assign( view->offsets.begin(), view->offsets.end() );
+        snapshot.neighbours.assign( view->neighbours.begin(), view->neighbours.end() );
+        snapshot.weights.assign( view->weights.begin(), view->weights.end() );
+
+        if( validate( view.value() ) )
+            return true;
+    }
+}
+
+} // namespace Seldon
\ No newline at end of file
@@ -0,0 +1,627 @@
+#include "trajectory.hpp"
+#include "util/bit_stream.hpp"
+#include "util/buffered_writer.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+namespace Seldon
+{
+
+namespace Trajectory
+{
+uint64_t checksum( const char * data, size_t n_bytes )
+{
+    constexpr uint64_t prime = 0x100000001b3;
+    uint64_t hash            = 0xcbf29ce484222325;
+
+    size_t i = 0;
+    for( ; i + sizeof( uint64_t ) <= n_bytes; i += sizeof( uint64_t ) )
+    {
+        uint64_t word;
+        std::memcpy( &word, data + i, sizeof( uint64_t ) );
+        hash = ( hash ^ word ) * prime;
+        hash ^= hash >> 32;
+    }
+    for( ; i < n_bytes; i++ )
+    {
+        hash = ( hash ^ uint8_t( data[i] ) ) * prime;
+    }
+    return hash;
+}
+} // namespace Trajectory
+
+namespace
+{
+template<typename T>
+void write_pod( std::ofstream & fs, const T & value )
+{
+    fs.write( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+}
+
+template<typename T>
+bool read_pod( std::ifstream & fs, T & value )
+{
+    fs.read( reinterpret_cast<char *>( &value ), sizeof( T ) );
+    return bool( fs );
+}
+
+template<typename T>
+void append_pod( std::vector<char> & out, const T & value )
+{
+    const char * bytes = reinterpret_cast<const char *>( &value );
+    out.insert( out.end(), bytes, bytes + sizeof( T ) );
+}
+
+template<typename T>
+T extract_pod( const std::vector<char> & in, size_t & position )
+{
+    if( position + sizeof( T ) > in.size() )
+        throw std::runtime_error( "Unexpected end of trajectory frame" );
+    T value;
+    std::memcpy( &value, in.data() + position, sizeof( T ) );
+    position += sizeof( T );
+    return value;
+}
+
+// The reference of value idx: the value in the previous frame, or the previous value in the column for keyframes
+inline uint64_t reference_bits( const double * reference, std::span<const double> values, size_t idx )
+{
+    if( reference != nullptr )
+        return std::bit_cast<uint64_t>( reference[idx] );
+    return idx > 0 ? std::bit_cast<uint64_t>( values[idx - 1] ) : 0;
+}
+
+/*
+Gorilla style XOR encoding. Control bits: '0' if the value equals its reference, '10' if the meaningful bits of the XOR
+fit into the previous window of leading and trailing zeros, and otherwise '11', followed by 6 bits for the number of
+leading zeros and 6 bits for the number of meaningful bits minus one.
+*/
+void encode_xor_column( std::span<const double> values, const double * reference, BitWriter & out )
+{
+    int leading_window  = 64;
+    int trailing_window = 0;
+
+    for( size_t i = 0; i < values.size(); i++ )
+    {
+        const uint64_t x = std::bit_cast<uint64_t>( values[i] ) ^ reference_bits( reference, values, i );
+        if( x == 0 )
+        {
+            out.write( 0, 1 );
+            continue;
+        }
+
+        const int leading  = std::countl_zero( x );
+        const int trailing = std::countr_zero( x );
+        if( leading >= leading_window && trailing >= trailing_window )
+        {
+            out.write( 0b01, 2 ); // Read back as '1', '0'
+            out.write( x >> trailing_window, 64 - leading_window - trailing_window );
+        }
+        else
+        {
+            const int n_meaningful = 64 - leading - trailing;
+            out.write( 0b11, 2 );
+            out.write( leading, 6 );
+            out.write( n_meaningful - 1, 6 );
+            out.write( x >> trailing, n_meaningful );
+            leading_window  = leading;
+            trailing_window = trailing;
+        }
+    }
+    out.finish();
+}
+
+void decode_xor_column( BitReader & in, const double * reference, std::span<double> values )
+{
+    int leading_window  = 64;
+    int trailing_window = 0;
+
+    for( size_t i = 0; i < values.size(); i++ )
+    {
+        uint64_t x = 0;
+        if( in.read( 1 ) == 1 )
+        {
+            if( in.read( 1 ) == 1 )
+            {
+                leading_window         = int( in.read( 6 ) );
+                const int n_meaningful = int( in.read( 6 ) ) + 1;
+                trailing_window        = 64 - leading_window - n_meaningful;
+                if( trailing_window < 0 )
+                    throw std::runtime_error( "Invalid XOR window in trajectory frame" );
+            }
+            else if( leading_window == 64 )
+            {
+                throw std::runtime_error( "Invalid XOR window in trajectory frame" );
+            }
+            x = in.read( 64 - leading_window - trailing_window ) << trailing_window;
+        }
+        values[i] = std::bit_cast<double>( x ^ reference_bits( reference, values, i ) );
+    }
+}
+
+// Values are quantized to multiples of step. Larger values, infinities and NaNs can not be quantized
+inline bool is_quantizable( double value, double step )
+{
+    return std::isfinite( value ) && std::abs( value / step ) < 0x1p52;
+}
+
+inline int64_t quantize( double value, double step )
+{
+    return std::llround( value / step );
+}
+
+/*
+Stores the difference of every quantized value to its quantized reference as a zigzag varint, and writes the values as
+the reader will decode them to decoded
+*/
+void encode_quantized_column(
+    std::span<const double> values, const double * reference, double step, std::vector<char> & out,
+    std::span<double> decoded )
+{
+    int64_t q_previous = 0;
+    for( size_t i = 0; i < values.size(); i++ )
+    {
+        const int64_t q           = quantize( values[i], step );
+        const int64_t q_reference = reference != nullptr ? quantize( reference[i], step ) : q_previous;
+        write_varint( out, zigzag_encode( q - q_reference ) );
+        decoded[i] = double( q ) * step;
+        q_previous = q;
+    }
+}
+
+void decode_quantized_column(
+    const char * data, size_t n_bytes, const double * reference, double step, std::span<double> values )
+{
+    size_t position    = 0;
+    int64_t q_previous = 0;
+    for( size_t i = 0; i < values.size(); i++ )
+    {
+        const int64_t q_reference = reference != nullptr ? quantize( reference[i], step ) : q_previous;
+        const int64_t q           = q_reference + zigzag_decode( read_varint( data, n_bytes, position ) );
+        values[i]                 = double( q ) * step;
+        q_previous                = q;
+    }
+}
+} // namespace
+
+TrajectoryWriter::TrajectoryWriter(
+    const std::string & file_path, const std::vector<std::string> & column_names,
+    const std::vector<size_t> & agent_indices, Config::TrajectoryCompression compression, double error_bound,
+    size_t keyframe_interval )
+        : fs( file_path, std::ios::out | std::ios::binary | std::ios::trunc ),
+          n_columns_( column_names.size() ),
+          n_agents_( agent_indices.size() ),
+          compression( compression ),
+          quantization_step( 2.0 * error_bound ),
+          keyframe_interval( std::max<size_t>( 1, keyframe_interval ) )
+{
+    if( compression == Config::TrajectoryCompression::Lossy )
+    {
+        if( !( error_bound > 0 ) )
+        {
+            throw std::runtime_error( "The error bound for lossy trajectory compression has to be positive" );
+        }
+        auto it_opinion = std::find( column_names.begin(), column_names.end(), "opinion" );
+        if( it_opinion != column_names.end() )
+            idx_quantized_column = std::distance( column_names.begin(), it_opinion );
+    }
+
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open trajectory file {}", file_path ) );
+    }
+
+    fs.write( Trajectory::file_magic, sizeof( Trajectory::file_magic ) );
+    write_pod( fs, Trajectory::version );
+    write_pod( fs, uint32_t( n_columns_ ) );
+    write_pod( fs, uint64_t( n_agents_ ) );
+    for( const auto & name : column_names )
+    {
+        write_pod( fs, uint32_t( name.size() ) );
+        fs.write( name.data(), name.size() );
+    }
+    for( auto idx_agent : agent_indices )
+    {
+        write_pod( fs, uint64_t( idx_agent ) );
+    }
+    fs.flush();
+
+    offset = uint64_t( fs.tellp() );
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    try
+    {
+        close();
+    }
+    catch( ... )
+    {
+    }
+}
+
+void TrajectoryWriter::write_frame( size_t step, std::span<const double> columns )
+{
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( "Trajectory file has already been closed" );
+    }
+    if( columns.size() != n_columns_ * n_agents_ )
+    {
+        throw std::runtime_error( fmt::format(
+            "Trajectory frame has {} values, but {} were expected", columns.size(), n_columns_ * n_agents_ ) );
+    }
+
+    Trajectory::FrameHeader header{};
+    header.step = step;
+
+    const char * frame_payload = reinterpret_cast<const char *>( columns.data() );
+    header.payload_size        = columns.size_bytes();
+    if( compression != Config::TrajectoryCompression::None )
+    {
+        const bool keyframe = index.size() % keyframe_interval == 0;
+        encode_frame( columns, keyframe );
+        header.encoding     = keyframe ? Trajectory::encoding_keyframe : Trajectory::encoding_delta;
+        frame_payload       = payload.data();
+        header.payload_size = payload.size();
+    }
+    header.checksum = Trajectory::checksum( frame_payload, header.payload_size );
+
+    write_pod( fs, header );
+    fs.write( frame_payload, header.payload_size );
+    fs.flush(); // So that the frame survives if the simulation is interrupted
+
+    if( !fs )
+    {
+        throw std::runtime_error( "Could not write trajectory frame" );
+    }
+
+    index.push_back( { header.step, offset } );
+    offset += sizeof( Trajectory::FrameHeader ) + header.payload_size;
+}
+
+void TrajectoryWriter::encode_frame( std::span<const double> columns, bool keyframe )
+{
+    reference.resize( columns.size() );
+    payload.clear();
+
+    for( size_t idx_col = 0; idx_col < n_columns_; idx_col++ )
+    {
+        auto values                  = columns.subspan( idx_col * n_agents_, n_agents_ );
+        auto decoded                 = std::span<double>( reference ).subspan( idx_col * n_agents_, n_agents_ );
+        const double * reference_col = keyframe ? nullptr : decoded.data();
+
+        // Columns with values that can not be quantized fall back to the lossless encoding
+        auto quantizable           = [&]( double v ) { return is_quantizable( v, quantization_step ); };
+        const bool quantize_column = idx_quantized_column == idx_col
+                                     && std::all_of( values.begin(), values.end(), quantizable )
+                                     && ( keyframe || std::all_of( decoded.begin(), decoded.end(), quantizable ) );
+
+        append_pod( payload, quantize_column ? Trajectory::column_quantized : Trajectory::column_xor );
+        if( quantize_column )
+            append_pod( payload, quantization_step );
+
+        // The size of the encoded column is filled in after encoding it
+        const size_t position_size = payload.size();
+        append_pod( payload, uint64_t( 0 ) );
+
+        if( quantize_column )
+        {
+            encode_quantized_column( values, reference_col, quantization_step, payload, decoded );
+        }
+        else
+        {
+            BitWriter out( payload );
+            encode_xor_column( values, reference_col, out );
+            std::copy( values.begin(), values.end(), decoded.begin() );
+        }
+
+        const uint64_t n_bytes = payload.size() - position_size - sizeof( uint64_t );
+        std::memcpy( payload.data() + position_size, &n_bytes, sizeof( uint64_t ) );
+    }
+}
+
+void TrajectoryWriter::close()
+{
+    if( !fs.is_open() )
+        return;
+
+    Trajectory::Footer footer{};
+    footer.n_frames     = index.size();
+    footer.index_offset = offset;
+    footer.checksum     = Trajectory::checksum(
+        reinterpret_cast<const char *>( index.data() ), index.size() * sizeof( Trajectory::IndexEntry ) );
+    std::memcpy( footer.magic, Trajectory::index_magic, sizeof( footer.magic ) );
+
+    fs.write( reinterpret_cast<const char *>( index.data() ), index.size() * sizeof( Trajectory::IndexEntry ) );
+    write_pod( fs, footer );
+    fs.close();
+}
+
+TrajectoryReader::TrajectoryReader( const std::string & file_path )
+        : fs( file_path, std::ios::in | std::ios::binary ), file_path( file_path )
+{
+    if( !fs.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Could not open trajectory file {}", file_path ) );
+    }
+
+    fs.seekg( 0, std::ios::end );
+    const uint64_t file_size = fs.tellg();
+    fs.seekg( 0, std::ios::beg );
+
+    char magic[8];
+    uint32_t version   = 0;
+    uint32_t n_columns = 0;
+    uint64_t n_agents  = 0;
+    fs.read( magic, sizeof( magic ) );
+    if( !fs || std::memcmp( magic, Trajectory::file_magic, sizeof( magic ) ) != 0 )
+    {
+        throw std::runtime_error( fmt::format( "{} is not a trajectory file", file_path ) );
+    }
+    if( !read_pod( fs, version ) || version != Trajectory::version )
+    {
+        throw std::runtime_error( fmt::format( "Unsupported version {} of trajectory file {}", version, file_path ) );
+    }
+    if( !read_pod( fs, n_columns ) || !read_pod( fs, n_agents ) || n_agents > file_size / sizeof( uint64_t ) )
+    {
+        throw std::runtime_error( fmt::format( "Damaged header in trajectory file {}", file_path ) );
+    }
+
+    column_names_.resize( n_columns );
+    for( auto & name : column_names_ )
+    {
+        uint32_t length = 0;
+        if( !read_pod( fs, length ) || length > Trajectory::max_name_length )
+        {
+            throw std::runtime_error( fmt::format( "Damaged header in trajectory file {}", file_path ) );
+        }
+        name.resize( length );
+        fs.read( name.data(), length );
+    }
+
+    std::vector<uint64_t> indices( n_agents );
+    fs.read( reinterpret_cast<char *>( indices.data() ), n_agents * sizeof( uint64_t ) );
+    if( !fs )
+    {
+        throw std::runtime_error( fmt::format( "Damaged header in trajectory file {}", file_path ) );
+    }
+    agent_indices_.assign( indices.begin(), indices.end() );
+
+    const uint64_t data_begin = fs.tellg();
+    footer_found              = read_footer( data_begin, file_size );
+    if( !footer_found )
+    {
+        scan_frames( data_begin, file_size );
+    }
+}
+
+bool TrajectoryReader::read_footer( uint64_t data_begin, uint64_t file_size )
+{
+    if( file_size < data_begin + sizeof( Trajectory::Footer ) )
+        return false;
+
+    Trajectory::Footer footer{};
+    fs.seekg( file_size - sizeof( Trajectory::Footer ) );
+    if( !read_pod( fs, footer )
+        || std::memcmp( footer.magic, Trajectory::index_magic, sizeof( footer.magic ) ) != 0 )
+    {
+        fs.clear();
+        return false;
+    }
+
+    const uint64_t index_size = file_size - sizeof( Trajectory::Footer ) - footer.index_offset;
+    if( footer.index_offset < data_begin || footer.index_offset > file_size - sizeof( Trajectory::Footer )
+        || index_size != footer.n_frames * sizeof( Trajectory::IndexEntry ) )
+    {
+        return false;
+    }
+
+    index.resize( footer.n_frames );
+    fs.seekg( footer.index_offset );
+    fs.read( reinterpret_cast<char *>( index.data() ), index_size );
+    if( !fs || Trajectory::checksum( reinterpret_cast<const char *>( index.data() ), index_size ) != footer.checksum )
+    {
+        fs.clear();
+        index.clear();
+        return false;
+    }
+    return true;
+}
+
+void TrajectoryReader::scan_frames( uint64_t data_begin, uint64_t file_size )
+{
+    const uint64_t payload_size = agent_indices_.size() * column_names_.size() * sizeof( double );
+
+    uint64_t offset = data_begin;
+    while( offset + sizeof( Trajectory::FrameHeader ) <= file_size )
+    {
+        Trajectory::FrameHeader header{};
+        fs.seekg( offset );
+        if( !read_pod( fs, header ) || header.magic != Trajectory::frame_magic )
+            break;
+
+        // Only the raw encoding has a fixed payload size
+        if( header.encoding == Trajectory::encoding_raw && header.payload_size != payload_size )
+            break;
+        if( header.payload_size > file_size - offset - sizeof( Trajectory::FrameHeader ) )
+            break; // Truncated frame
+
+        payload.resize( header.payload_size );
+        fs.read( payload.data(), header.payload_size );
+        if( !fs || Trajectory::checksum( payload.data(), payload.size() ) != header.checksum )
+            break; // Torn write
+
+        index.push_back( { header.step, offset } );
+        offset += sizeof( Trajectory::FrameHeader ) + header.payload_size;
+    }
+    fs.clear();
+}
+
+Trajectory::FrameHeader TrajectoryReader::read_frame_header( size_t idx_frame )
+{
+    Trajectory::FrameHeader header{};
+    fs.seekg( index[idx_frame].offset );
+    if( !read_pod( fs, header ) || header.magic != Trajectory::frame_magic )
+    {
+        fs.clear();
+        throw std::runtime_error( fmt::format( "Damaged frame {} in trajectory file {}", idx_frame, file_path ) );
+    }
+    return header;
+}
+
+void TrajectoryReader::decode_frame( size_t idx_frame )
+{
+    const auto header     = read_frame_header( idx_frame );
+    const size_t n_agents = agent_indices_.size();
+    const size_t n_values = n_agents * column_names_.size();
+
+    payload.resize( header.payload_size );
+    fs.read( payload.data(), header.payload_size );
+    if( !fs || Trajectory::checksum( payload.data(), payload.size() ) != header.checksum )
+    {
+        fs.clear();
+        throw std::runtime_error( fmt::format( "Damaged frame {} in trajectory file {}", idx_frame, file_path ) );
+    }
+
+    if( header.encoding == Trajectory::encoding_raw )
+    {
+        if( header.payload_size != n_values * sizeof( double ) )
+        {
+            throw std::runtime_error( fmt::format( "Damaged frame {} in trajectory file {}", idx_frame, file_path ) );
+        }
+        idx_decoded.reset();
+        decoded.resize( n_values );
+        std::memcpy( decoded.data(), payload.data(), payload.size() );
+    }
+    else if( header.encoding == Trajectory::encoding_keyframe || header.encoding == Trajectory::encoding_delta )
+    {
+        if( header.encoding == Trajectory::encoding_delta && !( idx_frame > 0 && idx_decoded == idx_frame - 1 ) )
+        {
+            throw std::runtime_error( fmt::format( "Frame {} decoded without its previous frame", idx_frame ) );
+        }
+        idx_decoded.reset(); // decoded is only valid again after the whole frame has been decoded
+        const bool keyframe = header.encoding == Trajectory::encoding_keyframe;
+        decoded.resize( n_values );
+
+        size_t position = 0;
+        for( size_t idx_col = 0; idx_col < column_names_.size(); idx_col++ )
+        {
+            auto values                  = std::span<double>( decoded ).subspan( idx_col * n_agents, n_agents );
+            const double * reference_col = keyframe ? nullptr : values.data();
+
+            const auto method = extract_pod<uint8_t>( payload, position );
+            double step       = 0;
+            if( method == Trajectory::column_quantized )
+                step = extract_pod<double>( payload, position );
+            const auto n_bytes = extract_pod<uint64_t>( payload, position );
+            if( n_bytes > payload.size() - position )
+                throw std::runtime_error( "Unexpected end of trajectory frame" );
+
+            if( method == Trajectory::column_quantized )
+            {
+                decode_quantized_column( payload.data() + position, n_bytes, reference_col, step, values );
+            }
+            else if( method == Trajectory::column_xor )
+            {
+                BitReader in( payload.data() + position, n_bytes );
+                decode_xor_column( in, reference_col, values );
+            }
+            else
+            {
+                throw std::runtime_error( fmt::format( "Unknown column encoding {} in frame {}", method, idx_frame ) );
+            }
+            position += n_bytes;
+        }
+    }
+    else
+    {
+        throw std::runtime_error( fmt::format(
+            "Unknown encoding {} of frame {} in trajectory file {}", header.encoding, idx_frame, file_path ) );
+    }
+
+    idx_decoded = idx_frame;
+}
+
+void TrajectoryReader::read_frame( size_t idx_frame, std::vector<double> & columns )
+{
+    if( idx_frame >= index.size() )
+    {
+        throw std::runtime_error(
+            fmt::format( "Frame {} requested, but trajectory file has {} frames", idx_frame, index.size() ) );
+    }
+
+    if( idx_decoded != idx_frame )
+    {
+        // Go back to the last keyframe, or to the frame after the last decoded frame, and decode from there
+        size_t idx_first = idx_frame;
+        while( !( idx_decoded.has_value() && idx_first == idx_decoded.value() + 1 )
+               && read_frame_header( idx_first ).encoding == Trajectory::encoding_delta )
+        {
+            if( idx_first == 0 )
+            {
+                throw std::runtime_error(
+                    fmt::format( "Trajectory file {} does not start with a keyframe", file_path ) );
+            }
+            idx_first--;
+        }
+
+        for( size_t i = idx_first; i <= idx_frame; i++ )
+        {
+            decode_frame( i );
+        }
+    }
+
+    columns = decoded;
+}
+
+void trajectory_to_text_files(
+    const std::string & trajectory_path, const std::filesystem::path & output_dir, size_t n_threads )
+{
+    TrajectoryReader reader( trajectory_path );
+
+    std::string header = "# idx_agent";
+    for( const auto & col : reader.column_names() )
+    {
+        header += ", " + col;
+    }
+    header += "\n";
+
+    const auto & agent_indices = reader.agent_indices();
+    const size_t n_rows        = agent_indices.size();
+    const size_t n_columns     = reader.column_names().size();
+    std::vector<double> columns{};
+
+    // Rows are formatted exactly like agents_to_file formats them: "{:>5}, {:>25}\n", where the agent is the
+    // comma separated list of its columns
+    auto format_row = [&]( fmt::memory_buffer & buffer, size_t idx_row )
+    {
+        thread_local fmt::memory_buffer agent_buffer;
+        agent_buffer.clear();
+        for( size_t idx_col = 0; idx_col < n_columns; idx_col++ )
+        {
+            if( idx_col > 0 )
+                agent_buffer.append( std::string_view( ", " ) );
+            fmt::format_to( std::back_inserter( agent_buffer ), "{}", columns[idx_col * n_rows + idx_row] );
+        }
+
+        fmt::format_to( std::back_inserter( buffer ), "{:>5}, ", agent_indices[idx_row] );
+        append_right_aligned( buffer, std::string_view( agent_buffer.data(), agent_buffer.size() ), 25 );
+        buffer.push_back( '\n' );
+    };
+
+    for( size_t idx_frame = 0; idx_frame < reader.n_frames(); idx_frame++ )
+    {
+        reader.read_frame( idx_frame, columns );
+        auto file_path = output_dir / fmt::format( "opinions_{}.txt", reader.step( idx_frame ) );
+        write_rows_to_file( file_path.string(), header, n_rows, format_row, n_threads );
+    }
+}
+
+} // namespace Seldon
\ No newline at end of file
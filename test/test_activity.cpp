@@ -3,6 +3,7 @@
 #include "util/math.hpp"
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <config_parser.hpp>
 #include <filesystem>
 #include <network_io.hpp>
@@ -225,4 +226,610 @@ TEST_CASE( "Test the meanfield activity driven model with 10 agents", "[activity
     // Set the critical controversialness to a little above the critical alpha
     model_settings.alpha = alpha_critical - delta_alpha;
     set_opinions_and_run( false );
+}
+
+TEST_CASE( "Test the meanfield weights against the sum over the contact rounds", "[activityMeanfieldWeights]" )
+{
+    using namespace Seldon;
+    using namespace Catch::Matchers;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/10_agents_meanfield_activity.toml" );
+
+    auto options = Config::parse_config_file( input_file.string() );
+
+    // dt = 0 keeps the opinions, from which the weights were computed
+    auto & model_settings         = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+    model_settings.max_iterations = 1;
+    model_settings.dt             = 0.0;
+    model_settings.homophily      = 0.5;
+    model_settings.reciprocity    = 0.4;
+    model_settings.n_bots         = 2;
+    model_settings.bot_m          = { 3, 4 };
+    model_settings.bot_homophily  = { 0.3, 1.0 };
+    model_settings.bot_activity   = { 0.5, 0.8 };
+    model_settings.bot_opinion    = { 1.5, -2.0 };
+
+    auto simulation          = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_meanfield_weights" );
+    simulation.run( output_dir_path );
+    fs::remove_all( output_dir_path );
+
+    const auto & network  = simulation.network;
+    const size_t n_agents = network.n_agents();
+
+    auto homophily_weight = [&]( size_t i, size_t j )
+    {
+        if( i == j )
+            return 0.0;
+        const double homophily
+            = i < model_settings.n_bots ? model_settings.bot_homophily[i] : model_settings.homophily;
+        const double opinion_diff = std::abs( network.agents[i].data.opinion - network.agents[j].data.opinion );
+        return std::pow( std::max( 1e-10, opinion_diff ), -homophily );
+    };
+
+    // The probability of i contacting j in m rounds
+    std::vector<std::vector<double>> contact_prob( n_agents, std::vector<double>( n_agents ) );
+    for( size_t i = 0; i < n_agents; i++ )
+    {
+        double normalization = 0;
+        for( size_t k = 0; k < n_agents; k++ )
+            normalization += homophily_weight( i, k );
+        const int m = i < model_settings.n_bots ? model_settings.bot_m[i] : model_settings.m;
+        for( size_t j = 0; j < n_agents; j++ )
+        {
+            const double omega = homophily_weight( i, j ) / normalization;
+            double p           = 0;
+            for( int round = 1; round <= m; round++ )
+                p += ( std::pow( -omega, round + 1 ) + omega ) / ( omega + 1 );
+            contact_prob[i][j] = std::max( 1.0, network.agents[i].data.activity ) * p;
+        }
+    }
+
+    for( size_t i = 0; i < n_agents; i++ )
+    {
+        const auto weights = network.get_weights( i );
+        for( size_t j = 0; j < n_agents; j++ )
+        {
+            const double expected
+                = contact_prob[j][i] + ( 1.0 - contact_prob[j][i] ) * model_settings.reciprocity * contact_prob[i][j];
+            REQUIRE_THAT( weights[j], WithinRel( expected, 1e-12 ) );
+        }
+    }
+}
+
+TEST_CASE( "Test that the matrix free meanfield mode gives the same opinions", "[activityMeanfieldMatrixFree]" )
+{
+    using namespace Seldon;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_meanfield_matrix_free" );
+
+    auto check_matrix_free = [&]( auto agent_tag, auto settings_tag, const std::string & config_file, size_t n_threads )
+    {
+        using AgentT    = decltype( agent_tag );
+        using SettingsT = decltype( settings_tag );
+
+        auto options = Config::parse_config_file( ( proj_root_path / fs::path( config_file ) ).string() );
+        options.output_settings.n_output_agents  = std::nullopt;
+        options.output_settings.n_output_network = std::nullopt;
+        options.output_settings.output_initial   = false;
+        options.network_settings.n_agents        = 40;
+        options.n_threads                        = n_threads;
+        auto & model_settings                    = std::get<SettingsT>( options.model_settings );
+        model_settings.max_iterations            = 20;
+        model_settings.mean_weights              = true;
+        model_settings.homophily                 = 0.5;
+
+        auto simulation_matrix         = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        model_settings.mean_field_mode = Config::MeanFieldMode::MatrixFree;
+        auto simulation_matrix_free    = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_matrix.run( output_dir_path );
+        simulation_matrix_free.run( output_dir_path );
+
+        REQUIRE( simulation_matrix_free.network.n_edges() == 0 );
+        for( size_t idx_agent = 0; idx_agent < simulation_matrix.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_matrix_free.network.agents[idx_agent] )
+                == agent_to_string( simulation_matrix.network.agents[idx_agent] ) );
+        }
+    };
+
+    for( size_t n_threads : { 1, 3 } )
+    {
+        check_matrix_free(
+            ActivityAgent{}, Config::ActivityDrivenSettings{}, "test/res/10_agents_meanfield_activity.toml",
+            n_threads );
+        check_matrix_free(
+            InertialAgent{}, Config::ActivityDrivenInertialSettings{}, "test/res/1bot_1agent_inertial.toml",
+            n_threads );
+    }
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test the binned meanfield mode against the exact weights", "[activityMeanfieldBinned]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_meanfield_binned" );
+
+    auto options = Config::parse_config_file(
+        ( proj_root_path / fs::path( "test/res/10_agents_meanfield_activity.toml" ) ).string() );
+    options.rng_seed                       = 120; // The same initial conditions for every run
+    options.output_settings.output_initial = false;
+    options.network_settings.n_agents      = 2000;
+    auto & model_settings                  = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+    model_settings.max_iterations          = 1;
+    model_settings.homophily               = 0.5;
+    model_settings.n_bots                  = 2;
+    model_settings.bot_m                   = { 3, 4 };
+    model_settings.bot_homophily           = { 0.3, 1.0 };
+    model_settings.bot_activity            = { 0.5, 0.8 };
+    model_settings.bot_opinion             = { 0.5, -0.4 };
+    model_settings.mean_field_mode         = Config::MeanFieldMode::MatrixFree;
+
+    // The opinions with the exact weights
+    auto simulation_exact = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_exact.run( output_dir_path );
+
+    auto max_opinion_diff = [&]( double tolerance )
+    {
+        model_settings.mean_field_mode      = Config::MeanFieldMode::Binned;
+        model_settings.mean_field_tolerance = tolerance;
+        auto simulation_binned              = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_binned.run( output_dir_path );
+        REQUIRE( simulation_binned.network.n_edges() == 0 );
+
+        double max_diff = 0;
+        for( size_t idx_agent = 0; idx_agent < simulation_exact.network.n_agents(); idx_agent++ )
+        {
+            max_diff = std::max(
+                max_diff,
+                std::abs(
+                    simulation_binned.network.agents[idx_agent].data.opinion
+                    - simulation_exact.network.agents[idx_agent].data.opinion ) );
+        }
+        fmt::print( "Binned meanfield with tolerance {}: largest opinion difference {}\n", tolerance, max_diff );
+        return max_diff;
+    };
+
+    // The error shrinks with the tolerance, and vanishes for a tolerance at the rounding error
+    const double diff_coarse = max_opinion_diff( 1e-2 );
+    const double diff_fine   = max_opinion_diff( 1e-4 );
+    const double diff_exact  = max_opinion_diff( 1e-15 );
+    REQUIRE( diff_coarse < 5e-3 );
+    REQUIRE( diff_fine < 1e-4 );
+    REQUIRE( diff_fine <= diff_coarse );
+    REQUIRE( diff_exact < 1e-12 );
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test the incremental meanfield mode against the full update", "[activityMeanfieldIncremental]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_meanfield_incremental" );
+
+    auto options = Config::parse_config_file(
+        ( proj_root_path / fs::path( "test/res/10_agents_meanfield_activity.toml" ) ).string() );
+    options.rng_seed                       = 120; // The same initial conditions for every run
+    options.output_settings.output_initial = false;
+    options.network_settings.n_agents      = 300;
+    auto & model_settings                  = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+    model_settings.max_iterations          = 3; // Close opinions amplify small differences of the weights
+    model_settings.homophily               = 0.5;
+    model_settings.n_bots                  = 2;
+    model_settings.bot_m                   = { 3, 4 };
+    model_settings.bot_homophily           = { 0.3, 1.0 };
+    model_settings.bot_activity            = { 0.5, 0.8 };
+    model_settings.bot_opinion             = { 0.5, -0.4 };
+    model_settings.mean_field_mode         = Config::MeanFieldMode::Matrix;
+
+    auto simulation_full = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_full.run( output_dir_path );
+
+    auto max_opinion_diff = [&]( double drift_tolerance, size_t refresh_interval )
+    {
+        model_settings.mean_field_mode                    = Config::MeanFieldMode::Incremental;
+        model_settings.mean_field_drift_tolerance         = drift_tolerance;
+        model_settings.mean_field_normalization_tolerance = drift_tolerance;
+        model_settings.mean_field_refresh_interval        = refresh_interval;
+        auto simulation_incremental                       = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_incremental.run( output_dir_path );
+
+        double max_diff = 0;
+        for( size_t idx_agent = 0; idx_agent < simulation_full.network.n_agents(); idx_agent++ )
+        {
+            max_diff = std::max(
+                max_diff,
+                std::abs(
+                    simulation_incremental.network.agents[idx_agent].data.opinion
+                    - simulation_full.network.agents[idx_agent].data.opinion ) );
+        }
+        fmt::print(
+            "Incremental meanfield with drift tolerance {} and refresh interval {}: largest opinion difference {}\n",
+            drift_tolerance, refresh_interval, max_diff );
+        return max_diff;
+    };
+
+    // Refreshing in every step is the full update
+    REQUIRE( max_opinion_diff( 1e-3, 1 ) == 0.0 );
+    // Without a drift tolerance, only the rounding of the updated normalisations differs
+    REQUIRE( max_opinion_diff( 0.0, 0 ) < 1e-10 );
+    // A drift tolerance gives an error of about the tolerance in the slopes, with or without refreshes
+    const double diff_drift   = max_opinion_diff( 1e-3, 0 );
+    const double diff_refresh = max_opinion_diff( 1e-3, 2 );
+    REQUIRE( diff_drift < 1e-3 );
+    REQUIRE( diff_refresh < 1e-3 );
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test replaying recorded contacts in the activity driven model", "[activityReplay]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path      = fs::current_path();
+    auto input_file          = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_replay" );
+    fs::remove_all( output_dir_path );
+    fs::create_directories( output_dir_path );
+
+    // Without homophily the contacts do not depend on the opinions
+    auto options                                  = Config::parse_config_file( input_file.string() );
+    auto & model_settings                         = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+    model_settings.homophily                      = 0.0;
+    options.output_settings.n_output_agents       = std::nullopt;
+    options.output_settings.n_output_network      = std::nullopt;
+    options.output_settings.output_contact_events = true;
+    auto simulation_recorded                      = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_recorded.run( output_dir_path );
+
+    // The replay of the contacts gives exactly the same opinions, even with another seed, which would sample other
+    // contacts. The initial agents are read from the recorded run.
+    auto agent_file                               = ( output_dir_path / "opinions_0.txt" ).string();
+    options.rng_seed                              = options.rng_seed + 1;
+    options.output_settings.output_initial        = false;
+    options.output_settings.output_contact_events = false;
+    model_settings.contact_events_file            = ( output_dir_path / "contacts.bin" ).string();
+    auto simulation_replayed                      = Simulation<AgentT>( options, std::nullopt, agent_file );
+    simulation_replayed.run( output_dir_path );
+
+    for( size_t idx_agent = 0; idx_agent < simulation_recorded.network.n_agents(); idx_agent++ )
+    {
+        REQUIRE(
+            simulation_replayed.network.agents[idx_agent].data.opinion
+            == simulation_recorded.network.agents[idx_agent].data.opinion );
+    }
+
+    // The simulation cannot run for more iterations than were recorded
+    model_settings.max_iterations.value()++;
+    auto simulation_longer = Simulation<AgentT>( options, std::nullopt, agent_file );
+    REQUIRE_THROWS( simulation_longer.run( output_dir_path ) );
+
+    // Nor replay a file with a missing step
+    model_settings.max_iterations      = 2;
+    model_settings.contact_events_file = ( output_dir_path / "contacts_gap.bin" ).string();
+    {
+        ContactEventWriter writer( model_settings.contact_events_file.value(), simulation_recorded.network.n_agents() );
+        writer.write_step( 1, {} );
+        writer.write_step( 3, {} );
+    }
+    auto simulation_gap = Simulation<AgentT>( options, std::nullopt, agent_file );
+    REQUIRE_THROWS( simulation_gap.run( output_dir_path ) );
+
+    fs::remove_all( output_dir_path );
+}
+
+
+TEST_CASE( "Test that the activity driven models give the same results for any number of threads", "[activityThreads]" )
+{
+    using namespace Seldon;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_threads" );
+
+    auto check_threads = [&]( auto agent_tag, const std::string & config_file )
+    {
+        using AgentT = decltype( agent_tag );
+
+        auto options = Config::parse_config_file( ( proj_root_path / fs::path( config_file ) ).string() );
+        options.output_settings.n_output_agents  = std::nullopt;
+        options.output_settings.n_output_network = std::nullopt;
+        options.output_settings.output_initial   = false;
+
+        options.n_threads        = 1;
+        auto simulation_serial   = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        options.n_threads        = 3;
+        auto simulation_parallel = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_serial.run( output_dir_path );
+        simulation_parallel.run( output_dir_path );
+
+        for( size_t idx_agent = 0; idx_agent < simulation_serial.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_parallel.network.agents[idx_agent] )
+                == agent_to_string( simulation_serial.network.agents[idx_agent] ) );
+        }
+    };
+
+    check_threads( ActivityAgent{}, "test/res/activity_probabilistic_conf.toml" );
+    check_threads( ActivityAgent{}, "test/res/10_agents_meanfield_activity.toml" );
+    check_threads( InertialAgent{}, "test/res/1bot_1agent_inertial.toml" );
+
+    // With per agent streams the network is sampled in parallel, and has to be the same as well
+    for( auto contact_sampling : { Config::ContactSampling::Reservoir, Config::ContactSampling::OpinionIndex } )
+    {
+        auto options = Config::parse_config_file(
+            ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+        options.output_settings.n_output_agents  = std::nullopt;
+        options.output_settings.n_output_network = std::nullopt;
+        options.output_settings.output_initial   = false;
+        auto & model_settings            = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+        model_settings.per_agent_streams = true;
+        model_settings.contact_sampling  = contact_sampling;
+
+        options.n_threads        = 1;
+        auto simulation_serial   = Simulation<ActivityAgent>( options, std::nullopt, std::nullopt );
+        options.n_threads        = 3;
+        auto simulation_parallel = Simulation<ActivityAgent>( options, std::nullopt, std::nullopt );
+        simulation_serial.run( output_dir_path );
+        simulation_parallel.run( output_dir_path );
+
+        for( size_t idx_agent = 0; idx_agent < simulation_serial.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_parallel.network.agents[idx_agent] )
+                == agent_to_string( simulation_serial.network.agents[idx_agent] ) );
+            auto neighbours_serial   = simulation_serial.network.get_neighbours( idx_agent );
+            auto neighbours_parallel = simulation_parallel.network.get_neighbours( idx_agent );
+            REQUIRE( std::equal(
+                neighbours_serial.begin(), neighbours_serial.end(), neighbours_parallel.begin(),
+                neighbours_parallel.end() ) );
+        }
+    }
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test that pushing the slopes along the outgoing edges gives the same opinions", "[activityPushSlopes]" )
+{
+    using namespace Seldon;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_push_slopes" );
+    fs::create_directories( output_dir_path );
+
+    auto check_push_slopes = [&]( auto agent_tag, auto settings_tag, const std::string & config_file, size_t n_threads )
+    {
+        using AgentT    = decltype( agent_tag );
+        using SettingsT = decltype( settings_tag );
+
+        auto options = Config::parse_config_file( ( proj_root_path / fs::path( config_file ) ).string() );
+        options.output_settings.n_output_agents  = std::nullopt;
+        options.output_settings.n_output_network = std::nullopt;
+        options.output_settings.output_initial   = false;
+        options.network_settings.n_agents        = 100;
+        options.n_threads                        = n_threads;
+
+        auto simulation_pull = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        std::get<SettingsT>( options.model_settings ).push_slopes = true;
+        auto simulation_push = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_pull.run( output_dir_path );
+        simulation_push.run( output_dir_path );
+
+        REQUIRE( simulation_push.network.direction() == Network<AgentT>::EdgeDirection::Outgoing );
+        for( size_t idx_agent = 0; idx_agent < simulation_pull.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_push.network.agents[idx_agent] )
+                == agent_to_string( simulation_pull.network.agents[idx_agent] ) );
+        }
+
+        // The network files hold the incoming neighbours either way
+        auto network_file = ( output_dir_path / "network_push.txt" ).string();
+        network_to_file( simulation_push.network, network_file );
+        auto network_push = NetworkGeneration::generate_from_file<AgentT>( network_file );
+        for( size_t idx_agent = 0; idx_agent < simulation_pull.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE_THAT(
+                network_push.get_neighbours( idx_agent ),
+                Catch::Matchers::RangeEquals( simulation_pull.network.get_neighbours( idx_agent ) ) );
+        }
+    };
+
+    for( size_t n_threads : { 1, 3, 8 } )
+    {
+        check_push_slopes(
+            ActivityAgent{}, Config::ActivityDrivenSettings{}, "test/res/activity_probabilistic_conf.toml", n_threads );
+        check_push_slopes(
+            InertialAgent{}, Config::ActivityDrivenInertialSettings{}, "test/res/1bot_1agent_inertial.toml",
+            n_threads );
+    }
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test the exact decay of the agents without incoming edges", "[activityExactDecay]" )
+{
+    using namespace Seldon;
+    using namespace Catch::Matchers;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_exact_decay" );
+
+    auto options = Config::parse_config_file(
+        ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+    options.output_settings.n_output_agents  = std::nullopt;
+    options.output_settings.n_output_network = std::nullopt;
+    options.output_settings.output_initial   = false;
+    auto & model_settings                    = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+    model_settings.max_iterations            = 1;
+
+    auto simulation_rk4 = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_rk4.run( output_dir_path );
+
+    std::optional<std::vector<AgentT>> agents_single_thread{};
+    for( size_t n_threads : { 1, 3 } )
+    {
+        options.n_threads                   = n_threads;
+        model_settings.exact_isolated_decay = true;
+        auto simulation_exact               = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        const auto initial_agents           = simulation_exact.network.agents;
+        simulation_exact.run( output_dir_path );
+
+        // The agents without incoming edges decay exactly, and all agents stay within the error of the integration
+        size_t n_isolated = 0;
+        for( size_t idx_agent = 0; idx_agent < simulation_exact.network.n_agents(); idx_agent++ )
+        {
+            const double opinion = simulation_exact.network.agents[idx_agent].data.opinion;
+            if( simulation_exact.network.get_neighbours( idx_agent ).empty() )
+            {
+                REQUIRE( opinion == initial_agents[idx_agent].data.opinion * std::exp( -model_settings.dt ) );
+                n_isolated++;
+            }
+            REQUIRE_THAT( opinion, WithinAbs( simulation_rk4.network.agents[idx_agent].data.opinion, 1e-6 ) );
+        }
+        REQUIRE( n_isolated > 0 );
+
+        // The same opinions for any number of threads
+        if( !agents_single_thread.has_value() )
+            agents_single_thread = simulation_exact.network.agents;
+        for( size_t idx_agent = 0; idx_agent < simulation_exact.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_exact.network.agents[idx_agent] )
+                == agent_to_string( agents_single_thread.value()[idx_agent] ) );
+        }
+    }
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test that pipelined sampling gives the same networks and opinions", "[activityPipelinedSampling]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_pipelined_sampling" );
+
+    auto check_pipelined = [&]( double homophily, bool per_agent_streams, size_t n_threads )
+    {
+        auto options = Config::parse_config_file(
+            ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+        options.output_settings.n_output_agents  = std::nullopt;
+        options.output_settings.n_output_network = std::nullopt;
+        options.output_settings.output_initial   = false;
+        options.n_threads                        = n_threads;
+        auto & model_settings                    = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+        model_settings.homophily                 = homophily;
+        model_settings.per_agent_streams         = per_agent_streams;
+
+        auto simulation_serial = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        model_settings.pipelined_sampling = true;
+        auto simulation_pipelined         = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_serial.run( output_dir_path );
+        simulation_pipelined.run( output_dir_path );
+
+        // With homophily = 0, the networks of all steps but the first are sampled ahead
+        auto * model_pipelined   = dynamic_cast<ActivityDrivenModel *>( simulation_pipelined.model.get() );
+        const size_t n_pipelined = model_pipelined->n_pipelined_networks_taken();
+        if( homophily == 0.0 )
+            REQUIRE( n_pipelined == simulation_pipelined.model->n_iterations() - 1 );
+        else
+            REQUIRE( n_pipelined == 0 );
+        REQUIRE( simulation_pipelined.model->n_iterations() > 1 );
+
+        for( size_t idx_agent = 0; idx_agent < simulation_serial.network.n_agents(); idx_agent++ )
+        {
+            const auto neighbours_serial    = simulation_serial.network.get_neighbours( idx_agent );
+            const auto neighbours_pipelined = simulation_pipelined.network.get_neighbours( idx_agent );
+            REQUIRE( std::equal(
+                neighbours_serial.begin(), neighbours_serial.end(), neighbours_pipelined.begin(),
+                neighbours_pipelined.end() ) );
+            REQUIRE(
+                agent_to_string( simulation_pipelined.network.agents[idx_agent] )
+                == agent_to_string( simulation_serial.network.agents[idx_agent] ) );
+        }
+    };
+
+    for( size_t n_threads : { 1, 3 } )
+    {
+        for( bool per_agent_streams : { false, true } )
+        {
+            check_pipelined( 0.0, per_agent_streams, n_threads );
+        }
+    }
+    // With homophily, the network is sampled in its step as before
+    check_pipelined( 0.5, false, 1 );
+
+    fs::remove_all( output_dir_path );
+}
+
+TEST_CASE( "Test that the activation buckets activate agents with their activities", "[activityActivationBuckets]" )
+{
+    using namespace Seldon;
+    using namespace Catch::Matchers;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+
+    for( bool per_agent_streams : { false, true } )
+    {
+        auto options = Config::parse_config_file(
+            ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+        options.network_settings.n_agents  = 50;
+        auto & model_settings              = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+        model_settings.activation_sampling = Config::ActivationSampling::Buckets;
+        model_settings.per_agent_streams   = per_agent_streams;
+        // Without reciprocity, the outgoing edges are exactly the contacts of the activated agents
+        model_settings.reciprocity   = 0.0;
+        model_settings.push_slopes   = true;
+        model_settings.n_bots        = 1;
+        model_settings.bot_m         = { 5 };
+        model_settings.bot_activity  = { 1.0 };
+        model_settings.bot_opinion   = { 0.5 };
+        model_settings.bot_homophily = { 0.5 };
+
+        auto simulation = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        auto & network  = simulation.network;
+
+        const size_t N_RUNS = 4000;
+        std::vector<size_t> n_activations( network.n_agents(), 0 );
+        for( size_t run = 0; run < N_RUNS; run++ )
+        {
+            simulation.model->iteration();
+            REQUIRE( network.direction() == Network<AgentT>::EdgeDirection::Outgoing );
+            for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+            {
+                const size_t n_contacts = network.get_neighbours( idx_agent ).size();
+                if( n_contacts == 0 )
+                    continue;
+                REQUIRE( n_contacts == size_t( idx_agent == 0 ? 5 : model_settings.m ) );
+                n_activations[idx_agent]++;
+            }
+        }
+
+        // The bot has activity 1, every agent is activated with the probability of its activity
+        REQUIRE( n_activations[0] == N_RUNS );
+        for( size_t idx_agent = 1; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            const double activity = std::min( 1.0, network.agents[idx_agent].data.activity );
+            const double mean     = N_RUNS * activity;
+            const double sigma    = std::sqrt( N_RUNS * activity * ( 1.0 - activity ) );
+            INFO( fmt::format( "agent {}: {} activations, {} expected", idx_agent, n_activations[idx_agent], mean ) );
+            REQUIRE_THAT( double( n_activations[idx_agent] ), WithinAbs( mean, 5 * sigma + 1 ) );
+        }
+    }
 }
\ No newline at end of file
@@ -7,10 +7,29 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
 
+#include <agent_io.hpp>
+#include <algorithm>
+#include <checkpoint.hpp>
+#include <cmath>
 #include <config_parser.hpp>
+#include <csignal>
+#include <contact_events.hpp>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <network_io.hpp>
+#include <numeric>
+#include <random>
+#include <shared_state.hpp>
 #include <simulation.hpp>
+#include <thread>
+#include <trajectory.hpp>
+#include <unistd.h>
+#include <util/bit_stream.hpp>
 namespace fs = std::filesystem;
 
 TEST_CASE( "Test reading in the network from a file", "[io_network]" )
@@ -38,6 +57,91 @@ TEST_CASE( "Test reading in the network from a file", "[io_network]" )
     }
 }
 
+TEST_CASE( "Test reading in the network from an edge list file", "[io_network_edge_list]" )
+{
+    using namespace Seldon;
+    using namespace Catch::Matchers;
+    using AgentT  = ActivityDrivenModel::AgentT;
+    using Network = Network<AgentT>;
+
+    auto proj_root_path = fs::current_path();
+    auto network_file   = proj_root_path / fs::path( "test/res/edge_list.txt" );
+
+    auto network = Seldon::NetworkGeneration::generate_from_edge_list_file<AgentT>( network_file );
+
+    REQUIRE( network.n_agents() == 4 );
+    REQUIRE( network.direction() == Network::EdgeDirection::Incoming );
+
+    // Incoming neighbours are sorted and the duplicate edge 1 -> 2 has been merged
+    std::vector<std::vector<size_t>> neighbours_expected        = { { 1, 2 }, {}, { 1, 3 }, {} };
+    std::vector<std::vector<Network::WeightT>> weights_expected = { { -0.2, 0.1 }, {}, { 1.2, 1.0 }, {} };
+
+    for( size_t i = 0; i < network.n_agents(); i++ )
+    {
+        REQUIRE_THAT( neighbours_expected[i], Catch::Matchers::RangeEquals( network.get_neighbours( i ) ) );
+        REQUIRE_THAT( weights_expected[i], Catch::Matchers::RangeEquals( network.get_weights( i ) ) );
+    }
+
+    SECTION( "Malformed lines are rejected with their line number" )
+    {
+        fs::path output_dir_path = proj_root_path / fs::path( "test/output_io" );
+        fs::create_directories( output_dir_path );
+        auto edge_list_file = ( output_dir_path / fs::path( "edge_list_malformed.txt" ) ).string();
+
+        for( const std::string line : { "0 1 0.5 junk", "0, 1, 0.5, 2", "0 x", "0 1 y" } )
+        {
+            std::ofstream( edge_list_file ) << "# idx_source, idx_target, weight\n1 0 0.5\n" << line << "\n";
+            REQUIRE_THROWS_WITH(
+                NetworkGeneration::generate_from_edge_list_file<AgentT>( edge_list_file ),
+                ContainsSubstring( "in line 3 of" ) );
+        }
+    }
+
+    SECTION( "The result does not depend on the number of threads" )
+    {
+        // Write a random network as an edge list, with every edge written twice
+        std::mt19937 gen( 0 );
+        auto network_random = NetworkGeneration::generate_n_connections<AgentT>( 500, 10, true, gen );
+
+        fs::path output_dir_path = proj_root_path / fs::path( "test/output_io" );
+        fs::create_directories( output_dir_path );
+        auto edge_list_file = ( output_dir_path / fs::path( "edge_list.txt" ) ).string();
+
+        std::string contents = "# idx_source, idx_target, weight\n";
+        for( size_t i = 0; i < network_random.n_agents(); i++ )
+        {
+            auto neighbours = network_random.get_neighbours( i );
+            auto weights    = network_random.get_weights( i );
+            for( size_t j = 0; j < neighbours.size(); j++ )
+            {
+                contents += fmt::format( "{}, {}, {}\n", neighbours[j], i, 0.5 * weights[j] );
+                contents += fmt::format( "{} {} {}\n", neighbours[j], i, 0.5 * weights[j] );
+            }
+        }
+        std::ofstream( edge_list_file ) << contents;
+
+        auto network_serial   = NetworkGeneration::generate_from_edge_list_file<AgentT>( edge_list_file, 1 );
+        auto network_parallel = NetworkGeneration::generate_from_edge_list_file<AgentT>( edge_list_file, 7 );
+
+        network_random.remove_double_counting();
+        REQUIRE( network_serial.n_agents() == network_random.n_agents() );
+        REQUIRE( network_parallel.n_agents() == network_random.n_agents() );
+
+        for( size_t i = 0; i < network_random.n_agents(); i++ )
+        {
+            REQUIRE_THAT( network_random.get_neighbours( i ), RangeEquals( network_serial.get_neighbours( i ) ) );
+            REQUIRE_THAT( network_serial.get_neighbours( i ), RangeEquals( network_parallel.get_neighbours( i ) ) );
+            REQUIRE_THAT( network_serial.get_weights( i ), RangeEquals( network_parallel.get_weights( i ) ) );
+            auto weights_expected = network_random.get_weights( i );
+            auto weights_read     = network_serial.get_weights( i );
+            for( size_t j = 0; j < weights_expected.size(); j++ )
+            {
+                REQUIRE_THAT( weights_read[j], WithinAbs( weights_expected[j], 1e-14 ) );
+            }
+        }
+    }
+}
+
 TEST_CASE( "Test reading in the agents from a file", "[io_agents]" )
 {
     using namespace Seldon;
@@ -61,4 +165,790 @@ TEST_CASE( "Test reading in the agents from a file", "[io_agents]" )
         REQUIRE_THAT( agents[i].data.activity, Catch::Matchers::WithinAbs( activities_expected[i], 1e-16 ) );
         REQUIRE_THAT( agents[i].data.reluctance, Catch::Matchers::WithinAbs( reluctances_expected[i], 1e-16 ) );
     }
+}
+
+TEST_CASE( "Test that the buffered writers produce the reference output", "[io_writers]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    // Reference implementations of the row formats
+    auto network_reference = []( const Network<AgentT> & network )
+    {
+        std::string res = "# idx_agent, n_neighbours_in, indices_neighbours_in[...], weights_in[...]\n";
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            auto neighbours = network.get_neighbours( idx_agent );
+            auto weights    = network.get_weights( idx_agent );
+            res += fmt::format( "{:>5}, {:>5}", idx_agent, neighbours.size() );
+            res += neighbours.empty() ? "\n" : ", ";
+            for( const auto & n : neighbours )
+                res += fmt::format( "{:>5}, ", n );
+            for( size_t i = 0; i < weights.size(); i++ )
+            {
+                if( i < weights.size() - 1 )
+                    res += fmt::format( "{:>25}, ", weights[i] );
+                else if( idx_agent < network.n_agents() - 1 )
+                    res += fmt::format( "{:>25}\n", weights[i] );
+                else
+                    res += fmt::format( "{:>25}", weights[i] );
+            }
+        }
+        return res;
+    };
+
+    auto agents_reference = []( const Network<AgentT> & network )
+    {
+        std::string res = "# idx_agent, opinion, activity, reluctance\n";
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            const auto & data = network.agents[idx_agent].data;
+            res += fmt::format(
+                "{:>5}, {:>25}\n", idx_agent,
+                fmt::format( "{}, {}, {}", data.opinion, data.activity, data.reluctance ) );
+        }
+        return res;
+    };
+
+    std::mt19937 gen( 0 );
+    std::uniform_real_distribution<double> dist( -1.0, 1.0 );
+    auto network = NetworkGeneration::generate_n_connections<AgentT>( 1000, 5, true, gen );
+    network.set_neighbours_and_weights( 3, {}, {} );
+    for( auto & agent : network.agents )
+    {
+        agent.data.opinion  = dist( gen );
+        agent.data.activity = 1e-3 * dist( gen );
+    }
+
+    auto proj_root_path      = fs::current_path();
+    fs::path output_dir_path = proj_root_path / fs::path( "test/output_io" );
+    fs::create_directories( output_dir_path );
+    auto network_file = ( output_dir_path / fs::path( "network_buffered.txt" ) ).string();
+    auto agents_file  = ( output_dir_path / fs::path( "opinions_buffered.txt" ) ).string();
+
+    for( size_t n_threads : { 1, 3 } )
+    {
+        network_to_file( network, network_file, n_threads );
+        agents_to_file( network, agents_file, n_threads );
+        REQUIRE( get_file_contents( network_file ) == network_reference( network ) );
+        REQUIRE( get_file_contents( agents_file ) == agents_reference( network ) );
+    }
+
+    // Check the special case of an empty last row
+    network.set_neighbours_and_weights( network.n_agents() - 1, {}, {} );
+    network_to_file( network, network_file, 2 );
+    REQUIRE( get_file_contents( network_file ) == network_reference( network ) );
+}
+
+TEST_CASE( "Test that asynchronous output gives the same files as synchronous output", "[io_async]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+
+    auto options                             = Config::parse_config_file( input_file.string() );
+    options.output_settings.n_output_agents  = 1;
+    options.output_settings.n_output_network = 3;
+
+    fs::path output_dir_sync  = proj_root_path / fs::path( "test/output_io/sync" );
+    fs::path output_dir_async = proj_root_path / fs::path( "test/output_io/async" );
+    fs::remove_all( output_dir_sync );
+    fs::remove_all( output_dir_async );
+    fs::create_directories( output_dir_sync );
+    fs::create_directories( output_dir_async );
+
+    options.output_settings.async_output = false;
+    auto simulation_sync                 = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_sync.run( output_dir_sync );
+
+    options.output_settings.async_output = true;
+    auto simulation_async                = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_async.run( output_dir_async );
+
+    size_t n_files = 0;
+    for( const auto & entry : fs::directory_iterator( output_dir_sync ) )
+    {
+        auto file_async = output_dir_async / entry.path().filename();
+        REQUIRE( fs::exists( file_async ) );
+        REQUIRE( get_file_contents( entry.path().string() ) == get_file_contents( file_async.string() ) );
+        n_files++;
+    }
+    REQUIRE( n_files > 0 );
+    REQUIRE(
+        n_files == size_t( std::distance( fs::directory_iterator( output_dir_async ), fs::directory_iterator{} ) ) );
+}
+
+TEST_CASE( "Test the trajectory output format and the export to text files", "[io_trajectory]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+
+    auto options                            = Config::parse_config_file( input_file.string() );
+    options.output_settings.n_output_agents = 2;
+
+    fs::path output_dir_text       = proj_root_path / fs::path( "test/output_io/text" );
+    fs::path output_dir_trajectory = proj_root_path / fs::path( "test/output_io/trajectory" );
+    fs::path output_dir_exported   = proj_root_path / fs::path( "test/output_io/exported" );
+    for( const auto & dir : { output_dir_text, output_dir_trajectory, output_dir_exported } )
+    {
+        fs::remove_all( dir );
+        fs::create_directories( dir );
+    }
+
+    options.output_settings.agent_output_format = Config::AgentOutputFormat::Text;
+    auto simulation_text                        = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_text.run( output_dir_text );
+
+    options.output_settings.agent_output_format = Config::AgentOutputFormat::Trajectory;
+    auto simulation_trajectory                  = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_trajectory.run( output_dir_trajectory );
+
+    auto trajectory_file = output_dir_trajectory / fs::path( "trajectory.bin" );
+    REQUIRE( fs::exists( trajectory_file ) );
+    REQUIRE( !fs::exists( output_dir_trajectory / fs::path( "opinions_0.txt" ) ) );
+
+    // The exported files are identical to the ones written by agents_to_file
+    trajectory_to_text_files( trajectory_file.string(), output_dir_exported, 3 );
+
+    size_t n_files = 0;
+    for( const auto & entry : fs::directory_iterator( output_dir_text ) )
+    {
+        if( !entry.path().filename().string().starts_with( "opinions_" ) )
+            continue;
+        auto file_exported = output_dir_exported / entry.path().filename();
+        REQUIRE( fs::exists( file_exported ) );
+        REQUIRE( get_file_contents( entry.path().string() ) == get_file_contents( file_exported.string() ) );
+        n_files++;
+    }
+
+    TrajectoryReader reader( trajectory_file.string() );
+    REQUIRE( reader.has_footer() );
+    REQUIRE( reader.n_frames() == n_files );
+    REQUIRE( reader.n_frames() > 2 );
+    REQUIRE( reader.step( 0 ) == 0 );
+    REQUIRE( reader.step( 1 ) == 2 );
+    REQUIRE( reader.column_names() == agent_to_string_column_names<AgentT>() );
+
+    // The last frame holds the final state of the simulation
+    auto columns        = reader.read_frame( reader.n_frames() - 1 );
+    const auto & agents = simulation_trajectory.network.agents;
+    REQUIRE( columns.size() == 3 * agents.size() );
+    for( size_t i = 0; i < agents.size(); i++ )
+    {
+        REQUIRE( columns[i] == agents[i].data.opinion );
+        REQUIRE( columns[agents.size() + i] == agents[i].data.activity );
+        REQUIRE( columns[2 * agents.size() + i] == agents[i].data.reluctance );
+    }
+
+    // Simulate an interrupted run: the footer is missing and the last frame is only partially written
+    auto truncated_file = output_dir_trajectory / fs::path( "truncated.bin" );
+    fs::copy_file( trajectory_file, truncated_file );
+    const size_t frame_size = sizeof( Trajectory::FrameHeader ) + columns.size() * sizeof( double );
+    const size_t index_size = reader.n_frames() * sizeof( Trajectory::IndexEntry ) + sizeof( Trajectory::Footer );
+    fs::resize_file( truncated_file, fs::file_size( trajectory_file ) - index_size - frame_size / 2 );
+
+    TrajectoryReader reader_truncated( truncated_file.string() );
+    REQUIRE( !reader_truncated.has_footer() );
+    REQUIRE( reader_truncated.n_frames() == reader.n_frames() - 1 );
+    for( size_t idx_frame = 0; idx_frame < reader_truncated.n_frames(); idx_frame++ )
+    {
+        REQUIRE( reader_truncated.step( idx_frame ) == reader.step( idx_frame ) );
+        REQUIRE( reader_truncated.read_frame( idx_frame ) == reader.read_frame( idx_frame ) );
+    }
+}
+
+TEST_CASE( "Test the compression of trajectory files", "[io_trajectory_compression]" )
+{
+    using namespace Seldon;
+
+    const size_t n_agents = 500;
+    const size_t n_frames = 40;
+    const double bound    = 1e-6;
+    const auto names      = std::vector<std::string>{ "opinion", "activity", "reluctance" };
+    auto agent_indices    = std::vector<size_t>( n_agents );
+    std::iota( agent_indices.begin(), agent_indices.end(), 0 );
+
+    // The bit streams are little endian on every host
+    std::vector<char> bytes{};
+    BitWriter bit_writer( bytes );
+    bit_writer.write( 0x0304, 16 );
+    bit_writer.write( 0x5, 4 );
+    bit_writer.finish();
+    REQUIRE( bytes == std::vector<char>{ 0x04, 0x03, 0x05 } );
+    BitReader bit_reader( bytes.data(), bytes.size() );
+    REQUIRE( bit_reader.read( 16 ) == 0x0304 );
+    REQUIRE( bit_reader.read( 4 ) == 0x5 );
+
+    // Opinions perform small random walks, activities and reluctances are constant
+    std::mt19937 gen( 42 );
+    std::normal_distribution<double> dist( 0.0, 1e-3 );
+    std::vector<std::vector<double>> frames( n_frames, std::vector<double>( 3 * n_agents ) );
+    for( size_t i = 0; i < n_agents; i++ )
+    {
+        frames[0][i]                = dist( gen ) * 1e3;
+        frames[0][n_agents + i]     = 0.01 + 0.001 * double( i );
+        frames[0][2 * n_agents + i] = 1.0;
+    }
+    for( size_t idx_frame = 1; idx_frame < n_frames; idx_frame++ )
+    {
+        frames[idx_frame] = frames[idx_frame - 1];
+        for( size_t i = 0; i < n_agents; i++ )
+            frames[idx_frame][i] += dist( gen );
+    }
+    // Values that can not be quantized have to survive as well
+    frames[5][7]            = std::numeric_limits<double>::infinity();
+    frames[6][n_agents + 3] = std::numeric_limits<double>::quiet_NaN();
+
+    auto same_bits = []( const std::vector<double> & a, const std::vector<double> & b )
+    { return a.size() == b.size() && std::memcmp( a.data(), b.data(), a.size() * sizeof( double ) ) == 0; };
+
+    fs::path output_dir = fs::current_path() / fs::path( "test/output_io/compression" );
+    fs::remove_all( output_dir );
+    fs::create_directories( output_dir );
+
+    std::map<Config::TrajectoryCompression, size_t> file_sizes{};
+    for( auto compression : { Config::TrajectoryCompression::None, Config::TrajectoryCompression::Lossless,
+                              Config::TrajectoryCompression::Lossy } )
+    {
+        auto file = output_dir / fmt::format( "trajectory_{}.bin", int( compression ) );
+        {
+            TrajectoryWriter writer( file.string(), names, agent_indices, compression, bound, 8 );
+            for( size_t idx_frame = 0; idx_frame < n_frames; idx_frame++ )
+                writer.write_frame( idx_frame, frames[idx_frame] );
+        }
+        file_sizes[compression] = fs::file_size( file );
+
+        TrajectoryReader reader( file.string() );
+        REQUIRE( reader.n_frames() == n_frames );
+
+        // Random access, in an order that requires going back to keyframes and continuing from cached frames
+        for( size_t idx_frame : { 37, 3, 4, 5, 6, 7, 8, 0, 39, 17, 17, 16 } )
+        {
+            INFO( fmt::format( "compression = {}, idx_frame = {}", int( compression ), idx_frame ) );
+            auto columns       = reader.read_frame( idx_frame );
+            const auto & frame = frames[idx_frame];
+            if( compression != Config::TrajectoryCompression::Lossy )
+            {
+                REQUIRE( same_bits( columns, frame ) );
+                continue;
+            }
+
+            REQUIRE( columns.size() == frame.size() );
+            for( size_t i = 0; i < n_agents; i++ )
+            {
+                if( std::isfinite( frame[i] ) )
+                    REQUIRE( std::abs( columns[i] - frame[i] ) <= bound * ( 1.0 + 1e-9 ) );
+                else
+                    REQUIRE( std::isinf( columns[i] ) );
+            }
+            // Only the opinions are quantized
+            REQUIRE( std::memcmp(
+                         columns.data() + n_agents, frame.data() + n_agents, 2 * n_agents * sizeof( double ) )
+                     == 0 );
+        }
+    }
+
+    REQUIRE( file_sizes[Config::TrajectoryCompression::Lossless] < file_sizes[Config::TrajectoryCompression::None] );
+    REQUIRE( 5 * file_sizes[Config::TrajectoryCompression::Lossy] < file_sizes[Config::TrajectoryCompression::None] );
+}
+
+TEST_CASE( "Test writing out a subset of the agents", "[io_agent_subset]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+    fs::path output_dir = proj_root_path / fs::path( "test/output_io/subset" );
+    fs::remove_all( output_dir );
+
+    auto options                            = Config::parse_config_file( input_file.string() );
+    options.output_settings.n_output_agents = 5;
+
+    // Reference run, which writes all agents
+    auto run = [&]( const Config::SimulationOptions & options, const std::string & name )
+    {
+        fs::create_directories( output_dir / name );
+        auto simulation = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation.run( output_dir / name );
+        return simulation.output_agent_indices;
+    };
+    run( options, "all" );
+
+    auto check_subset = [&]( const std::string & name, const std::vector<size_t> & agent_indices )
+    {
+        for( const auto & entry : fs::directory_iterator( output_dir / "all" ) )
+        {
+            if( !entry.path().filename().string().starts_with( "opinions_" ) )
+                continue;
+            auto agents_all    = agents_from_file<AgentT>( entry.path().string() );
+            auto agents_subset = agents_from_file<AgentT>( ( output_dir / name / entry.path().filename() ).string() );
+            REQUIRE( agents_subset.size() == agent_indices.size() );
+            for( size_t i = 0; i < agent_indices.size(); i++ )
+            {
+                REQUIRE( agents_subset[i].data.opinion == agents_all[agent_indices[i]].data.opinion );
+            }
+
+            // The first column holds the indices of the agents
+            auto contents = get_file_contents( ( output_dir / name / entry.path().filename() ).string() );
+            auto row      = contents.substr( contents.find( '\n' ) + 1 );
+            REQUIRE( std::stoul( row.substr( 0, row.find( ',' ) ) ) == agent_indices.front() );
+        }
+    };
+
+    SECTION( "Agents from a file" )
+    {
+        fs::create_directories( output_dir );
+        auto id_file = output_dir / "ids.txt";
+        std::ofstream( id_file ) << "# tracked agents\n17\n3\n\n250\n";
+
+        options.output_settings.output_agents_file = id_file.string();
+        REQUIRE( run( options, "file" ) == std::vector<size_t>{ 17, 3, 250 } );
+        check_subset( "file", { 17, 3, 250 } );
+    }
+
+    SECTION( "Random sample, written synchronously, asynchronously and as trajectory" )
+    {
+        options.output_settings.output_agents_sample = 10;
+        auto agent_indices                           = run( options, "sample" ).value();
+        REQUIRE( agent_indices.size() == 10 );
+        REQUIRE( std::is_sorted( agent_indices.begin(), agent_indices.end() ) );
+        check_subset( "sample", agent_indices );
+
+        // The sample does not change the simulation, and does not depend on the output mode
+        options.output_settings.async_output = true;
+        REQUIRE( run( options, "sample_async" ).value() == agent_indices );
+        check_subset( "sample_async", agent_indices );
+
+        options.output_settings.agent_output_format = Config::AgentOutputFormat::Trajectory;
+        run( options, "sample_trajectory" );
+        TrajectoryReader reader( ( output_dir / "sample_trajectory" / "trajectory.bin" ).string() );
+        REQUIRE( reader.agent_indices() == agent_indices );
+    }
+
+    SECTION( "Only bots" )
+    {
+        auto bot_file     = proj_root_path / fs::path( "test/res/1bot_1agent_activity_prob.toml" );
+        auto options_bots = Config::parse_config_file( bot_file.string() );
+        options_bots.output_settings.n_output_agents  = 500;
+        options_bots.output_settings.output_bots_only = true;
+        REQUIRE( run( options_bots, "bots" ).value() == std::vector<size_t>{ 0 } );
+        REQUIRE( agents_from_file<AgentT>( ( output_dir / "bots" / "opinions_500.txt" ).string() ).size() == 1 );
+
+        options.output_settings.output_bots_only = true;
+        REQUIRE( run( options, "no_bots" ).value().empty() );
+    }
+}
+
+TEST_CASE( "Test the in-situ observables", "[io_observables]" )
+{
+    using namespace Seldon;
+    using namespace Catch::Matchers;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    using Obs = Config::Observable;
+    Config::OutputSettings settings{};
+    settings.observables       = { Obs::Mean,         Obs::Variance,  Obs::MeanAbs,
+                                   Obs::Polarization, Obs::Histogram, Obs::Clusters };
+    settings.histogram_bins    = 4;
+    settings.histogram_min     = -2.0;
+    settings.histogram_max     = 2.0;
+    settings.cluster_threshold = 0.5;
+
+    // Two equally large groups at -1 and +1, with one outlier outside of the histogram range
+    std::vector<double> opinions = { -1.0, -1.1, -0.9, 1.0, 1.1, 0.9, 5.0 };
+    for( size_t n_threads : { 1, 3, 8 } )
+    {
+        auto values = compute_observables( opinions, settings, n_threads );
+        REQUIRE_THAT( values.mean, WithinAbs( 5.0 / 7.0, 1e-14 ) );
+        REQUIRE_THAT( values.variance, WithinAbs( 31.04 / 7.0 - 25.0 / 49.0, 1e-12 ) );
+        REQUIRE_THAT( values.mean_abs, WithinAbs( 11.0 / 7.0, 1e-14 ) );
+        REQUIRE_THAT( values.polarization, WithinAbs( ( 1.0 - 1.0 / 7.0 ) * ( 2.0 + 1.0 ) / 2.0, 1e-14 ) );
+        REQUIRE( values.histogram == std::vector<size_t>{ 1, 2, 1, 3 } );
+        REQUIRE( values.n_clusters == 3 );
+    }
+
+    // A simulation writes the observables of the opinions that it writes out
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+    fs::path output_dir = proj_root_path / fs::path( "test/output_io/observables" );
+    fs::remove_all( output_dir );
+    fs::create_directories( output_dir );
+
+    auto options                                 = Config::parse_config_file( input_file.string() );
+    options.output_settings.n_output_agents      = 2;
+    options.output_settings.n_output_observables = 2;
+    options.output_settings.observables          = { Config::Observable::Mean, Config::Observable::Variance };
+    auto simulation                              = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation.run( output_dir );
+
+    auto contents = get_file_contents( ( output_dir / "observables.txt" ).string() );
+    REQUIRE( contents.starts_with( "# step, mean, variance\n" ) );
+
+    size_t n_rows     = 0;
+    size_t start_line = contents.find( '\n' ) + 1;
+    while( start_line < contents.size() )
+    {
+        auto end_line = contents.find( '\n', start_line );
+        auto line     = contents.substr( start_line, end_line - start_line );
+        start_line    = end_line + 1;
+
+        std::vector<double> row{};
+        auto callback = [&]( int, std::string & substr ) { row.push_back( std::stod( substr ) ); };
+        parse_comma_separated_list( line, callback );
+        REQUIRE( row.size() == 3 );
+
+        auto agents = agents_from_file<AgentT>(
+            ( output_dir / fmt::format( "opinions_{}.txt", size_t( row[0] ) ) ).string() );
+        double mean = 0;
+        for( const auto & agent : agents )
+            mean += agent.data.opinion / double( agents.size() );
+        REQUIRE_THAT( row[1], WithinAbs( mean, 1e-12 ) );
+        n_rows++;
+    }
+    REQUIRE( n_rows == 6 ); // Steps 0, 2, 4, 6, 8 and 10
+}
+
+TEST_CASE( "Test the contact event stream of the activity driven model", "[io_contact_events]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityDrivenModel::AgentT;
+
+    auto proj_root_path = fs::current_path();
+    auto input_file     = proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" );
+    fs::path output_dir = proj_root_path / fs::path( "test/output_io/contact_events" );
+    fs::remove_all( output_dir );
+    fs::create_directories( output_dir );
+
+    auto options                                  = Config::parse_config_file( input_file.string() );
+    options.output_settings.n_output_agents       = std::nullopt;
+    options.output_settings.n_output_network      = 1;
+    options.output_settings.output_contact_events = true;
+    auto simulation                               = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation.run( output_dir );
+
+    // The events of every step are the transposed edges of the network of that step
+    ContactEventReader reader( ( output_dir / "contacts.bin" ).string() );
+    REQUIRE( reader.n_agents() == simulation.network.n_agents() );
+
+    size_t n_steps = 0;
+    size_t step    = 0;
+    std::vector<ContactEvent> events{};
+    uintmax_t network_files_size = 0;
+    while( reader.read_step( step, events ) )
+    {
+        n_steps++;
+        REQUIRE( step == n_steps );
+
+        auto network_file = output_dir / fmt::format( "network_{}.txt", step );
+        network_files_size += fs::file_size( network_file );
+        auto network = NetworkGeneration::generate_from_file<AgentT>( network_file.string() );
+
+        std::vector<ContactEvent> edges{};
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            for( auto idx_neighbour : network.get_neighbours( idx_agent ) )
+                edges.emplace_back( idx_neighbour, idx_agent );
+        }
+        std::sort( edges.begin(), edges.end() );
+        std::sort( events.begin(), events.end() );
+        REQUIRE( events == edges );
+    }
+    REQUIRE( n_steps == 10 );
+
+    REQUIRE( 5 * fs::file_size( output_dir / "contacts.bin" ) < network_files_size );
+
+    // A truncated last step is treated as the end of the stream
+    fs::resize_file( output_dir / "contacts.bin", fs::file_size( output_dir / "contacts.bin" ) - 3 );
+    ContactEventReader reader_truncated( ( output_dir / "contacts.bin" ).string() );
+    n_steps = 0;
+    while( reader_truncated.read_step( step, events ) )
+        n_steps++;
+    REQUIRE( n_steps == 9 );
+
+    // Corrupted step headers are rejected before the payload is allocated
+    auto corrupt_step_header = [&]( std::streamoff offset, uint64_t value )
+    {
+        auto file_path = ( output_dir / "corrupted.bin" ).string();
+        {
+            ContactEventWriter writer( file_path, 4 );
+            const std::vector<ContactEvent> step_events = { { 0, 1 }, { 2, 3 } };
+            writer.write_step( 1, step_events );
+        }
+        std::fstream fs( file_path, std::ios::in | std::ios::out | std::ios::binary );
+        fs.seekp( sizeof( ContactEvents::file_magic ) + sizeof( uint32_t ) + sizeof( uint64_t ) + offset );
+        fs.write( reinterpret_cast<const char *>( &value ), sizeof( value ) );
+        return file_path;
+    };
+
+    // More events than the payload can hold
+    ContactEventReader reader_too_many_events( corrupt_step_header( sizeof( uint64_t ), uint64_t( 1 ) << 60 ) );
+    REQUIRE_THROWS( reader_too_many_events.read_step( step, events ) );
+
+    // A payload larger than the rest of the file
+    ContactEventReader reader_too_many_bytes( corrupt_step_header( 2 * sizeof( uint64_t ), uint64_t( 1 ) << 60 ) );
+    REQUIRE_FALSE( reader_too_many_bytes.read_step( step, events ) );
+}
+
+TEST_CASE( "Test restarting a simulation from a checkpoint", "[io_checkpoint]" )
+{
+    using namespace Seldon;
+
+    auto proj_root_path = fs::current_path();
+    fs::path output_dir = proj_root_path / fs::path( "test/output_io/checkpoint" );
+    fs::remove_all( output_dir );
+    fs::create_directories( output_dir );
+
+    // A simulation that is restarted from its last checkpoint ends in exactly the same state
+    auto check_restart = [&]( auto agent_tag, const std::string & config_file, size_t n_output_checkpoint )
+    {
+        using AgentT = decltype( agent_tag );
+
+        auto options = Config::parse_config_file( ( proj_root_path / fs::path( config_file ) ).string() );
+        options.output_settings.n_output_agents     = std::nullopt;
+        options.output_settings.output_initial      = false;
+        options.output_settings.n_output_checkpoint = n_output_checkpoint;
+        auto simulation                             = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation.run( output_dir );
+
+        options.output_settings.n_output_checkpoint = std::nullopt;
+        auto simulation_restarted                   = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+        simulation_restarted.restart( output_dir / "checkpoint.bin" );
+        simulation_restarted.run( output_dir );
+
+        REQUIRE( simulation_restarted.model->n_iterations() == simulation.model->n_iterations() );
+        for( size_t idx_agent = 0; idx_agent < simulation.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                agent_to_string( simulation_restarted.network.agents[idx_agent] )
+                == agent_to_string( simulation.network.agents[idx_agent] ) );
+            REQUIRE_THAT(
+                simulation_restarted.network.get_neighbours( idx_agent ),
+                Catch::Matchers::RangeEquals( simulation.network.get_neighbours( idx_agent ) ) );
+        }
+    };
+
+    check_restart( ActivityAgent{}, "test/res/activity_probabilistic_conf.toml", 6 );
+    check_restart( InertialAgent{}, "test/res/1bot_1agent_inertial.toml", 600 );
+    check_restart( DiscreteVectorAgent{}, "test/res/deffuant_vector_2agents.toml", 7 );
+
+    // The incremental mean-field weights continue from the opinions and normalisations they were computed with
+    {
+        auto options = Config::parse_config_file(
+            ( proj_root_path / fs::path( "test/res/10_agents_meanfield_activity.toml" ) ).string() );
+        options.output_settings.n_output_agents     = std::nullopt;
+        options.output_settings.output_initial      = false;
+        options.output_settings.n_output_checkpoint = 3;
+        options.network_settings.n_agents           = 50;
+
+        auto & model_settings = std::get<Config::ActivityDrivenSettings>( options.model_settings );
+        model_settings.max_iterations              = 7;
+        model_settings.homophily                   = 0.5;
+        model_settings.mean_field_mode             = Config::MeanFieldMode::Incremental;
+        model_settings.mean_field_drift_tolerance  = 5e-2;
+        model_settings.mean_field_refresh_interval = 5;
+        auto simulation = Simulation<ActivityAgent>( options, std::nullopt, std::nullopt );
+        simulation.run( output_dir );
+
+        options.output_settings.n_output_checkpoint = std::nullopt;
+        auto simulation_restarted                   = Simulation<ActivityAgent>( options, std::nullopt, std::nullopt );
+        simulation_restarted.restart( output_dir / "checkpoint.bin" );
+        simulation_restarted.run( output_dir );
+        for( size_t idx_agent = 0; idx_agent < simulation.network.n_agents(); idx_agent++ )
+        {
+            REQUIRE(
+                simulation_restarted.network.agents[idx_agent].data.opinion
+                == simulation.network.agents[idx_agent].data.opinion );
+        }
+    }
+
+    // SIGUSR1 writes a checkpoint after the current iteration, SIGTERM also stops the simulation
+    using AgentT = ActivityAgent;
+    auto options = Config::parse_config_file(
+        ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+    options.output_settings.n_output_agents = std::nullopt;
+    options.output_settings.output_initial  = false;
+    install_checkpoint_signal_handlers();
+
+    fs::remove( output_dir / "checkpoint.bin" );
+    std::raise( SIGUSR1 );
+    auto simulation_usr1 = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_usr1.run( output_dir );
+    REQUIRE( simulation_usr1.model->n_iterations() == 10 );
+    REQUIRE( fs::exists( output_dir / "checkpoint.bin" ) );
+
+    std::raise( SIGTERM );
+    auto simulation_term = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_term.run( output_dir );
+    REQUIRE( simulation_term.model->n_iterations() == 1 );
+
+    std::signal( SIGTERM, SIG_DFL );
+    std::signal( SIGUSR1, SIG_DFL );
+
+    // Both checkpoints were written after the first iteration
+    auto simulation_continued = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation_continued.restart( output_dir / "checkpoint.bin" );
+    simulation_continued.run( output_dir );
+    REQUIRE( simulation_continued.model->n_iterations() == 10 );
+    for( size_t idx_agent = 0; idx_agent < simulation_usr1.network.n_agents(); idx_agent++ )
+    {
+        REQUIRE(
+            simulation_continued.network.agents[idx_agent].data.opinion
+            == simulation_usr1.network.agents[idx_agent].data.opinion );
+    }
+
+    // A checkpoint of a host with the other byte order is rejected
+    auto write_byte_order_mark = [&]( uint32_t mark )
+    {
+        std::fstream fs( output_dir / "checkpoint.bin", std::ios::in | std::ios::out | std::ios::binary );
+        fs.seekp( sizeof( Checkpoint::file_magic ) );
+        fs.write( reinterpret_cast<const char *>( &mark ), sizeof( mark ) );
+    };
+    write_byte_order_mark( 0x04030201 );
+    auto simulation_swapped = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    REQUIRE_THROWS( simulation_swapped.restart( output_dir / "checkpoint.bin" ) );
+    write_byte_order_mark( Checkpoint::byte_order_mark );
+
+    // A corrupted checkpoint is rejected
+    {
+        std::fstream fs( output_dir / "checkpoint.bin", std::ios::in | std::ios::out | std::ios::binary );
+        fs.seekp( 100 );
+        fs.put( 'x' );
+    }
+    auto simulation_corrupted = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    REQUIRE_THROWS( simulation_corrupted.restart( output_dir / "checkpoint.bin" ) );
+}
+
+TEST_CASE( "Test publishing the state to shared memory", "[io_shared_state]" )
+{
+    using namespace Seldon;
+    using AgentT = ActivityAgent;
+
+    const std::string name = fmt::format( "/seldon_test_{}", getpid() );
+
+    auto network = NetworkGeneration::generate_fully_connected<AgentT>( 4, 0.5 );
+    for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+    {
+        network.agents[idx_agent].data.opinion  = 0.5 * double( idx_agent );
+        network.agents[idx_agent].data.activity = 1.0 + double( idx_agent );
+    }
+    const std::vector<size_t> agent_indices = { 1, 3 };
+    std::vector<double> columns{};
+    agents_to_columns( network.agents, agent_indices, columns );
+
+    {
+        // A round trip of the agents and the network
+        auto publisher = SharedStatePublisher(
+            name, agent_to_string_column_names<AgentT>(), agent_indices, 3, network.n_agents(), network.n_edges() );
+        auto reader = SharedStateReader( name );
+        REQUIRE( reader.column_names() == agent_to_string_column_names<AgentT>() );
+        REQUIRE_THAT( reader.agent_indices(), Catch::Matchers::RangeEquals( agent_indices ) );
+
+        SharedStateSnapshot snapshot{};
+        REQUIRE( !reader.read_latest( snapshot ) );
+
+        publisher.publish( 7, columns, network );
+        REQUIRE( reader.n_published() == 1 );
+        REQUIRE( reader.read_latest( snapshot ) );
+        REQUIRE( snapshot.step == 7 );
+        REQUIRE_THAT( snapshot.columns, Catch::Matchers::RangeEquals( columns ) );
+        REQUIRE( snapshot.has_network );
+        REQUIRE( snapshot.offsets.size() == network.n_agents() + 1 );
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            const auto begin = snapshot.offsets[idx_agent];
+            const auto end   = snapshot.offsets[idx_agent + 1];
+            REQUIRE_THAT(
+                std::vector<size_t>( snapshot.neighbours.begin() + begin, snapshot.neighbours.begin() + end ),
+                Catch::Matchers::RangeEquals( network.get_neighbours( idx_agent ) ) );
+            REQUIRE_THAT(
+                std::vector<double>( snapshot.weights.begin() + begin, snapshot.weights.begin() + end ),
+                Catch::Matchers::RangeEquals( network.get_weights( idx_agent ) ) );
+        }
+
+        // A network that holds the outgoing edges is published with the incoming neighbours
+        std::mt19937 gen( 0 );
+        auto network_outgoing = NetworkGeneration::generate_n_connections<AgentT>( 4, 2, false, gen );
+        network_outgoing.toggle_incoming_outgoing();
+        auto network_incoming = network_outgoing;
+        network_incoming.toggle_incoming_outgoing();
+        publisher.publish( 8, columns, network_outgoing );
+        REQUIRE( reader.read_latest( snapshot ) );
+        REQUIRE( snapshot.has_network );
+        for( size_t idx_agent = 0; idx_agent < network.n_agents(); idx_agent++ )
+        {
+            const auto begin = snapshot.offsets[idx_agent];
+            const auto end   = snapshot.offsets[idx_agent + 1];
+            REQUIRE_THAT(
+                std::vector<size_t>( snapshot.neighbours.begin() + begin, snapshot.neighbours.begin() + end ),
+                Catch::Matchers::RangeEquals( network_incoming.get_neighbours( idx_agent ) ) );
+            REQUIRE_THAT(
+                std::vector<double>( snapshot.weights.begin() + begin, snapshot.weights.begin() + end ),
+                Catch::Matchers::RangeEquals( network_incoming.get_weights( idx_agent ) ) );
+        }
+
+        // A network that does not fit into the slots is left out
+        network.push_back_neighbour_and_weight( 0, 0, 1.0 );
+        publisher.publish( 9, columns, network );
+        REQUIRE( reader.read_latest( snapshot ) );
+        REQUIRE( snapshot.step == 9 );
+        REQUIRE( !snapshot.has_network );
+    }
+
+    // The segment is removed with the publisher
+    REQUIRE_THROWS( SharedStateReader( name ) );
+
+    {
+        // Every value of a frame equals its step, so a torn read shows up as a mix of values
+        const std::vector<size_t> many_agents( 1000, 0 );
+        const size_t n_frames = 20000;
+        auto publisher        = SharedStatePublisher( name, { "step" }, many_agents, 2 );
+        auto reader           = SharedStateReader( name );
+
+        auto writer = std::thread(
+            [&]()
+            {
+                std::vector<double> frame( many_agents.size() );
+                for( size_t step = 1; step <= n_frames; step++ )
+                {
+                    std::fill( frame.begin(), frame.end(), double( step ) );
+                    publisher.publish( step, frame, network );
+                }
+            } );
+
+        SharedStateSnapshot snapshot{};
+        size_t last_step = 0;
+        while( last_step < n_frames )
+        {
+            if( !reader.read_latest( snapshot ) )
+                continue;
+            REQUIRE( snapshot.step >= last_step );
+            REQUIRE( std::all_of(
+                snapshot.columns.begin(), snapshot.columns.end(),
+                [&]( double value ) { return value == double( snapshot.step ); } ) );
+            last_step = snapshot.step;
+        }
+        writer.join();
+    }
+
+    // A simulation publishes its state while it runs and removes the segment at the end
+    auto proj_root_path = fs::current_path();
+    fs::path output_dir = proj_root_path / fs::path( "test/output_io/shared_state" );
+    fs::remove_all( output_dir );
+    fs::create_directories( output_dir );
+
+    auto options = Config::parse_config_file(
+        ( proj_root_path / fs::path( "test/res/activity_probabilistic_conf.toml" ) ).string() );
+    options.output_settings.n_output_agents        = std::nullopt;
+    options.output_settings.n_output_shared_memory = 1;
+    options.output_settings.shared_memory_name     = name;
+    options.output_settings.shared_memory_network  = true;
+    auto simulation                                = Simulation<AgentT>( options, std::nullopt, std::nullopt );
+    simulation.run( output_dir );
+    REQUIRE_THROWS( SharedStateReader( name ) );
 }
\ No newline at end of file
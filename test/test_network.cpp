@@ -196,4 +196,63 @@ TEST_CASE( "Testing the network class" )
             REQUIRE_THAT( neighbours, Catch::Matchers::UnorderedRangeEquals( desired_neighbour_list[i_agent] ) );
         }
     }
+
+    SECTION( "Test the threaded toggle_incoming_outgoing" )
+    {
+        // Agents with many edges in both directions, so that the chunks of sources are not of equal size
+        const size_t n_agents_skewed = 200;
+        std::uniform_int_distribution<size_t> dist_agent( 0, n_agents_skewed - 1 );
+        std::uniform_real_distribution<double> dist_weight( 0.0, 1.0 );
+        std::vector<std::vector<size_t>> neighbour_list( n_agents_skewed );
+        std::vector<std::vector<double>> weight_list( n_agents_skewed );
+        for( size_t i_agent = 0; i_agent < n_agents_skewed; i_agent++ )
+        {
+            const size_t n_neighbours = i_agent % 50 == 0 ? 600 : 10 + i_agent % 7;
+            for( size_t i_neighbour = 0; i_neighbour < n_neighbours; i_neighbour++ )
+            {
+                neighbour_list[i_agent].push_back( i_neighbour % 3 == 0 ? 5 : dist_agent( gen ) );
+                weight_list[i_agent].push_back( dist_weight( gen ) );
+            }
+        }
+
+        auto network_serial = Network(
+            std::vector<std::vector<size_t>>( neighbour_list ), std::vector<std::vector<double>>( weight_list ),
+            Network::EdgeDirection::Incoming );
+        network_serial.toggle_incoming_outgoing();
+        auto network_serial_back = network_serial;
+        network_serial_back.toggle_incoming_outgoing();
+
+        // The transposed lists are the same as the serial ones, in the same order
+        for( size_t n_threads : { 1, 2, 3, 7 } )
+        {
+            Parallel::ThreadPool thread_pool( n_threads );
+            auto network_threaded = Network(
+                std::vector<std::vector<size_t>>( neighbour_list ), std::vector<std::vector<double>>( weight_list ),
+                Network::EdgeDirection::Incoming );
+            network_threaded.toggle_incoming_outgoing( thread_pool );
+
+            REQUIRE( network_threaded.direction() == network_serial.direction() );
+            for( size_t i_agent = 0; i_agent < n_agents_skewed; i_agent++ )
+            {
+                REQUIRE_THAT(
+                    network_threaded.get_neighbours( i_agent ),
+                    Catch::Matchers::RangeEquals( network_serial.get_neighbours( i_agent ) ) );
+                REQUIRE_THAT(
+                    network_threaded.get_weights( i_agent ),
+                    Catch::Matchers::RangeEquals( network_serial.get_weights( i_agent ) ) );
+            }
+
+            // Toggling back reuses the buffers of the first toggle
+            network_threaded.toggle_incoming_outgoing( thread_pool );
+            for( size_t i_agent = 0; i_agent < n_agents_skewed; i_agent++ )
+            {
+                REQUIRE_THAT(
+                    network_threaded.get_neighbours( i_agent ),
+                    Catch::Matchers::RangeEquals( network_serial_back.get_neighbours( i_agent ) ) );
+                REQUIRE_THAT(
+                    network_threaded.get_weights( i_agent ),
+                    Catch::Matchers::RangeEquals( network_serial_back.get_weights( i_agent ) ) );
+            }
+        }
+    }
 }
\ No newline at end of file
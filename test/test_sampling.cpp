@@ -1,9 +1,13 @@
+#include "util/activation_sampler.hpp"
+#include "util/homophily_sampler.hpp"
 #include "util/math.hpp"
 #include <fmt/format.h>
 #include <algorithm>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <cmath>
 #include <cstddef>
+#include <numeric>
 #include <random>
 #include <set>
 #include <vector>
@@ -126,4 +130,140 @@ TEST_CASE( "Testing sampling functions" )
 
         // TODO: histogram and sigma test
     }
+
+    SECTION( "weighted_reservior_sampling_log", "The log space keys give the same samples as A_ExpJ" )
+    {
+        const size_t N_RUNS = 10000;
+        const size_t k      = 6;
+        const size_t n      = 100;
+
+        std::vector<double> weights( n );
+        for( size_t idx = 0; idx < n; idx++ )
+        {
+            weights[idx] = std::pow( std::max( 1e-10, std::abs( 0.3 - double( idx ) / n ) ), -1.5 );
+        }
+        weights[11] = 0.0;
+
+        Seldon::ReservoirWorkspace workspace{};
+        std::vector<size_t> buffer{};
+        std::vector<size_t> buffer_log{};
+        std::mt19937 gen1( 5 );
+        std::mt19937 gen2( 5 );
+        for( size_t i = 0; i < N_RUNS; i++ )
+        {
+            Seldon::reservoir_sampling_A_ExpJ( k, n, [&]( size_t idx ) { return weights[idx]; }, buffer, gen1 );
+            Seldon::reservoir_sampling_A_ExpJ_log( k, weights, buffer_log, gen2, workspace );
+            REQUIRE( buffer == buffer_log );
+        }
+    }
+}
+
+TEST_CASE( "Test sampling the contacts from the agents sorted by opinion", "[sampling_opinion_index]" )
+{
+    std::mt19937 gen( 12 );
+
+    // Agents 3 and 6 have the same opinion, agent 5 is within the tolerance of agent 0
+    const std::vector<double> opinions = { 0.1, -0.8, 0.45, -0.2, 0.9, 0.1 + 1e-12, -0.2, 0.3 };
+    const size_t n                     = opinions.size();
+    const size_t idx_agent             = 0;
+    const size_t k                     = 2;
+    const double homophily             = 1.5;
+
+    Seldon::HomophilySampler sampler{};
+    sampler.update( n, [&]( size_t i ) { return opinions[i]; } );
+
+    // Exact probability of every agent to be in a sample of k = 2, for successive sampling without replacement
+    std::vector<double> weights( n, 0.0 );
+    for( size_t j = 0; j < n; j++ )
+    {
+        if( j != idx_agent )
+            weights[j] = std::pow(
+                std::max( Seldon::HomophilySampler::tolerance, std::abs( opinions[idx_agent] - opinions[j] ) ),
+                -homophily );
+    }
+    const double total_weight = std::accumulate( weights.begin(), weights.end(), 0.0 );
+    std::vector<double> p_included( n, 0.0 );
+    for( size_t j = 0; j < n; j++ )
+    {
+        p_included[j] = weights[j] / total_weight;
+        for( size_t i = 0; i < n; i++ )
+        {
+            if( i != j && weights[i] > 0 )
+                p_included[j] += weights[i] / total_weight * weights[j] / ( total_weight - weights[i] );
+        }
+    }
+
+    const size_t N_RUNS = 100000;
+    std::vector<size_t> histogram( n, 0 );
+    std::vector<size_t> buffer{};
+    for( size_t run = 0; run < N_RUNS; run++ )
+    {
+        sampler.sample( idx_agent, k, homophily, buffer, gen );
+        REQUIRE( buffer.size() == k );
+        REQUIRE( buffer[0] != buffer[1] );
+        for( auto idx : buffer )
+            histogram[idx]++;
+    }
+
+    REQUIRE( histogram[idx_agent] == 0 );
+    for( size_t j = 0; j < n; j++ )
+    {
+        const double mean  = N_RUNS * p_included[j];
+        const double sigma = std::sqrt( N_RUNS * p_included[j] * ( 1.0 - p_included[j] ) );
+        INFO( fmt::format( "agent {}: {} drawn, {} expected", j, histogram[j], mean ) );
+        REQUIRE_THAT( double( histogram[j] ), Catch::Matchers::WithinAbs( mean, 5 * sigma + 1 ) );
+    }
+
+    // Asking for more agents than there are gives all other agents
+    sampler.sample( 4, 20, homophily, buffer, gen );
+    std::sort( buffer.begin(), buffer.end() );
+    REQUIRE( buffer == std::vector<size_t>{ 0, 1, 2, 3, 5, 6, 7 } );
+
+    // The order after an update does not depend on the previous order
+    std::vector<double> shuffled = opinions;
+    std::reverse( shuffled.begin(), shuffled.end() );
+    sampler.update( n, [&]( size_t i ) { return shuffled[i]; } );
+    sampler.update( n, [&]( size_t i ) { return opinions[i]; } );
+    std::mt19937 gen1( 3 );
+    std::mt19937 gen2( 3 );
+    Seldon::HomophilySampler sampler_fresh{};
+    sampler_fresh.update( n, [&]( size_t i ) { return opinions[i]; } );
+    std::vector<size_t> buffer_fresh{};
+    sampler.sample( 3, 3, homophily, buffer, gen1 );
+    sampler_fresh.sample( 3, 3, homophily, buffer_fresh, gen2 );
+    REQUIRE( buffer == buffer_fresh );
+}
+
+TEST_CASE( "Test sampling the activated agents from activity buckets", "[sampling_activation]" )
+{
+    std::mt19937 gen( 7 );
+
+    const std::vector<double> activities = { 0.01, 0.0, 1.0, 0.5, 0.3, 1.5, 0.75, 0.011, 0.25, 0.999, 1e-4, 0.3 };
+    const size_t n                       = activities.size();
+
+    Seldon::ActivationSampler sampler{};
+    sampler.build( n, [&]( size_t i ) { return activities[i]; } );
+    REQUIRE( sampler.n_agents() == n );
+
+    const size_t N_RUNS = 100000;
+    std::vector<size_t> histogram( n, 0 );
+    std::vector<size_t> activated{};
+    for( size_t run = 0; run < N_RUNS; run++ )
+    {
+        sampler.sample( gen, activated );
+        REQUIRE( std::is_sorted( activated.begin(), activated.end() ) );
+        REQUIRE( std::adjacent_find( activated.begin(), activated.end() ) == activated.end() );
+        for( auto idx : activated )
+            histogram[idx]++;
+    }
+
+    // Every agent is activated with the probability of its activity
+    for( size_t i = 0; i < n; i++ )
+    {
+        const double p     = std::min( 1.0, activities[i] );
+        const double mean  = N_RUNS * p;
+        const double sigma = std::sqrt( N_RUNS * p * ( 1.0 - p ) );
+        INFO( fmt::format( "activity {}: {} activations, {} expected", activities[i], histogram[i], mean ) );
+        REQUIRE_THAT( double( histogram[i] ), Catch::Matchers::WithinAbs( mean, 5 * sigma ) );
+    }
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #include "catch2/matchers/catch_matchers.hpp"
+#include "util/edge_hash_set.hpp"
 #include "util/math.hpp"
 #include "util/misc.hpp"
+#include "util/parallel.hpp"
+#include "util/segment_sum.hpp"
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
 
 TEST_CASE( "Test parse_comma_separated_list", "[util_parse_list]" )
 {
@@ -42,4 +49,141 @@ TEST_CASE( "Test Hamming distance", "[util_hamming_dist]" )
     auto dist = Seldon::hamming_distance( std::span( v1 ), std::span( v2 ) );
 
     REQUIRE( dist == 2 );
+}
+
+TEST_CASE( "Test the balanced chunks and the thread pool", "[util_parallel]" )
+{
+    using namespace Seldon::Parallel;
+
+    // A hub at index 2 gets a chunk of its own
+    const std::vector<size_t> costs = { 1, 1, 10, 1, 1, 1, 1, 1, 1, 1, 1 };
+    std::vector<size_t> bounds{};
+    balanced_chunk_bounds( costs.size(), 2, [&]( size_t i ) { return costs[i]; }, bounds );
+    REQUIRE( bounds == std::vector<size_t>{ 0, 3, 11 } );
+
+    // More chunks than items leaves chunks empty, but all items are covered
+    balanced_chunk_bounds( 2, 4, []( size_t ) { return 1; }, bounds );
+    REQUIRE( bounds.front() == 0 );
+    REQUIRE( bounds.back() == 2 );
+    REQUIRE( std::is_sorted( bounds.begin(), bounds.end() ) );
+
+    ThreadPool pool( 4 );
+    REQUIRE( pool.n_threads() == 4 );
+    std::vector<size_t> counts( pool.n_threads() );
+    for( size_t i = 0; i < 1000; i++ )
+    {
+        pool.run( [&]( size_t idx_chunk ) { counts[idx_chunk]++; } );
+    }
+    REQUIRE( counts == std::vector<size_t>( pool.n_threads(), 1000 ) );
+
+    REQUIRE_THROWS( pool.run(
+        [&]( size_t idx_chunk )
+        {
+            if( idx_chunk == 2 )
+                throw std::runtime_error( "Error in a chunk" );
+        } ) );
+    pool.run( [&]( size_t idx_chunk ) { counts[idx_chunk]++; } );
+    REQUIRE( counts == std::vector<size_t>( pool.n_threads(), 1001 ) );
+
+    // The background worker runs one task after the other on the same thread
+    BackgroundWorker worker{};
+    size_t n_tasks = 0;
+    for( size_t i = 0; i < 1000; i++ )
+        worker.start( [&]() { n_tasks++; } );
+    worker.wait();
+    REQUIRE( n_tasks == 1000 );
+
+    worker.start( []() { throw std::runtime_error( "Error in a task" ); } );
+    REQUIRE_THROWS( worker.wait() );
+    worker.start( [&]() { n_tasks++; } );
+    worker.wait();
+    REQUIRE( n_tasks == 1001 );
+}
+
+TEST_CASE( "Test the edge hash set", "[util_edge_hash_set]" )
+{
+    Seldon::EdgeHashSet edges{};
+    REQUIRE( !edges.contains( 0, 0 ) );
+
+    // Enough edges to grow the table several times, and refilled after clearing
+    for( size_t round = 0; round < 2; round++ )
+    {
+        edges.clear();
+        for( size_t i = 0; i < 100; i++ )
+        {
+            for( size_t j = 0; j < 10; j++ )
+                edges.insert( i, ( i * 7 + j * 13 ) % 100 );
+        }
+        edges.insert( 5, ( 5 * 7 ) % 100 ); // Already present
+
+        REQUIRE( edges.size() == 1000 );
+        for( size_t i = 0; i < 100; i++ )
+        {
+            for( size_t j = 0; j < 100; j++ )
+            {
+                bool expected = false;
+                for( size_t k = 0; k < 10; k++ )
+                    expected = expected || j == ( i * 7 + k * 13 ) % 100;
+                REQUIRE( edges.contains( i, j ) == expected );
+            }
+        }
+    }
+
+    edges.clear( 5000 );
+    REQUIRE( edges.size() == 0 );
+    REQUIRE( !edges.contains( 1, 7 ) );
+    edges.insert( size_t( 1 ) << 31, 3 );
+    REQUIRE( edges.contains( size_t( 1 ) << 31, 3 ) );
+    REQUIRE( !edges.contains( 3, size_t( 1 ) << 31 ) );
+}
+
+TEST_CASE( "Test the approximate weighted sum", "[util_segment_sum]" )
+{
+    using namespace Catch::Matchers;
+
+    // A kernel |x - x_p|^(-1/2) of positions sorted by x, with values of both signs
+    const size_t n_positions = 5000;
+    std::vector<double> x( n_positions );
+    std::vector<double> values( n_positions );
+    std::vector<double> value_sums( n_positions + 1, 0.0 );
+    for( size_t p = 0; p < n_positions; p++ )
+    {
+        x[p]              = -1.0 + 2.0 * double( p * p ) / double( n_positions * n_positions );
+        values[p]         = std::sin( 0.01 * double( p ) );
+        value_sums[p + 1] = value_sums[p] + values[p];
+    }
+
+    const double x0 = -0.3;
+    auto weight     = [&]( size_t p ) { return 1.0 / std::sqrt( std::abs( x0 - x[p] ) + 1e-10 ); };
+    auto value      = [&]( size_t p ) { return values[p]; };
+    auto range_sum  = [&]( size_t first, size_t last ) { return value_sums[last] - value_sums[first]; };
+
+    const size_t split = std::lower_bound( x.begin(), x.end(), x0 ) - x.begin();
+    double exact       = 0;
+    double sum_abs     = 0;
+    for( size_t p = 0; p < n_positions; p++ )
+    {
+        exact += weight( p ) * value( p );
+        sum_abs += std::abs( weight( p ) * value( p ) );
+    }
+
+    for( double tolerance : { 1e-2, 1e-4, 1e-8 } )
+    {
+        const double approximation
+            = Seldon::approximate_weighted_sum( 0, split, weight, value, range_sum, tolerance )
+              + Seldon::approximate_weighted_sum( split, n_positions, weight, value, range_sum, tolerance );
+        REQUIRE_THAT( approximation, WithinAbs( exact, tolerance * sum_abs ) );
+    }
+
+    // A constant weight is summed in one range
+    size_t n_evaluations = 0;
+    auto constant_weight = [&]( size_t )
+    {
+        n_evaluations++;
+        return 2.0;
+    };
+    REQUIRE_THAT(
+        Seldon::approximate_weighted_sum( 0, n_positions, constant_weight, value, range_sum, 1e-3 ),
+        WithinRel( 2.0 * value_sums[n_positions], 1e-12 ) );
+    REQUIRE( n_evaluations == 3 );
 }
\ No newline at end of file